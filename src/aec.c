@@ -68,15 +68,38 @@ int get_param(unsigned int *param, int *iarg, char *argv[])
     return 0;
 }
 
+struct files {
+    FILE *infp;
+    FILE *outfp;
+    unsigned char *in;
+    size_t chunk;
+};
+
+static size_t read_input(void *opaque, const unsigned char **data)
+{
+    struct files *files = opaque;
+
+    *data = files->in;
+    return fread(files->in, 1, files->chunk, files->infp);
+}
+
+static int write_output(void *opaque, const unsigned char *data,
+                        size_t len, unsigned char **next, size_t *avail)
+{
+    struct files *files = opaque;
+
+    (void)next;
+    (void)avail;
+    return len > 0 && fwrite(data, len, 1, files->outfp) != 1;
+}
+
 int main(int argc, char *argv[])
 {
     struct aec_stream strm;
+    struct files files;
     unsigned char *in;
-    unsigned char *out;
-    size_t total_out;
     unsigned int chunk;
     int status;
-    int input_avail, output_avail;
     char *infn, *outfn;
     FILE *infp, *outfp;
     int dflag;
@@ -154,20 +177,10 @@ int main(int argc, char *argv[])
         chunk *= 2;
     }
 
-    out = (unsigned char *)malloc(chunk);
     in = (unsigned char *)malloc(chunk);
-
-    if (in == NULL || out == NULL)
+    if (in == NULL)
         exit(-1);
 
-    total_out = 0;
-    strm.avail_in = 0;
-    strm.avail_out = chunk;
-    strm.next_out = out;
-
-    input_avail = 1;
-    output_avail = 1;
-
     if ((infp = fopen(infn, "rb")) == NULL) {
         fprintf(stderr, "ERROR: cannot open input file %s\n", infn);
         return 1;
@@ -176,6 +189,10 @@ int main(int argc, char *argv[])
         fprintf(stderr, "ERROR: cannot open output file %s\n", infn);
         return 1;
     }
+    files.infp = infp;
+    files.outfp = outfp;
+    files.in = in;
+    files.chunk = chunk;
 
     if (dflag)
         status = aec_decode_init(&strm);
@@ -187,54 +204,25 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    while(input_avail || output_avail) {
-        if (strm.avail_in == 0 && input_avail) {
-            strm.avail_in = fread(in, 1, chunk, infp);
-            if (strm.avail_in != chunk)
-                input_avail = 0;
-            strm.next_in = in;
-        }
-
-        if (dflag)
-            status = aec_decode(&strm, AEC_NO_FLUSH);
-        else
-            status = aec_encode(&strm, AEC_NO_FLUSH);
-
-        if (status != AEC_OK) {
-            fprintf(stderr, "ERROR: %i\n", status);
-            return 1;
-        }
-
-        if (strm.total_out - total_out > 0) {
-            fwrite(out, strm.total_out - total_out, 1, outfp);
-            total_out = strm.total_out;
-            output_avail = 1;
-            strm.next_out = out;
-            strm.avail_out = chunk;
-        } else {
-            output_avail = 0;
-        }
-
-    }
-
+    /* Output is written straight from the buffers of the library */
     if (dflag) {
+        status = aec_decode_callback(&strm, read_input, write_output,
+                                     &files);
         aec_decode_end(&strm);
     } else {
-        if ((status = aec_encode(&strm, AEC_FLUSH)) != AEC_OK) {
-            fprintf(stderr, "ERROR: while flushing output (%i)\n", status);
-            return 1;
-        }
-
-        if (strm.total_out - total_out > 0)
-            fwrite(out, strm.total_out - total_out, 1, outfp);
-
+        status = aec_encode_callback(&strm, read_input, write_output,
+                                     &files);
         aec_encode_end(&strm);
     }
 
+    if (status != AEC_OK) {
+        fprintf(stderr, "ERROR: %i\n", status);
+        return 1;
+    }
+
     fclose(infp);
     fclose(outfp);
     free(in);
-    free(out);
     return 0;
 
 FAIL:
@@ -244,7 +232,7 @@ FAIL:
     fprintf(stderr, "\nOPTIONS\n");
     fprintf(stderr, "\t-3\n\t\t24 bit samples are stored in 3 bytes\n");
     fprintf(stderr, "\t-N\n\t\tdisable pre/post processing\n");
-    fprintf(stderr, "\t-b size\n\t\tinternal buffer size in bytes\n");
+    fprintf(stderr, "\t-b size\n\t\tinput buffer size in bytes\n");
     fprintf(stderr, "\t-d\n\t\tdecode SOURCE. If -d is not used: encode.\n");
     fprintf(stderr, "\t-j samples\n\t\tblock size in samples\n");
     fprintf(stderr, "\t-m\n\t\tsamples are MSB first. Default is LSB\n");
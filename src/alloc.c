@@ -0,0 +1,106 @@
+/**
+ * @file alloc.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Memory allocation for encoder and decoder workspaces
+ *
+ */
+
+#include "config.h"
+#include "alloc.h"
+#include "libaec.h"
+#include <stdlib.h>
+
+#ifdef HAVE_MADVISE
+#include <sys/mman.h>
+#endif
+
+static void *default_alloc(size_t size, int huge_pages)
+{
+#if defined(HAVE_POSIX_MEMALIGN) && defined(HAVE_MADVISE) \
+    && defined(MADV_HUGEPAGE)
+    if (huge_pages && size >= HUGE_PAGE_SIZE) {
+        void *ptr;
+        size_t len = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+        if (posix_memalign(&ptr, HUGE_PAGE_SIZE, len) != 0)
+            return NULL;
+        /* Only a hint, the kernel may ignore it. */
+        madvise(ptr, len, MADV_HUGEPAGE);
+        return ptr;
+    }
+#else
+    (void)huge_pages;
+#endif
+    return malloc(size);
+}
+
+void aec_alloc_init(struct aec_alloc *alloc, const struct aec_stream *strm)
+{
+    if (strm->flags & AEC_CUSTOM_ALLOC) {
+        alloc->alloc_func = strm->alloc_func;
+        alloc->free_func = strm->free_func;
+        alloc->opaque = strm->opaque;
+    } else {
+        alloc->alloc_func = NULL;
+        alloc->free_func = NULL;
+        alloc->opaque = NULL;
+    }
+    alloc->huge_pages = (strm->flags & AEC_HUGE_PAGES) != 0;
+}
+
+void *aec_alloc(const struct aec_alloc *alloc, size_t size)
+{
+    if (alloc->alloc_func)
+        return alloc->alloc_func(alloc->opaque, size);
+    return default_alloc(size, alloc->huge_pages);
+}
+
+void aec_free(const struct aec_alloc *alloc, void *ptr)
+{
+    if (alloc->free_func)
+        alloc->free_func(alloc->opaque, ptr);
+    else
+        free(ptr);
+}
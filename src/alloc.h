@@ -0,0 +1,80 @@
+/**
+ * @file alloc.h
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Memory allocation for encoder and decoder workspaces
+ *
+ */
+
+#ifndef ALLOC_H
+#define ALLOC_H 1
+
+#include "config.h"
+#include <stddef.h>
+
+struct aec_stream;
+
+/* Workspaces of at least this size are backed by huge pages if
+ * requested */
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+struct aec_alloc {
+    void *(*alloc_func)(void *opaque, size_t size);
+    void (*free_func)(void *opaque, void *ptr);
+    void *opaque;
+
+    /* 1 if huge pages were requested */
+    int huge_pages;
+};
+
+void aec_alloc_init(struct aec_alloc *alloc, const struct aec_stream *strm);
+void *aec_alloc(const struct aec_alloc *alloc, size_t size);
+void aec_free(const struct aec_alloc *alloc, void *ptr);
+
+/* 1 if the workspace of an initialized stream was allocated by the
+ * library, 0 if it was provided by the caller */
+int aec_encode_owns_workspace(const struct aec_stream *strm);
+int aec_decode_owns_workspace(const struct aec_stream *strm);
+
+#endif /* ALLOC_H */
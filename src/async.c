@@ -0,0 +1,392 @@
+/**
+ * @file async.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Asynchronous encoding and decoding of buffers
+ *
+ * Submitted jobs wait in a bounded ring until one of the workers
+ * takes them. Workers feed the input of a job to the coder in chunks
+ * and check for cancellation between chunks, so a running job can
+ * be stopped without waiting for the whole buffer.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "encode.h"
+#include "threads.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Input bytes coded between checks for cancellation */
+#define JOB_CHUNK ((size_t)1 << 20)
+
+struct job {
+    struct aec_stream *strm;
+    aec_done_fn done;
+    void *arg;
+    int encode;
+};
+
+struct worker {
+    struct aec_async *async;
+    aec_thread_t thread;
+
+    /* job being coded, strm is NULL if idle */
+    struct job job;
+
+    /* set by aec_cancel() for the running job */
+    int cancel;
+};
+
+struct aec_async {
+    aec_mutex_t lock;
+
+    /* signalled when a job was queued or on shutdown */
+    aec_cond_t queued;
+
+    /* signalled when a job left the queue or finished */
+    aec_cond_t taken;
+
+    /* ring of waiting jobs */
+    struct job *queue;
+    size_t capacity;
+    size_t head;
+    size_t count;
+
+    /* number of jobs taken by workers and not yet completed */
+    size_t running;
+
+    struct worker *worker;
+    unsigned int threads;
+    int shutdown;
+};
+
+static int cancelled(struct worker *w)
+{
+    int cancel;
+
+    aec_mutex_lock(&w->async->lock);
+    cancel = w->cancel;
+    aec_mutex_unlock(&w->async->lock);
+    return cancel;
+}
+
+static int encode_job(struct worker *w, struct aec_stream *strm)
+{
+    const unsigned char *end = strm->next_in + strm->avail_in;
+    int status;
+
+    status = aec_encode_init(strm);
+    if (status != AEC_OK)
+        return status;
+
+    for (;;) {
+        size_t left = (size_t)(end - strm->next_in);
+        int flush = left <= JOB_CHUNK ? AEC_FLUSH : AEC_NO_FLUSH;
+
+        strm->avail_in = MIN(left, JOB_CHUNK);
+        status = aec_encode(strm, flush);
+        if (status != AEC_OK)
+            break;
+        if (flush == AEC_FLUSH) {
+            if (!strm->state->flushed)
+                status = AEC_STREAM_ERROR;
+            break;
+        }
+        if (strm->avail_out == 0) {
+            status = AEC_STREAM_ERROR;
+            break;
+        }
+        if (cancelled(w)) {
+            status = AEC_CANCELLED;
+            break;
+        }
+    }
+    strm->avail_in = (size_t)(end - strm->next_in);
+    aec_encode_end(strm);
+    return status;
+}
+
+static int decode_job(struct worker *w, struct aec_stream *strm)
+{
+    const unsigned char *end = strm->next_in + strm->avail_in;
+    int status;
+
+    status = aec_decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+
+    for (;;) {
+        const unsigned char *start = strm->next_in;
+        size_t left = (size_t)(end - start);
+
+        strm->avail_in = MIN(left, JOB_CHUNK);
+        status = aec_decode(strm, AEC_FLUSH);
+        if (status != AEC_OK
+            || strm->next_in == end
+            || strm->next_in == start
+            || strm->avail_out == 0)
+            break;
+        if (cancelled(w)) {
+            status = AEC_CANCELLED;
+            break;
+        }
+    }
+    strm->avail_in = (size_t)(end - strm->next_in);
+    aec_decode_end(strm);
+    return status;
+}
+
+static void *work(void *arg)
+{
+    struct worker *w = arg;
+    struct aec_async *async = w->async;
+
+    aec_mutex_lock(&async->lock);
+    for (;;) {
+        struct job job;
+        int status;
+
+        while (async->count == 0 && !async->shutdown)
+            aec_cond_wait(&async->queued, &async->lock);
+        if (async->count == 0)
+            break;
+
+        job = async->queue[async->head];
+        async->head = (async->head + 1) % async->capacity;
+        async->count--;
+        async->running++;
+        w->job = job;
+        w->cancel = 0;
+        aec_cond_broadcast(&async->taken);
+        aec_mutex_unlock(&async->lock);
+
+        if (job.encode)
+            status = encode_job(w, job.strm);
+        else
+            status = decode_job(w, job.strm);
+
+        aec_mutex_lock(&async->lock);
+        w->job.strm = NULL;
+        aec_mutex_unlock(&async->lock);
+
+        /* The stream belongs to the caller again once the callback
+         * runs. */
+        if (job.done)
+            job.done(job.strm, status, job.arg);
+
+        aec_mutex_lock(&async->lock);
+        async->running--;
+        aec_cond_broadcast(&async->taken);
+    }
+    aec_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+struct aec_async *aec_async_create(unsigned int threads, size_t queue_length)
+{
+    struct aec_async *async;
+
+    if (threads == 0)
+        threads = aec_cpu_count();
+    if (queue_length == 0)
+        queue_length = 2 * (size_t)threads;
+
+    async = malloc(sizeof(struct aec_async));
+    if (async == NULL)
+        return NULL;
+    memset(async, 0, sizeof(struct aec_async));
+    async->queue = malloc(queue_length * sizeof(struct job));
+    async->worker = malloc(threads * sizeof(struct worker));
+    if (async->queue == NULL || async->worker == NULL) {
+        free(async->queue);
+        free(async->worker);
+        free(async);
+        return NULL;
+    }
+    memset(async->worker, 0, threads * sizeof(struct worker));
+    async->capacity = queue_length;
+    aec_mutex_init(&async->lock);
+    aec_cond_init(&async->queued);
+    aec_cond_init(&async->taken);
+
+    for (unsigned int i = 0; i < threads; i++) {
+        struct worker *w = &async->worker[async->threads];
+
+        w->async = async;
+        if (aec_thread_create(&w->thread, work, w) == 0)
+            async->threads++;
+    }
+    if (async->threads == 0) {
+        aec_async_destroy(async);
+        return NULL;
+    }
+    return async;
+}
+
+void aec_async_destroy(struct aec_async *async)
+{
+    /**
+       Cancel waiting jobs, let running ones complete, and stop the
+       workers.
+    */
+
+    if (async == NULL)
+        return;
+
+    aec_mutex_lock(&async->lock);
+    while (async->count) {
+        struct job job = async->queue[async->head];
+
+        async->head = (async->head + 1) % async->capacity;
+        async->count--;
+        aec_mutex_unlock(&async->lock);
+        if (job.done)
+            job.done(job.strm, AEC_CANCELLED, job.arg);
+        aec_mutex_lock(&async->lock);
+    }
+    async->shutdown = 1;
+    aec_cond_broadcast(&async->queued);
+    aec_cond_broadcast(&async->taken);
+    aec_mutex_unlock(&async->lock);
+
+    for (unsigned int i = 0; i < async->threads; i++)
+        aec_thread_join(async->worker[i].thread);
+
+    aec_cond_destroy(&async->taken);
+    aec_cond_destroy(&async->queued);
+    aec_mutex_destroy(&async->lock);
+    free(async->worker);
+    free(async->queue);
+    free(async);
+}
+
+static int submit(struct aec_async *async, struct aec_stream *strm,
+                  aec_done_fn done, void *arg, int encode)
+{
+    struct job job;
+
+    job.strm = strm;
+    job.done = done;
+    job.arg = arg;
+    job.encode = encode;
+
+    aec_mutex_lock(&async->lock);
+    while (async->count == async->capacity && !async->shutdown)
+        aec_cond_wait(&async->taken, &async->lock);
+    if (async->shutdown) {
+        aec_mutex_unlock(&async->lock);
+        return AEC_STREAM_ERROR;
+    }
+    async->queue[(async->head + async->count) % async->capacity] = job;
+    async->count++;
+    aec_cond_signal(&async->queued);
+    aec_mutex_unlock(&async->lock);
+    return AEC_OK;
+}
+
+int aec_submit_encode(struct aec_async *async, struct aec_stream *strm,
+                      aec_done_fn done, void *arg)
+{
+    return submit(async, strm, done, arg, 1);
+}
+
+int aec_submit_decode(struct aec_async *async, struct aec_stream *strm,
+                      aec_done_fn done, void *arg)
+{
+    return submit(async, strm, done, arg, 0);
+}
+
+int aec_cancel(struct aec_async *async, struct aec_stream *strm)
+{
+    /**
+       A waiting job is removed from the queue and completed right
+       away. A running job is only flagged and completes in its
+       worker.
+    */
+
+    struct job job = {NULL, NULL, NULL, 0};
+    int found = 0;
+
+    aec_mutex_lock(&async->lock);
+    for (size_t i = 0; i < async->count; i++) {
+        size_t k = (async->head + i) % async->capacity;
+
+        if (async->queue[k].strm != strm)
+            continue;
+        job = async->queue[k];
+        for (; i + 1 < async->count; i++) {
+            size_t next = (async->head + i + 1) % async->capacity;
+
+            async->queue[(async->head + i) % async->capacity] =
+                async->queue[next];
+        }
+        async->count--;
+        aec_cond_broadcast(&async->taken);
+        found = 1;
+        break;
+    }
+    if (!found) {
+        for (unsigned int i = 0; i < async->threads; i++) {
+            if (async->worker[i].job.strm == strm) {
+                async->worker[i].cancel = 1;
+                found = 2;
+            }
+        }
+    }
+    aec_mutex_unlock(&async->lock);
+
+    if (found == 1 && job.done)
+        job.done(job.strm, AEC_CANCELLED, job.arg);
+    return found ? AEC_OK : AEC_STREAM_ERROR;
+}
+
+void aec_async_wait(struct aec_async *async)
+{
+    aec_mutex_lock(&async->lock);
+    while (async->count || async->running)
+        aec_cond_wait(&async->taken, &async->lock);
+    aec_mutex_unlock(&async->lock);
+}
@@ -0,0 +1,325 @@
+/**
+ * @file batch.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Encoding and decoding of many independent buffers
+ *
+ * Every worker owns a contiguous range of buffers and takes them
+ * from the front. A worker which runs out of buffers steals the back
+ * half of the range of another worker. Each worker keeps one stream
+ * which is reset for every buffer.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "encode.h"
+#include "alloc.h"
+#include "threads.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct worker {
+    struct batch *batch;
+
+    /* stream reused for all buffers of this worker */
+    struct aec_stream ctx;
+
+    /* buffers not yet taken */
+    aec_mutex_t lock;
+    size_t begin;
+    size_t end;
+
+    /* first buffer this worker failed on, n if none */
+    size_t failed;
+    int failed_status;
+};
+
+struct batch {
+    struct aec_stream *strm;
+    int *status;
+    int encode;
+
+    struct worker *worker;
+    unsigned int threads;
+};
+
+static int same_alloc(const struct aec_stream *a, const struct aec_stream *b)
+{
+    /**
+       Reset keeps the allocator of a stream, so it can only be
+       reused for buffers with the same memory settings.
+    */
+
+    unsigned int mask = AEC_CUSTOM_ALLOC | AEC_HUGE_PAGES;
+
+    if ((a->flags & mask) != (b->flags & mask))
+        return 0;
+    if (a->flags & AEC_CUSTOM_ALLOC)
+        return a->alloc_func == b->alloc_func
+            && a->free_func == b->free_func
+            && a->opaque == b->opaque;
+    return 1;
+}
+
+static void end_ctx(struct worker *w)
+{
+    if (w->ctx.state == NULL)
+        return;
+    if (w->batch->encode)
+        aec_encode_end(&w->ctx);
+    else
+        aec_decode_end(&w->ctx);
+    w->ctx.state = NULL;
+}
+
+static int code(struct worker *w, struct aec_stream *strm)
+{
+    /**
+       Encode or decode one buffer with the stream of worker w.
+    */
+
+    struct aec_stream *ctx = &w->ctx;
+    int encode = w->batch->encode;
+    int status;
+
+    if (ctx->state && !same_alloc(ctx, strm))
+        end_ctx(w);
+
+    ctx->bits_per_sample = strm->bits_per_sample;
+    ctx->block_size = strm->block_size;
+    ctx->rsi = strm->rsi;
+    /* Buffers are already coded concurrently */
+    ctx->flags = strm->flags & ~AEC_PIPELINE;
+    ctx->alloc_func = strm->alloc_func;
+    ctx->free_func = strm->free_func;
+    ctx->opaque = strm->opaque;
+    ctx->sample_stride = strm->sample_stride;
+
+    if (ctx->state)
+        status = encode ? aec_encode_reset(ctx) : aec_decode_reset(ctx);
+    else
+        status = encode ? aec_encode_init(ctx) : aec_decode_init(ctx);
+    if (status != AEC_OK)
+        return status;
+
+    ctx->next_in = strm->next_in;
+    ctx->avail_in = strm->avail_in;
+    ctx->next_out = strm->next_out;
+    ctx->avail_out = strm->avail_out;
+
+    if (encode) {
+        status = aec_encode(ctx, AEC_FLUSH);
+        if (status == AEC_OK && !ctx->state->flushed)
+            status = AEC_STREAM_ERROR;
+    } else {
+        status = aec_decode(ctx, AEC_FLUSH);
+    }
+
+    strm->next_in = ctx->next_in;
+    strm->avail_in = ctx->avail_in;
+    strm->total_in = ctx->total_in;
+    strm->next_out = ctx->next_out;
+    strm->avail_out = ctx->avail_out;
+    strm->total_out = ctx->total_out;
+    return status;
+}
+
+static int take(struct worker *w, size_t *i)
+{
+    int found = 0;
+
+    aec_mutex_lock(&w->lock);
+    if (w->begin < w->end) {
+        *i = w->begin++;
+        found = 1;
+    }
+    aec_mutex_unlock(&w->lock);
+    return found;
+}
+
+static int steal(struct worker *w)
+{
+    /**
+       Move the back half of the range of another worker to w.
+    */
+
+    struct batch *batch = w->batch;
+    size_t self = (size_t)(w - batch->worker);
+
+    for (unsigned int j = 1; j < batch->threads; j++) {
+        struct worker *v = &batch->worker[(self + j) % batch->threads];
+        size_t begin = 0, end = 0;
+
+        aec_mutex_lock(&v->lock);
+        if (v->begin < v->end) {
+            end = v->end;
+            begin = v->end - (v->end - v->begin + 1) / 2;
+            v->end = begin;
+        }
+        aec_mutex_unlock(&v->lock);
+
+        if (begin < end) {
+            aec_mutex_lock(&w->lock);
+            w->begin = begin;
+            w->end = end;
+            aec_mutex_unlock(&w->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *run(void *arg)
+{
+    struct worker *w = arg;
+    struct batch *batch = w->batch;
+    size_t i;
+
+    do {
+        while (take(w, &i)) {
+            int status = code(w, &batch->strm[i]);
+            if (batch->status)
+                batch->status[i] = status;
+            if (status != AEC_OK && i < w->failed) {
+                w->failed = i;
+                w->failed_status = status;
+            }
+        }
+    } while (steal(w));
+
+    end_ctx(w);
+    return NULL;
+}
+
+static int batch_code(struct aec_stream *strm, size_t n, int *status,
+                      unsigned int threads, int encode)
+{
+    struct aec_alloc alloc;
+    struct batch batch;
+    aec_thread_t *thread;
+    int *started;
+    unsigned int locks = 0;
+    size_t failed = n;
+    int result = AEC_OK;
+
+    if (n == 0)
+        return AEC_OK;
+    if (threads == 0)
+        threads = aec_cpu_count();
+    if (threads > n)
+        threads = (unsigned int)n;
+
+    batch.strm = strm;
+    batch.status = status;
+    batch.encode = encode;
+    batch.threads = threads;
+    /* Bookkeeping comes from the allocator of the first stream */
+    aec_alloc_init(&alloc, strm);
+    batch.worker = aec_alloc(&alloc, threads * sizeof(struct worker));
+    thread = aec_alloc(&alloc, threads * sizeof(aec_thread_t));
+    started = aec_alloc(&alloc, threads * sizeof(int));
+    if (batch.worker == NULL || thread == NULL || started == NULL) {
+        result = AEC_MEM_ERROR;
+        goto CLEANUP;
+    }
+    memset(batch.worker, 0, threads * sizeof(struct worker));
+    memset(started, 0, threads * sizeof(int));
+
+    for (locks = 0; locks < threads; locks++) {
+        struct worker *w = &batch.worker[locks];
+
+        if (aec_mutex_init(&w->lock) != 0) {
+            result = AEC_MEM_ERROR;
+            goto CLEANUP;
+        }
+        w->batch = &batch;
+        w->begin = n * locks / threads;
+        w->end = n * (locks + 1) / threads;
+        w->failed = n;
+    }
+
+    /* Buffers of workers which fail to start are stolen by others */
+    for (unsigned int t = 1; t < threads; t++)
+        started[t] = aec_thread_create(&thread[t], run,
+                                       &batch.worker[t]) == 0;
+    run(&batch.worker[0]);
+
+    for (unsigned int t = 0; t < threads; t++) {
+        struct worker *w = &batch.worker[t];
+
+        if (t > 0 && started[t])
+            aec_thread_join(thread[t]);
+        if (w->failed < failed) {
+            failed = w->failed;
+            result = w->failed_status;
+        }
+    }
+
+CLEANUP:
+    for (unsigned int t = 0; t < locks; t++)
+        aec_mutex_destroy(&batch.worker[t].lock);
+    if (result == AEC_MEM_ERROR && failed == n && status)
+        for (size_t i = 0; i < n; i++)
+            status[i] = AEC_MEM_ERROR;
+    if (batch.worker)
+        aec_free(&alloc, batch.worker);
+    if (thread)
+        aec_free(&alloc, thread);
+    if (started)
+        aec_free(&alloc, started);
+    return result;
+}
+
+int aec_buffer_encode_batch(struct aec_stream *strm, size_t n,
+                            int *status, unsigned int threads)
+{
+    return batch_code(strm, n, status, threads, 1);
+}
+
+int aec_buffer_decode_batch(struct aec_stream *strm, size_t n,
+                            int *status, unsigned int threads)
+{
+    return batch_code(strm, n, status, threads, 0);
+}
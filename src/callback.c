@@ -0,0 +1,391 @@
+/**
+ * @file callback.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Encoding and decoding driven by callbacks for input and output
+ *
+ * Input spans of the source are handed to the coder as they are.
+ * Only a sample which is split between two spans is completed in a
+ * small carry buffer. Output goes to buffers provided by the sink
+ * or, if it has none, to a staging buffer whose filled parts are
+ * passed to the sink.
+ *
+ * Scatter-gather coding runs on the same driver with a source and a
+ * sink which walk arrays of segments. A decoded sample which does
+ * not fit into the rest of an output segment is written to a buffer
+ * of one sample and split between the segments.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "alloc.h"
+#include <string.h>
+
+#define MIN(a, b) (((a) < (b))? (a): (b))
+
+/* Size of the staging buffer for output */
+#define STAGE_SIZE ((size_t)1 << 16)
+
+struct source {
+    aec_source_func func;
+    void *opaque;
+
+    /* Part of the current span not handed to the coder yet */
+    const unsigned char *rest;
+    size_t rest_len;
+
+    /* Sample split between two spans */
+    unsigned char carry[4];
+
+    /* 1 once the source has no more input */
+    int eof;
+};
+
+struct sink {
+    aec_sink_func func;
+    void *opaque;
+    struct aec_alloc alloc;
+    unsigned char *stage;
+
+    /* Output buffers are used in multiples of this many bytes */
+    size_t unit;
+
+    /* Start of the output buffer handed to the coder */
+    unsigned char *start;
+};
+
+static int next_span(struct source *src)
+{
+    while (src->rest_len == 0 && !src->eof) {
+        src->rest_len = src->func(src->opaque, &src->rest);
+        if (src->rest_len == 0)
+            src->eof = 1;
+    }
+    return src->rest_len > 0;
+}
+
+static void refill(struct aec_stream *strm, struct source *src, size_t unit)
+{
+    /**
+       Give the coder more input. Called when less than unit bytes
+       are left. A partial sample is completed from the following
+       spans in the carry buffer.
+    */
+
+    size_t n = strm->avail_in;
+
+    if (n == 0) {
+        if (next_span(src)) {
+            strm->next_in = src->rest;
+            strm->avail_in = src->rest_len;
+            src->rest_len = 0;
+        }
+        return;
+    }
+
+    memmove(src->carry, strm->next_in, n);
+    while (n < unit && next_span(src)) {
+        size_t take = MIN(unit - n, src->rest_len);
+
+        memcpy(src->carry + n, src->rest, take);
+        src->rest += take;
+        src->rest_len -= take;
+        n += take;
+    }
+    strm->next_in = src->carry;
+    strm->avail_in = n;
+}
+
+static int emit(struct aec_stream *strm, struct sink *snk)
+{
+    /**
+       Pass the output since the last call to the sink and set up the
+       next output buffer. The decoder only writes whole samples, so
+       buffers are cut to a multiple of their size.
+    */
+
+    size_t len = (size_t)(strm->next_out - snk->start);
+    unsigned char *next = NULL;
+    size_t avail = 0;
+
+    if (snk->func(snk->opaque, len ? snk->start : NULL, len,
+                  &next, &avail))
+        return AEC_CANCELLED;
+
+    if (next != NULL)
+        avail -= avail % snk->unit;
+    if (next == NULL || avail == 0) {
+        if (snk->stage == NULL) {
+            snk->stage = aec_alloc(&snk->alloc, STAGE_SIZE);
+            if (snk->stage == NULL)
+                return AEC_MEM_ERROR;
+        }
+        next = snk->stage;
+        avail = STAGE_SIZE - STAGE_SIZE % snk->unit;
+    }
+    strm->next_out = next;
+    strm->avail_out = avail;
+    snk->start = next;
+    return AEC_OK;
+}
+
+static int drive(struct aec_stream *strm,
+                 int (*code)(struct aec_stream *, int), int flush,
+                 size_t unit, struct source *src, struct sink *snk)
+{
+    int status;
+
+    /* Split samples are assembled from adjacent bytes of whole
+     * samples */
+    if (strm->flags & (AEC_DATA_STRIDED | AEC_DATA_PACKED))
+        return AEC_CONF_ERROR;
+
+    strm->avail_in = 0;
+    strm->next_out = NULL;
+    snk->start = NULL;
+    status = emit(strm, snk);
+
+    while (status == AEC_OK) {
+        size_t avail_in;
+        size_t avail_out;
+
+        if (strm->avail_in < unit && !src->eof)
+            refill(strm, src, unit);
+
+        avail_in = strm->avail_in;
+        avail_out = strm->avail_out;
+        status = code(strm, src->eof ? flush : AEC_NO_FLUSH);
+        if (status != AEC_OK)
+            break;
+
+        if (strm->avail_out == 0) {
+            status = emit(strm, snk);
+        } else if (src->eof && strm->avail_in < unit) {
+            if (strm->next_out != snk->start)
+                status = emit(strm, snk);
+            break;
+        } else if (strm->avail_in == avail_in
+                   && strm->avail_out == avail_out
+                   && strm->avail_in >= unit) {
+            /* The coder neither took input nor gave output */
+            status = AEC_STREAM_ERROR;
+        }
+    }
+
+    /* Nothing handed out stays referenced by strm */
+    strm->next_in = NULL;
+    strm->avail_in = 0;
+    strm->next_out = NULL;
+    strm->avail_out = 0;
+    if (snk->stage)
+        aec_free(&snk->alloc, snk->stage);
+    return status;
+}
+
+static size_t sample_bytes(const struct aec_stream *strm)
+{
+    if (strm->bits_per_sample > 16)
+        return strm->flags & AEC_DATA_3BYTE
+            && strm->bits_per_sample <= 24 ? 3 : 4;
+    else if (strm->bits_per_sample > 8)
+        return 2;
+    else
+        return 1;
+}
+
+int aec_encode_callback(struct aec_stream *strm, aec_source_func source,
+                        aec_sink_func sink, void *opaque)
+{
+    struct source src = {source, opaque, NULL, 0, {0}, 0};
+    struct sink snk = {sink, opaque, {0}, NULL, 1, NULL};
+
+    aec_alloc_init(&snk.alloc, strm);
+    return drive(strm, aec_encode, AEC_FLUSH, sample_bytes(strm),
+                 &src, &snk);
+}
+
+int aec_decode_callback(struct aec_stream *strm, aec_source_func source,
+                        aec_sink_func sink, void *opaque)
+{
+    struct source src = {source, opaque, NULL, 0, {0}, 0};
+    struct sink snk = {sink, opaque, {0}, NULL, 0, NULL};
+
+    snk.unit = sample_bytes(strm);
+    aec_alloc_init(&snk.alloc, strm);
+    return drive(strm, aec_decode, AEC_FLUSH, 1, &src, &snk);
+}
+
+struct segments {
+    const struct aec_iovec *in;
+    size_t in_count;
+    const struct aec_iovec *out;
+    size_t out_count;
+
+    /* Position in the output segments */
+    size_t seg;
+    size_t pos;
+
+    /* Sample which straddles two output segments */
+    unsigned char split[4];
+    size_t unit;
+
+    /* 1 if output stopped because all segments are full */
+    int full;
+};
+
+static size_t next_segment(void *opaque, const unsigned char **data)
+{
+    struct segments *v = opaque;
+
+    while (v->in_count > 0 && v->in->len == 0) {
+        v->in++;
+        v->in_count--;
+    }
+    if (v->in_count == 0)
+        return 0;
+    *data = v->in->base;
+    v->in_count--;
+    return (v->in++)->len;
+}
+
+static void scatter(struct segments *v, const unsigned char *data,
+                    size_t len)
+{
+    while (len > 0) {
+        size_t n = MIN(len, v->out[v->seg].len - v->pos);
+
+        memcpy((unsigned char *)v->out[v->seg].base + v->pos, data, n);
+        data += n;
+        len -= n;
+        v->pos += n;
+        if (v->pos == v->out[v->seg].len) {
+            v->seg++;
+            v->pos = 0;
+        }
+    }
+}
+
+static int fill_segment(void *opaque, const unsigned char *data,
+                        size_t len, unsigned char **next, size_t *avail)
+{
+    /**
+       Advance past the output written since the last call and hand
+       out the rest of the current segment in whole samples, or the
+       split buffer if less than a sample is left in it.
+    */
+
+    struct segments *v = opaque;
+    size_t left;
+    size_t rest = 0;
+
+    if (data == v->split) {
+        scatter(v, data, len);
+    } else {
+        v->pos += len;
+    }
+
+    while (v->seg < v->out_count && v->pos == v->out[v->seg].len) {
+        v->seg++;
+        v->pos = 0;
+    }
+    if (v->seg == v->out_count) {
+        v->full = 1;
+        return 1;
+    }
+
+    left = v->out[v->seg].len - v->pos;
+    if (left >= v->unit) {
+        *next = (unsigned char *)v->out[v->seg].base + v->pos;
+        *avail = left - left % v->unit;
+        return 0;
+    }
+
+    /* A sample is only split if the following segments can take the
+     * rest of it */
+    for (size_t i = v->seg; i < v->out_count && rest < v->unit; i++)
+        rest += v->out[i].len - (i == v->seg ? v->pos : 0);
+    if (rest < v->unit) {
+        v->full = 1;
+        return 1;
+    }
+    *next = v->split;
+    *avail = v->unit;
+    return 0;
+}
+
+static int code_v(struct aec_stream *strm,
+                  int (*code)(struct aec_stream *, int), size_t in_unit,
+                  size_t out_unit, const struct aec_iovec *in,
+                  size_t in_count, const struct aec_iovec *out,
+                  size_t out_count, int flush)
+{
+    struct segments v = {in, in_count, out, out_count, 0, 0, {0},
+                         out_unit, 0};
+    struct source src = {next_segment, &v, NULL, 0, {0}, 0};
+    struct sink snk = {fill_segment, &v, {0}, NULL, out_unit, NULL};
+    int status;
+
+    aec_alloc_init(&snk.alloc, strm);
+    status = drive(strm, code, flush, in_unit, &src, &snk);
+    if (status == AEC_CANCELLED && v.full)
+        status = AEC_OK;
+    return status;
+}
+
+int aec_encode_v(struct aec_stream *strm,
+                 const struct aec_iovec *in, size_t in_count,
+                 const struct aec_iovec *out, size_t out_count, int flush)
+{
+    return code_v(strm, aec_encode, sample_bytes(strm), 1,
+                  in, in_count, out, out_count, flush);
+}
+
+int aec_decode_v(struct aec_stream *strm,
+                 const struct aec_iovec *in, size_t in_count,
+                 const struct aec_iovec *out, size_t out_count, int flush)
+{
+    return code_v(strm, aec_decode, 1, sample_bytes(strm),
+                  in, in_count, out, out_count, flush);
+}
@@ -0,0 +1,180 @@
+/**
+ * @file concat.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Joining of independently encoded segments
+ *
+ * RSIs do not depend on each other, so a stream can be continued
+ * with the RSIs of another one as long as the first ends at an RSI
+ * boundary. The option IDs and code lengths of every segment but the
+ * last are scanned to find the end of its last RSI. With AEC_PAD_RSI
+ * that has to be the end of the segment, and segments are copied as
+ * they are. Otherwise a segment ends with up to seven zero bits of
+ * padding after its last RSI, which have to be dropped. Their number
+ * is not recorded in the stream, so the next segment is copied behind
+ * the scanned end with a shift.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "decode.h"
+#include "alloc.h"
+#include "scan.h"
+#include <stdint.h>
+#include <string.h>
+
+static int rsi_end(const struct aec_stream *strm, int id_len,
+                   const unsigned char *in, size_t len, size_t *bits)
+{
+    /**
+       Scan the segment at in and store the bit position following
+       its last complete RSI in bits. Everything after that position
+       has to be zero padding of less than a byte, which is none with
+       AEC_PAD_RSI.
+    */
+
+    struct scanner s;
+    size_t end = 0;
+
+    s.data = in;
+    s.pos = 0;
+    s.end = len * 8;
+    while (scan_rsi(&s, strm, id_len))
+        end = s.pos;
+
+    if (len != (end + 7) / 8
+        || (end % 8 && (in[len - 1] & (0xff >> end % 8)) != 0))
+        return AEC_DATA_ERROR;
+
+    *bits = end;
+    return AEC_OK;
+}
+
+static void append(unsigned char *out, size_t out_bit,
+                   const unsigned char *src, size_t nbits)
+{
+    /**
+       Copy nbits from src to out starting at bit out_bit. Bits in
+       front of out_bit are preserved.
+    */
+
+    unsigned char *d = out + out_bit / 8;
+    int shift = out_bit % 8;
+    size_t nbytes = (nbits + 7) / 8;
+    unsigned char carry;
+
+    if (shift == 0) {
+        memcpy(d, src, nbytes);
+        return;
+    }
+
+    carry = *d & (0xff00 >> shift);
+    for (size_t i = 0; i < nbytes; i++) {
+        d[i] = carry | (unsigned char)(src[i] >> shift);
+        carry = (unsigned char)(src[i] << (8 - shift));
+    }
+    if ((out_bit + nbits + 7) / 8 > out_bit / 8 + nbytes)
+        d[nbytes] = carry;
+}
+
+int aec_concat(struct aec_stream *strm, const unsigned char *const *segment,
+               const size_t *length, size_t n)
+{
+    struct aec_stream dec;
+    struct aec_alloc alloc;
+    size_t *bits;
+    size_t total = 0;
+    size_t out_bit = 0;
+    int status = AEC_OK;
+
+    if (aec_decode_workspace_size(strm) == 0)
+        return AEC_CONF_ERROR;
+
+    aec_alloc_init(&alloc, strm);
+    bits = aec_alloc(&alloc, (n + 1) * sizeof(size_t));
+    if (bits == NULL)
+        return AEC_MEM_ERROR;
+
+    /* The last segment keeps its padding */
+    for (size_t i = 0; i < n; i++)
+        bits[i] = length[i] * 8;
+
+    if (n > 1) {
+        dec = *strm;
+        dec.flags &= ~AEC_PIPELINE;
+        status = aec_decode_init(&dec);
+        if (status != AEC_OK)
+            goto CLEANUP;
+        for (size_t i = 0; i < n - 1 && status == AEC_OK; i++) {
+            if (length[i])
+                status = rsi_end(strm, dec.state->id_len, segment[i],
+                                 length[i], &bits[i]);
+        }
+        aec_decode_end(&dec);
+        if (status != AEC_OK)
+            goto CLEANUP;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        total += bits[i];
+    if (strm->avail_out < (total + 7) / 8) {
+        status = AEC_STREAM_ERROR;
+        goto CLEANUP;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        append(strm->next_out, out_bit, segment[i], bits[i]);
+        out_bit += bits[i];
+    }
+
+    total = (out_bit + 7) / 8;
+    strm->next_out += total;
+    strm->avail_out -= total;
+    strm->total_out += total;
+
+CLEANUP:
+    aec_free(&alloc, bits);
+    return status;
+}
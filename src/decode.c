@@ -51,6 +51,7 @@
 #include "config.h"
 #include "decode.h"
 #include "libaec.h"
+#include "snapshot.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -59,11 +60,32 @@
 #include <intrin.h>
 #endif
 
-#define ROS 5
 #define RSI_USED_SIZE(state) ((size_t)(state->rsip - state->rsi_buffer))
 #define BUFFERSPACE(strm) (strm->avail_in >= strm->state->in_blklen      \
                            && strm->avail_out >= strm->state->out_blklen)
 
+/* Table for decoding the second extension option. Entry 2 * m holds
+ * the sum of the sample pair coded by m, entry 2 * m + 1 the first m
+ * of that sum. */
+static const int se_table[2 * (SE_TABLE_SIZE + 1)] = {
+    0, 0,
+    1, 1, 1, 1,
+    2, 3, 2, 3, 2, 3,
+    3, 6, 3, 6, 3, 6, 3, 6,
+    4, 10, 4, 10, 4, 10, 4, 10, 4, 10,
+    5, 15, 5, 15, 5, 15, 5, 15, 5, 15, 5, 15,
+    6, 21, 6, 21, 6, 21, 6, 21, 6, 21, 6, 21, 6, 21,
+    7, 28, 7, 28, 7, 28, 7, 28, 7, 28, 7, 28, 7, 28, 7, 28,
+    8, 36, 8, 36, 8, 36, 8, 36, 8, 36, 8, 36, 8, 36, 8, 36, 8, 36,
+    9, 45, 9, 45, 9, 45, 9, 45, 9, 45, 9, 45, 9, 45, 9, 45, 9, 45, 9, 45,
+    10, 55, 10, 55, 10, 55, 10, 55, 10, 55, 10, 55, 10, 55, 10, 55, 10, 55,
+    10, 55, 10, 55,
+    11, 66, 11, 66, 11, 66, 11, 66, 11, 66, 11, 66, 11, 66, 11, 66, 11, 66,
+    11, 66, 11, 66, 11, 66,
+    12, 78, 12, 78, 12, 78, 12, 78, 12, 78, 12, 78, 12, 78, 12, 78, 12, 78,
+    12, 78, 12, 78, 12, 78, 12, 78
+};
+
 #define FLUSH(KIND)                                                      \
     static void flush_##KIND(struct aec_stream *strm)                    \
     {                                                                    \
@@ -77,7 +99,7 @@
                 && state->rsip > state->rsi_buffer) {                    \
                 state->last_out = *state->rsi_buffer;                    \
                                                                          \
-                if (strm->flags & AEC_DATA_SIGNED) {                     \
+                if (state->flags & AEC_DATA_SIGNED) {                    \
                     m = UINT32_C(1) << (strm->bits_per_sample - 1);      \
                     /* Reference samples have to be sign extended */     \
                     state->last_out = (state->last_out ^ m) - m;         \
@@ -139,16 +161,41 @@
     }
 
 
-static inline void put_msb_32(struct aec_stream *strm, uint32_t data)
+/* Samples in native byte order are stored whole */
+#define PUT_NATIVE(KIND, TYPE)                                           \
+    static inline void put_##KIND(struct aec_stream *strm,               \
+                                  uint32_t data)                         \
+    {                                                                    \
+        TYPE v = (TYPE)data;                                             \
+        memcpy(strm->next_out, &v, sizeof(v));                           \
+        strm->next_out += sizeof(v);                                     \
+    }
+
+#ifdef WORDS_BIGENDIAN
+PUT_NATIVE(msb_32, uint32_t)
+PUT_NATIVE(msb_16, uint16_t)
+
+static inline void put_lsb_32(struct aec_stream *strm, uint32_t data)
 {
-    *strm->next_out++ = (unsigned char)(data >> 24);
-    *strm->next_out++ = (unsigned char)(data >> 16);
+    *strm->next_out++ = (unsigned char)data;
     *strm->next_out++ = (unsigned char)(data >> 8);
+    *strm->next_out++ = (unsigned char)(data >> 16);
+    *strm->next_out++ = (unsigned char)(data >> 24);
+}
+
+static inline void put_lsb_16(struct aec_stream *strm, uint32_t data)
+{
     *strm->next_out++ = (unsigned char)data;
+    *strm->next_out++ = (unsigned char)(data >> 8);
 }
 
-static inline void put_msb_24(struct aec_stream *strm, uint32_t data)
+#else /* !WORDS_BIGENDIAN */
+PUT_NATIVE(lsb_32, uint32_t)
+PUT_NATIVE(lsb_16, uint16_t)
+
+static inline void put_msb_32(struct aec_stream *strm, uint32_t data)
 {
+    *strm->next_out++ = (unsigned char)(data >> 24);
     *strm->next_out++ = (unsigned char)(data >> 16);
     *strm->next_out++ = (unsigned char)(data >> 8);
     *strm->next_out++ = (unsigned char)data;
@@ -160,12 +207,13 @@ static inline void put_msb_16(struct aec_stream *strm, uint32_t data)
     *strm->next_out++ = (unsigned char)data;
 }
 
-static inline void put_lsb_32(struct aec_stream *strm, uint32_t data)
+#endif /* !WORDS_BIGENDIAN */
+
+static inline void put_msb_24(struct aec_stream *strm, uint32_t data)
 {
-    *strm->next_out++ = (unsigned char)data;
-    *strm->next_out++ = (unsigned char)(data >> 8);
     *strm->next_out++ = (unsigned char)(data >> 16);
-    *strm->next_out++ = (unsigned char)(data >> 24);
+    *strm->next_out++ = (unsigned char)(data >> 8);
+    *strm->next_out++ = (unsigned char)data;
 }
 
 static inline void put_lsb_24(struct aec_stream *strm, uint32_t data)
@@ -175,12 +223,6 @@ static inline void put_lsb_24(struct aec_stream *strm, uint32_t data)
     *strm->next_out++ = (unsigned char)(data >> 16);
 }
 
-static inline void put_lsb_16(struct aec_stream *strm, uint32_t data)
-{
-    *strm->next_out++ = (unsigned char)data;
-    *strm->next_out++ = (unsigned char)(data >> 8);
-}
-
 static inline void put_8(struct aec_stream *strm, uint32_t data)
 {
     *strm->next_out++ = (unsigned char)data;
@@ -194,6 +236,151 @@ FLUSH(lsb_24)
 FLUSH(lsb_16)
 FLUSH(8)
 
+#define PUT_STRIDED(KIND)                                                \
+    static inline void put_strided_##KIND(struct aec_stream *strm,       \
+                                          uint32_t data)                 \
+    {                                                                    \
+        put_##KIND(strm, data);                                          \
+        strm->next_out += strm->state->out_gap;                          \
+    }                                                                    \
+    FLUSH(strided_##KIND)
+
+PUT_STRIDED(msb_32)
+PUT_STRIDED(msb_24)
+PUT_STRIDED(msb_16)
+PUT_STRIDED(lsb_32)
+PUT_STRIDED(lsb_24)
+PUT_STRIDED(lsb_16)
+PUT_STRIDED(8)
+
+/* Samples of typed arrays are stored through a pointer to the element
+ * type, which cannot alias next_out. Samples of signed types are sign
+ * extended from bits_per_sample, with or without preprocessing. */
+#define PUT_TYPED(NAME, TYPE, SIGNED)                                    \
+    static inline void put_##NAME(struct aec_stream *strm,               \
+                                  uint32_t data)                         \
+    {                                                                    \
+        if (SIGNED) {                                                    \
+            uint32_t m = strm->state->xmax + 1;                          \
+            data = ((data & (2 * m - 1)) ^ m) - m;                       \
+        }                                                                \
+        *(TYPE *)strm->next_out = (TYPE)data;                            \
+        strm->next_out += sizeof(TYPE);                                  \
+    }                                                                    \
+    FLUSH(NAME)
+
+PUT_TYPED(u8, uint8_t, 0)
+PUT_TYPED(i8, uint8_t, 1)
+PUT_TYPED(u16, uint16_t, 0)
+PUT_TYPED(i16, uint16_t, 1)
+PUT_TYPED(u32, uint32_t, 0)
+PUT_TYPED(i32, uint32_t, 1)
+
+/* Packed samples are postprocessed in place first */
+PUT_NATIVE(word, uint32_t)
+FLUSH(word)
+
+#define PACK_BYTES(BITS)                                                 \
+    for (; i + 8 / BITS <= n && out < end; i += 8 / BITS) {              \
+        uint32_t b = 0;                                                  \
+        for (int k = 0; k < 8 / BITS; k++)                               \
+            b = (b << BITS) | (in[i + k] & mask);                        \
+        *out++ = (unsigned char)b;                                       \
+    }
+
+static void pack(struct aec_stream *strm, const uint32_t *in, size_t n)
+{
+    /**
+       Append n samples to the output with bits_per_sample bits each,
+       most significant bit first. Bits which do not fit into the
+       output buffer, at least those of an incomplete last byte, stay
+       in pack_acc.
+    */
+
+    struct internal_state *state = strm->state;
+    unsigned int bits = strm->bits_per_sample;
+    uint32_t mask = UINT32_MAX >> (32 - bits);
+    uint64_t acc = state->pack_acc;
+    unsigned int avail = state->pack_bits;
+    unsigned char *restrict out = strm->next_out;
+    unsigned char *end = state->pack_end;
+    size_t i = 0;
+
+    while (avail >= 8 && out < end) {
+        avail -= 8;
+        *out++ = (unsigned char)(acc >> avail);
+    }
+
+    if (avail == 0) {
+        switch (bits) {
+        case 1:
+            PACK_BYTES(1)
+            break;
+        case 2:
+            PACK_BYTES(2)
+            break;
+        case 4:
+            PACK_BYTES(4)
+            break;
+        case 12:
+            for (; i + 2 <= n && end - out >= 3; i += 2) {
+                uint32_t a = in[i] & mask;
+                uint32_t b = in[i + 1] & mask;
+                out[0] = (unsigned char)(a >> 4);
+                out[1] = (unsigned char)((a << 4) | (b >> 8));
+                out[2] = (unsigned char)b;
+                out += 3;
+            }
+            break;
+        }
+    }
+
+    for (; i < n; i++) {
+        acc = (acc << bits) | (in[i] & mask);
+        avail += bits;
+        while (avail >= 8 && out < end) {
+            avail -= 8;
+            *out++ = (unsigned char)(acc >> avail);
+        }
+    }
+
+    state->pack_acc = acc & ((UINT64_C(1) << avail) - 1);
+    state->pack_bits = avail;
+    strm->next_out = out;
+}
+
+static void flush_packed(struct aec_stream *strm)
+{
+    struct internal_state *state = strm->state;
+    uint32_t *start = state->flush_start;
+    size_t n = (size_t)(state->rsip - start);
+    unsigned char *next_out = strm->next_out;
+
+    strm->next_out = (unsigned char *)start;
+    flush_word(strm);
+    strm->next_out = next_out;
+    pack(strm, start, n);
+}
+
+static size_t packed_room(struct aec_stream *strm)
+{
+    /**
+       Number of samples which start inside of the output buffer
+       after the kept bits have been written.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t room;
+    size_t bits;
+
+    pack(strm, NULL, 0);
+    room = (size_t)(state->pack_end - strm->next_out);
+    if (room == 0)
+        return 0;
+    bits = MIN(room, SIZE_MAX / 8 - 64) * 8 - state->pack_bits;
+    return (bits + strm->bits_per_sample - 1) / strm->bits_per_sample;
+}
+
 static inline void put_sample(struct aec_stream *strm, uint32_t s)
 {
     struct internal_state *state = strm->state;
@@ -402,7 +589,12 @@ static int m_next_cds(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
     if (state->rsi_size == RSI_USED_SIZE(state)) {
-        state->flush_output(strm);
+        if (state->defer_flush && state->flush_start < state->rsip) {
+            state->deferred = 1;
+            return M_EXIT;
+        }
+        if (state->pipe == NULL || !aec_decode_pipeline_flush(strm))
+            state->flush_output(strm);
         state->flush_start = state->rsi_buffer;
         state->rsip = state->rsi_buffer;
         if (state->pp) {
@@ -554,12 +746,12 @@ static int m_se_decode(struct aec_stream *strm)
         m = state->fs;
         if (m > SE_TABLE_SIZE)
             return M_ERROR;
-        d1 = m - state->se_table[2 * m + 1];
+        d1 = m - se_table[2 * m + 1];
 
         if ((state->sample_counter & 1) == 0) {
             if (strm->avail_out < state->bytes_per_sample)
                 return M_EXIT;
-            put_sample(strm, state->se_table[2 * m] - d1);
+            put_sample(strm, se_table[2 * m] - d1);
             state->sample_counter++;
         }
 
@@ -588,10 +780,10 @@ static int m_se(struct aec_stream *strm)
             if (m > SE_TABLE_SIZE)
                 return M_ERROR;
 
-            d1 = m - state->se_table[2 * m + 1];
+            d1 = m - se_table[2 * m + 1];
 
             if ((i & 1) == 0) {
-                put_sample(strm, state->se_table[2 * m] - d1);
+                put_sample(strm, se_table[2 * m] - d1);
                 i++;
             }
             put_sample(strm, d1);
@@ -660,82 +852,184 @@ static int m_uncomp(struct aec_stream *strm)
     return M_CONTINUE;
 }
 
-static void create_se_table(int *table)
+/* Tables map option IDs to states, one for each ID length */
+static int (*const id_table_1[])(struct aec_stream *) = {
+    m_low_entropy, m_uncomp
+};
+
+static int (*const id_table_2[])(struct aec_stream *) = {
+    m_low_entropy, m_split, m_split, m_uncomp
+};
+
+static int (*const id_table_3[])(struct aec_stream *) = {
+    m_low_entropy, m_split, m_split, m_split, m_split, m_split, m_split,
+    m_uncomp
+};
+
+static int (*const id_table_4[])(struct aec_stream *) = {
+    m_low_entropy, m_split, m_split, m_split, m_split, m_split, m_split,
+    m_split, m_split, m_split, m_split, m_split, m_split, m_split, m_split,
+    m_uncomp
+};
+
+static int (*const id_table_5[])(struct aec_stream *) = {
+    m_low_entropy, m_split, m_split, m_split, m_split, m_split, m_split,
+    m_split, m_split, m_split, m_split, m_split, m_split, m_split, m_split,
+    m_split, m_split, m_split, m_split, m_split, m_split, m_split, m_split,
+    m_split, m_split, m_split, m_split, m_split, m_split, m_split, m_split,
+    m_uncomp
+};
+
+static unsigned int packed_group(unsigned int bits_per_sample)
 {
-    int k = 0;
-    for (int i = 0; i < 13; i++) {
-        int ms = k;
-        for (int j = 0; j <= i; j++) {
-            table[2 * k] = i;
-            table[2 * k + 1] = ms;
-            k++;
-        }
-    }
+    /**
+       Smallest number of packed samples which fill whole bytes.
+    */
+    unsigned int low = bits_per_sample & (0U - bits_per_sample);
+    return low >= 8 ? 1 : 8 / low;
 }
 
-int aec_decode_init(struct aec_stream *strm)
+static int check_params(const struct aec_stream *strm, unsigned int flags)
 {
-    struct internal_state *state;
-    int modi;
-
     if (strm->bits_per_sample > 32 || strm->bits_per_sample == 0)
         return AEC_CONF_ERROR;
 
-    state = malloc(sizeof(struct internal_state));
-    if (state == NULL)
-        return AEC_MEM_ERROR;
-    memset(state, 0, sizeof(struct internal_state));
+    if (flags & AEC_RESTRICTED && strm->bits_per_sample > 4)
+        return AEC_CONF_ERROR;
 
-    create_se_table(state->se_table);
+    if (flags & AEC_CUSTOM_ALLOC
+        && (strm->alloc_func == NULL || strm->free_func == NULL))
+        return AEC_CONF_ERROR;
 
-    strm->state = state;
+    if (flags & AEC_DATA_STRIDED) {
+        unsigned int width;
+
+        if (strm->bits_per_sample > 16)
+            width = strm->bits_per_sample <= 24
+                && flags & AEC_DATA_3BYTE ? 3 : 4;
+        else
+            width = strm->bits_per_sample > 8 ? 2 : 1;
+        if (strm->sample_stride < width
+            || (uint64_t)strm->rsi * strm->block_size * strm->sample_stride
+            > UINT32_MAX)
+            return AEC_CONF_ERROR;
+    }
+
+    if (flags & AEC_DATA_PACKED
+        && (flags & AEC_DATA_STRIDED
+            || strm->block_size % packed_group(strm->bits_per_sample)))
+        return AEC_CONF_ERROR;
+
+    return AEC_OK;
+}
+
+static int pipelined(unsigned int flags)
+{
+    /**
+       Packed samples are written in order by the decoding thread.
+    */
+    return flags & AEC_PIPELINE && !(flags & AEC_DATA_PACKED);
+}
+
+static size_t buffer_size(const struct aec_stream *strm)
+{
+    return ALIGN_UP((size_t)strm->rsi * strm->block_size * sizeof(uint32_t));
+}
+
+static size_t workspace_size(const struct aec_stream *strm,
+                             unsigned int flags)
+{
+    size_t size;
+
+    if (check_params(strm, flags) != AEC_OK)
+        return 0;
+
+    size = WORKSPACE_ALIGN - 1
+        + ALIGN_UP(sizeof(struct internal_state))
+        + buffer_size(strm);
+    if (pipelined(flags))
+        size += aec_decode_pipeline_size(strm);
+    return size;
+}
+
+static void configure(struct aec_stream *strm)
+{
+    /**
+       Derive coding parameters from user settings.
+    */
+    struct internal_state *state = strm->state;
+    int strided = (state->flags & AEC_DATA_STRIDED) != 0;
 
     if (strm->bits_per_sample > 16) {
         state->id_len = 5;
+        state->id_table = id_table_5;
 
-        if (strm->bits_per_sample <= 24 && strm->flags & AEC_DATA_3BYTE) {
+        if (strm->bits_per_sample <= 24 && state->flags & AEC_DATA_3BYTE) {
             state->bytes_per_sample = 3;
-            if (strm->flags & AEC_DATA_MSB)
-                state->flush_output = flush_msb_24;
+            if (state->flags & AEC_DATA_MSB)
+                state->flush_output = strided
+                    ? flush_strided_msb_24 : flush_msb_24;
             else
-                state->flush_output = flush_lsb_24;
+                state->flush_output = strided
+                    ? flush_strided_lsb_24 : flush_lsb_24;
         } else {
             state->bytes_per_sample = 4;
-            if (strm->flags & AEC_DATA_MSB)
-                state->flush_output = flush_msb_32;
+            if (state->flags & AEC_DATA_MSB)
+                state->flush_output = strided
+                    ? flush_strided_msb_32 : flush_msb_32;
             else
-                state->flush_output = flush_lsb_32;
+                state->flush_output = strided
+                    ? flush_strided_lsb_32 : flush_lsb_32;
         }
         state->out_blklen = strm->block_size * state->bytes_per_sample;
     }
     else if (strm->bits_per_sample > 8) {
         state->bytes_per_sample = 2;
         state->id_len = 4;
+        state->id_table = id_table_4;
         state->out_blklen = strm->block_size * 2;
-        if (strm->flags & AEC_DATA_MSB)
-            state->flush_output = flush_msb_16;
+        if (state->flags & AEC_DATA_MSB)
+            state->flush_output = strided
+                ? flush_strided_msb_16 : flush_msb_16;
         else
-            state->flush_output = flush_lsb_16;
+            state->flush_output = strided
+                ? flush_strided_lsb_16 : flush_lsb_16;
     } else {
-        if (strm->flags & AEC_RESTRICTED) {
-            if (strm->bits_per_sample <= 4) {
-                if (strm->bits_per_sample <= 2)
-                    state->id_len = 1;
-                else
-                    state->id_len = 2;
+        if (state->flags & AEC_RESTRICTED) {
+            if (strm->bits_per_sample <= 2) {
+                state->id_len = 1;
+                state->id_table = id_table_1;
             } else {
-                return AEC_CONF_ERROR;
+                state->id_len = 2;
+                state->id_table = id_table_2;
             }
         } else {
             state->id_len = 3;
+            state->id_table = id_table_3;
         }
 
         state->bytes_per_sample = 1;
         state->out_blklen = strm->block_size;
-        state->flush_output = flush_8;
+        state->flush_output = strided ? flush_strided_8 : flush_8;
+    }
+
+    /* Counts of output bytes include the gaps between samples */
+    state->out_gap = 0;
+    if (strided) {
+        state->out_gap = strm->sample_stride - state->bytes_per_sample;
+        state->bytes_per_sample = strm->sample_stride;
+        state->out_blklen = strm->block_size * strm->sample_stride;
+    }
+
+    /* Output of packed samples is counted in samples, see
+     * decode_packed() */
+    if (state->flags & AEC_DATA_PACKED) {
+        state->bytes_per_sample = 1;
+        state->out_blklen = strm->block_size;
+        state->flush_output = flush_packed;
     }
 
-    if (strm->flags & AEC_DATA_SIGNED) {
+    if (state->flags & AEC_DATA_SIGNED) {
         state->xmax = (INT64_C(1) << (strm->bits_per_sample - 1)) - 1;
         state->xmin = ~state->xmax;
     } else {
@@ -745,24 +1039,40 @@ int aec_decode_init(struct aec_stream *strm)
 
     state->in_blklen = (strm->block_size * strm->bits_per_sample
                         + state->id_len) / 8 + 16;
+    state->rsi_size = strm->rsi * strm->block_size;
+    state->pp = state->flags & AEC_DATA_PREPROCESS;
+}
+
+static int setup(struct aec_stream *strm, void *workspace, size_t size,
+                 int own_workspace, unsigned int flags)
+{
+    /**
+       Place state and rsi_buffer in workspace and start a new stream.
+    */
+    struct internal_state *state;
+    uint8_t *ws;
+    size_t offset;
 
-    modi = 1UL << state->id_len;
-    state->id_table = malloc(modi * sizeof(int (*)(struct aec_stream *)));
-    if (state->id_table == NULL)
+    offset = (WORKSPACE_ALIGN - (uintptr_t)workspace % WORKSPACE_ALIGN)
+        % WORKSPACE_ALIGN;
+    if (size < workspace_size(strm, flags))
         return AEC_MEM_ERROR;
 
-    state->id_table[0] = m_low_entropy;
-    for (int i = 1; i < modi - 1; i++) {
-        state->id_table[i] = m_split;
-    }
-    state->id_table[modi - 1] = m_uncomp;
+    ws = (uint8_t *)workspace + offset;
+    state = (struct internal_state *)ws;
+    memset(state, 0, sizeof(struct internal_state));
+    state->workspace = workspace;
+    state->workspace_size = size;
+    state->own_workspace = own_workspace;
+    state->flags = flags;
+    strm->state = state;
+    ws += ALIGN_UP(sizeof(struct internal_state));
+    state->rsi_buffer = (uint32_t *)ws;
 
-    state->rsi_size = strm->rsi * strm->block_size;
-    state->rsi_buffer = malloc(state->rsi_size * sizeof(uint32_t));
-    if (state->rsi_buffer == NULL)
-        return AEC_MEM_ERROR;
+    configure(strm);
+    if (pipelined(flags))
+        state->pipe = aec_decode_pipeline_setup(strm, ws + buffer_size(strm));
 
-    state->pp = strm->flags & AEC_DATA_PREPROCESS;
     if (state->pp) {
         state->ref = 1;
         state->encoded_block_size = strm->block_size - 1;
@@ -781,7 +1091,233 @@ int aec_decode_init(struct aec_stream *strm)
     return AEC_OK;
 }
 
-int aec_decode(struct aec_stream *strm, int flush)
+static int init(struct aec_stream *strm, unsigned int flags)
+{
+    struct aec_alloc alloc;
+    void *workspace;
+    size_t size;
+    int status = check_params(strm, flags);
+    if (status != AEC_OK)
+        return status;
+
+    size = workspace_size(strm, flags);
+    aec_alloc_init(&alloc, strm);
+    workspace = aec_alloc(&alloc, size);
+    if (workspace == NULL)
+        return AEC_MEM_ERROR;
+
+    status = setup(strm, workspace, size, 1, flags);
+    if (status != AEC_OK) {
+        aec_free(&alloc, workspace);
+        return status;
+    }
+    strm->state->alloc = alloc;
+    return AEC_OK;
+}
+
+size_t aec_decode_workspace_size(const struct aec_stream *strm)
+{
+    return workspace_size(strm, strm->flags);
+}
+
+int aec_decode_init_workspace(struct aec_stream *strm,
+                              void *workspace, size_t size)
+{
+    int status = check_params(strm, strm->flags);
+    if (status != AEC_OK)
+        return status;
+
+    return setup(strm, workspace, size, 0, strm->flags);
+}
+
+int aec_decode_owns_workspace(const struct aec_stream *strm)
+{
+    return strm->state->own_workspace;
+}
+
+int aec_decode_init(struct aec_stream *strm)
+{
+    return init(strm, strm->flags);
+}
+
+int aec_decode_reset(struct aec_stream *strm)
+{
+    /**
+       Start a new stream reusing the memory of strm->state. Grow
+       the workspace if the new parameters need more memory and the
+       workspace is owned by the library.
+    */
+    struct internal_state *state = strm->state;
+    struct aec_alloc alloc = state->alloc;
+    void *workspace = state->workspace;
+    size_t size = state->workspace_size;
+    int own_workspace = state->own_workspace;
+    int status = check_params(strm, strm->flags);
+    if (status != AEC_OK)
+        return status;
+
+    if (state->pipe)
+        aec_decode_pipeline_end(state->pipe);
+    if (size < aec_decode_workspace_size(strm)) {
+        if (!own_workspace)
+            return AEC_MEM_ERROR;
+        aec_free(&alloc, workspace);
+        strm->state = NULL;
+        return aec_decode_init(strm);
+    }
+    status = setup(strm, workspace, size, own_workspace, strm->flags);
+    if (status == AEC_OK)
+        strm->state->alloc = alloc;
+    return status;
+}
+
+/* All states, the decoder can return in any of them */
+static int (*const snapshot_modes[])(struct aec_stream *) = {
+    m_id, m_next_cds, m_split_output, m_split_fs, m_split, m_zero_output,
+    m_zero_block, m_se_decode, m_se, m_low_entropy_ref, m_low_entropy,
+    m_uncomp_copy, m_uncomp
+};
+
+#define SNAPSHOT_MODES (sizeof(snapshot_modes) / sizeof(snapshot_modes[0]))
+
+static int save(struct aec_stream *strm, struct snapshot *s)
+{
+    /**
+       Write the state between two calls of aec_decode() to s. Of the
+       RSI buffer only samples which are not flushed yet and the
+       current block are kept.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t used = RSI_USED_SIZE(state);
+    size_t begin = (size_t)(state->flush_start - state->rsi_buffer);
+    size_t end = MIN(used + strm->block_size, state->rsi_size);
+    uint32_t mode;
+
+    for (mode = 0; mode < SNAPSHOT_MODES; mode++)
+        if (state->mode == snapshot_modes[mode])
+            break;
+    if (mode == SNAPSHOT_MODES || state->defer_flush || state->pack_bits)
+        return AEC_STREAM_ERROR;
+
+    snap_put_header(s, strm, SNAPSHOT_DECODER);
+    snap_put32(s, mode);
+    snap_put32(s, (uint32_t)state->id);
+    snap_put32(s, (uint32_t)state->last_out);
+    snap_put32(s, state->sample_counter);
+    snap_put64(s, state->acc);
+    snap_put32(s, (uint32_t)state->bitp);
+    snap_put32(s, state->fs);
+    snap_put32(s, (uint32_t)state->ref);
+    snap_put32(s, state->encoded_block_size);
+    snap_put32(s, (uint32_t)used);
+    snap_put32(s, (uint32_t)begin);
+    snap_put_words(s, state->flush_start, end - begin);
+    return AEC_OK;
+}
+
+static int restore(struct aec_stream *strm, struct snapshot *s)
+{
+    /**
+       Read a state written by save() into the freshly initialized
+       state of strm. Values which could lead outside of the RSI
+       buffer are rejected.
+    */
+
+    struct internal_state *state = strm->state;
+    uint32_t mode;
+    uint32_t used;
+    uint32_t begin;
+    size_t room;
+    size_t end;
+    int status = snap_get_header(s, strm, SNAPSHOT_DECODER);
+    if (status != AEC_OK)
+        return status;
+
+    mode = snap_get32(s);
+    state->id = (int)snap_get32(s);
+    state->last_out = (int32_t)snap_get32(s);
+    state->sample_counter = snap_get32(s);
+    state->acc = snap_get64(s);
+    state->bitp = (int)snap_get32(s);
+    state->fs = snap_get32(s);
+    state->ref = (int)snap_get32(s);
+    state->encoded_block_size = snap_get32(s);
+    used = snap_get32(s);
+    begin = snap_get32(s);
+
+    if (s->error || mode >= SNAPSHOT_MODES
+        || state->id < 0 || state->id >= 1 << state->id_len
+        || state->bitp < 0 || state->bitp > 64
+        || (state->ref != 0 && state->ref != 1)
+        || state->encoded_block_size != strm->block_size - state->ref
+        || begin > used || used > state->rsi_size)
+        return AEC_DATA_ERROR;
+    state->mode = snapshot_modes[mode];
+
+    /* Samples the state may still write from rsip on */
+    if (state->mode == m_split_fs) {
+        room = state->encoded_block_size;
+    } else if (state->mode == m_split_output) {
+        room = state->encoded_block_size - state->sample_counter;
+    } else if (state->mode == m_se_decode) {
+        room = strm->block_size - state->sample_counter;
+    } else if (state->mode == m_zero_output
+               || state->mode == m_uncomp_copy) {
+        room = state->sample_counter;
+    } else if (state->mode == m_next_cds && used == state->rsi_size) {
+        room = 0;
+    } else {
+        room = strm->block_size;
+    }
+    if (state->sample_counter > state->rsi_size
+        || room > state->rsi_size - used)
+        return AEC_DATA_ERROR;
+
+    end = MIN(used + strm->block_size, state->rsi_size);
+    state->rsip = state->rsi_buffer + used;
+    state->flush_start = state->rsi_buffer + begin;
+    snap_get_words(s, state->flush_start, end - begin);
+    return s->error ? AEC_DATA_ERROR : AEC_OK;
+}
+
+size_t aec_decode_state_size(struct aec_stream *strm)
+{
+    struct snapshot s = {NULL, NULL, 0, 0, 0};
+
+    if (save(strm, &s) != AEC_OK)
+        return 0;
+    return s.pos;
+}
+
+int aec_decode_save_state(struct aec_stream *strm, void *buf, size_t *size)
+{
+    struct snapshot s = {buf, NULL, 0, *size, 0};
+    int status = save(strm, &s);
+    if (status != AEC_OK)
+        return status;
+
+    *size = s.pos;
+    if (s.pos > s.size)
+        return AEC_STREAM_ERROR;
+    return AEC_OK;
+}
+
+int aec_decode_restore_state(struct aec_stream *strm,
+                             const void *buf, size_t size)
+{
+    struct snapshot s = {NULL, buf, 0, size, 0};
+    int status = aec_decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+
+    status = restore(strm, &s);
+    if (status != AEC_OK)
+        aec_decode_end(strm);
+    return status;
+}
+
+static int decode(struct aec_stream *strm)
 {
     /**
        Finite-state machine implementation of the adaptive entropy
@@ -798,10 +1334,16 @@ int aec_decode(struct aec_stream *strm, int flush)
     strm->total_in += strm->avail_in;
     strm->total_out += strm->avail_out;
 
+    if (state->pipe)
+        aec_decode_pipeline_begin(strm);
+
     do {
         status = state->mode(strm);
     } while (status == M_CONTINUE);
 
+    if (state->pipe)
+        aec_decode_pipeline_drain(strm);
+
     if (status == M_ERROR)
         return AEC_DATA_ERROR;
 
@@ -809,7 +1351,8 @@ int aec_decode(struct aec_stream *strm, int flush)
         strm->avail_out < state->bytes_per_sample)
         return AEC_MEM_ERROR;
 
-    state->flush_output(strm);
+    if (!state->defer_flush)
+        state->flush_output(strm);
 
     strm->total_in -= strm->avail_in;
     strm->total_out -= strm->avail_out;
@@ -817,13 +1360,49 @@ int aec_decode(struct aec_stream *strm, int flush)
     return AEC_OK;
 }
 
+static int decode_packed(struct aec_stream *strm)
+{
+    /**
+       Decode with avail_out counting the samples which start inside
+       of the output buffer, then count bytes again.
+    */
+
+    struct internal_state *state = strm->state;
+    unsigned char *next_out = strm->next_out;
+    size_t avail_out = strm->avail_out;
+    size_t total_out = strm->total_out;
+    size_t written;
+    int status;
+
+    state->pack_end = next_out + avail_out;
+    strm->avail_out = packed_room(strm);
+    status = decode(strm);
+    written = (size_t)(strm->next_out - next_out);
+    strm->avail_out = avail_out - written;
+    strm->total_out = total_out + written;
+    return status;
+}
+
+int aec_decode(struct aec_stream *strm, int flush)
+{
+    (void)flush;
+    if (strm->state->flags & AEC_DATA_PACKED)
+        return decode_packed(strm);
+    return decode(strm);
+}
+
 int aec_decode_end(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
 
-    free(state->id_table);
-    free(state->rsi_buffer);
-    free(state);
+    if (state->pipe)
+        aec_decode_pipeline_end(state->pipe);
+    if (state->own_workspace) {
+        /* The allocator lives in the workspace */
+        struct aec_alloc alloc = state->alloc;
+        aec_free(&alloc, state->workspace);
+    }
+    strm->state = NULL;
     return AEC_OK;
 }
 
@@ -837,3 +1416,147 @@ int aec_buffer_decode(struct aec_stream *strm)
     aec_decode_end(strm);
     return status;
 }
+
+static int decode_typed(struct aec_stream *strm, void *dst, size_t count,
+                        unsigned int width, int is_signed,
+                        void (*flush_output)(struct aec_stream *))
+{
+    /**
+       Decode into count native integers of width bytes like
+       aec_buffer_decode(). The sample layout comes from the array
+       type instead of strm->flags and samples are stored with a
+       flush for it.
+    */
+    unsigned int flags = strm->flags & ~(AEC_DATA_SIGNED | AEC_DATA_3BYTE
+                                         | AEC_DATA_MSB | AEC_DATA_STRIDED
+                                         | AEC_DATA_PACKED);
+    int status;
+
+    if (strm->bits_per_sample == 0
+        || strm->bits_per_sample > 8 * width
+        || (width > 1 && strm->bits_per_sample <= 4 * width)
+        || count > SIZE_MAX / width)
+        return AEC_CONF_ERROR;
+
+    if (is_signed)
+        flags |= AEC_DATA_SIGNED;
+
+    status = init(strm, flags);
+    if (status != AEC_OK)
+        return status;
+    strm->state->flush_output = flush_output;
+    strm->next_out = (unsigned char *)dst;
+    strm->avail_out = count * width;
+    status = aec_decode(strm, AEC_FLUSH);
+    aec_decode_end(strm);
+    return status;
+}
+
+#define DECODE_TYPED(NAME, TYPE, SIGNED)                                 \
+    int aec_decode_##NAME(struct aec_stream *strm, TYPE *dst,            \
+                          size_t count)                                  \
+    {                                                                    \
+        return decode_typed(strm, dst, count, sizeof(TYPE), SIGNED,      \
+                            flush_##NAME);                               \
+    }
+
+DECODE_TYPED(u8, uint8_t, 0)
+DECODE_TYPED(i8, int8_t, 1)
+DECODE_TYPED(u16, uint16_t, 0)
+DECODE_TYPED(i16, int16_t, 1)
+DECODE_TYPED(u32, uint32_t, 0)
+DECODE_TYPED(i32, int32_t, 1)
+
+int aec_decode_range(struct aec_stream *strm, const struct aec_index *index,
+                     size_t offset, size_t count)
+{
+    /**
+       Decode count samples starting with sample offset. Decoding
+       starts at the last RSI in the index before offset. Samples in
+       front of offset are decoded into a scratch buffer.
+    */
+
+    struct internal_state *state;
+    struct aec_alloc alloc;
+    unsigned char *out;
+    unsigned char *scratch = NULL;
+    size_t avail_out = strm->avail_out;
+    size_t rsi_samples = (size_t)strm->rsi * strm->block_size;
+    size_t interval = index->interval ? index->interval : 1;
+    size_t entry;
+    size_t skip;
+    size_t out_len;
+    uint64_t bit;
+    int status;
+
+    if (rsi_samples == 0 || index->count == 0
+        || offset + count > index->samples || offset + count < offset
+        || strm->flags & AEC_DATA_PACKED)
+        return AEC_CONF_ERROR;
+
+    entry = offset / rsi_samples / interval;
+    if (entry >= index->count)
+        return AEC_CONF_ERROR;
+    skip = offset - entry * interval * rsi_samples;
+    bit = index->offsets[entry];
+    if (bit / 8 >= strm->avail_in)
+        return AEC_DATA_ERROR;
+
+    status = aec_decode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    state = strm->state;
+
+    out_len = count * state->bytes_per_sample;
+    if (strm->avail_out < out_len) {
+        status = AEC_STREAM_ERROR;
+        goto CLEANUP;
+    }
+    out = strm->next_out;
+
+    /* Seed the accumulator with the partial first byte */
+    strm->next_in += bit / 8;
+    strm->avail_in -= bit / 8;
+    if (bit % 8) {
+        state->acc = *strm->next_in++;
+        strm->avail_in--;
+        state->bitp = 8 - (int)(bit % 8);
+    }
+
+    if (skip) {
+        aec_alloc_init(&alloc, strm);
+        scratch = aec_alloc(&alloc, rsi_samples * state->bytes_per_sample);
+        if (scratch == NULL) {
+            status = AEC_MEM_ERROR;
+            goto CLEANUP;
+        }
+    }
+    while (skip) {
+        size_t n = MIN(skip, rsi_samples);
+
+        strm->next_out = scratch;
+        strm->avail_out = n * state->bytes_per_sample;
+        status = aec_decode(strm, AEC_FLUSH);
+        if (status != AEC_OK)
+            goto CLEANUP;
+        if (strm->avail_out) {
+            status = AEC_DATA_ERROR;
+            goto CLEANUP;
+        }
+        skip -= n;
+    }
+
+    strm->next_out = out;
+    strm->avail_out = out_len;
+    status = aec_decode(strm, AEC_FLUSH);
+    if (status == AEC_OK && strm->avail_out)
+        status = AEC_DATA_ERROR;
+    strm->total_out = out_len - strm->avail_out;
+    strm->avail_out = avail_out - strm->total_out;
+
+CLEANUP:
+    if (scratch)
+        aec_free(&alloc, scratch);
+    aec_decode_end(strm);
+    return status;
+}
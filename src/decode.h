@@ -52,6 +52,7 @@
 #define DECODE_H 1
 
 #include "config.h"
+#include "alloc.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -63,7 +64,19 @@
 
 #define SE_TABLE_SIZE 90
 
+/* Remainder Of Segment condition in zero block encoding */
+#define ROS 5
+
+/* Number of RSI buffers of a pipelined decoder */
+#define PIPELINE_SLOTS 3
+
+/* Alignment of buffers in the workspace */
+#define WORKSPACE_ALIGN 64
+#define ALIGN_UP(n) (((n) + WORKSPACE_ALIGN - 1)        \
+                     & ~(size_t)(WORKSPACE_ALIGN - 1))
+
 struct aec_stream;
+struct decode_pipeline;
 
 struct internal_state {
     int (*mode)(struct aec_stream *);
@@ -75,7 +88,7 @@ struct internal_state {
     int id_len;
 
     /* table maps IDs to states */
-    int (**id_table)(struct aec_stream *);
+    int (*const *id_table)(struct aec_stream *);
 
     void (*flush_output)(struct aec_stream *);
 
@@ -115,9 +128,24 @@ struct internal_state {
     /* 1 if postprocessor has to be used */
     int pp;
 
-    /* storage size of samples in bytes */
+    /* strm->flags with the sample layout in effect, which
+     * aec_decode_u8() and friends take from the array type */
+    unsigned int flags;
+
+    /* storage size of samples in bytes, with AEC_DATA_STRIDED the
+     * distance between samples, 1 with AEC_DATA_PACKED where
+     * avail_out counts samples inside of aec_decode() */
     uint32_t bytes_per_sample;
 
+    /* bytes between the end of a sample and the next one */
+    uint32_t out_gap;
+
+    /* with AEC_DATA_PACKED, bits of packed samples not written yet
+     * and the end of the output buffer of the current call */
+    uint64_t pack_acc;
+    uint32_t pack_bits;
+    unsigned char *pack_end;
+
     /* output buffer holding one reference sample interval */
     uint32_t *rsi_buffer;
 
@@ -130,8 +158,36 @@ struct internal_state {
     /* first not yet flushed byte in rsi_buffer */
     uint32_t *flush_start;
 
-    /* table for decoding second extension option */
-    int se_table[2 * (SE_TABLE_SIZE + 1)];
-} decode_state;
+    /* flusher of complete RSIs if AEC_PIPELINE is set */
+    struct decode_pipeline *pipe;
+
+    /* leave decoded samples to the multi-stream decoder instead of
+     * flushing them */
+    int defer_flush;
+
+    /* 1 if decoding stopped at a complete RSI which is waiting to be
+     * flushed */
+    int deferred;
+
+    /* memory holding this state and rsi_buffer */
+    void *workspace;
+
+    /* size of workspace in bytes */
+    size_t workspace_size;
+
+    /* 1 if workspace was allocated by the library */
+    int own_workspace;
+
+    /* allocator used for an owned workspace */
+    struct aec_alloc alloc;
+};
+
+size_t aec_decode_pipeline_size(const struct aec_stream *strm);
+struct decode_pipeline *aec_decode_pipeline_setup(struct aec_stream *strm,
+                                                  uint8_t *ws);
+void aec_decode_pipeline_begin(struct aec_stream *strm);
+int aec_decode_pipeline_flush(struct aec_stream *strm);
+void aec_decode_pipeline_drain(struct aec_stream *strm);
+void aec_decode_pipeline_end(struct decode_pipeline *pipe);
 
 #endif /* DECODE_H */
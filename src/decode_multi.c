@@ -0,0 +1,305 @@
+/**
+ * @file decode_multi.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Decoding of many streams with identical parameters
+ *
+ * Streams are decoded in groups of LANES. Each stream keeps its own
+ * bit reader but leaves its decoded samples in rsi_buffer. The
+ * samples of all streams in a group are then postprocessed together,
+ * transposed so that sample i of every stream forms one row of
+ * lanes. Postprocessing is a chain from one sample to the next
+ * within a stream whose branches are hard to predict for noisy data
+ * near the limits of the sample range. Across streams it runs in
+ * branch-free SIMD lanes instead.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "decode.h"
+#include <stdint.h>
+
+#define LANES 16
+
+/* Samples per lane transposed at once */
+#define TILE 64
+
+static inline void put_samples(unsigned char *out, const uint32_t *x,
+                               size_t count, int bytes, int msb,
+                               size_t stride)
+{
+    /**
+       Write column x[i * LANES] of a tile to out.
+    */
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v = x[i * LANES];
+        for (int b = 0; b < bytes; b++)
+            out[i * stride + b] =
+                (unsigned char)(v >> (8 * (msb ? bytes - 1 - b : b)));
+    }
+}
+
+static void put_tile(struct aec_stream *strm, const uint32_t *x,
+                     size_t count)
+{
+    size_t stride = strm->state->bytes_per_sample;
+    int bytes = (int)(stride - strm->state->out_gap);
+    int msb = (strm->flags & AEC_DATA_MSB) != 0;
+
+    switch (bytes * 2 + msb) {
+    case 2:
+    case 3:
+        put_samples(strm->next_out, x, count, 1, 0, stride);
+        break;
+    case 4:
+        put_samples(strm->next_out, x, count, 2, 0, stride);
+        break;
+    case 5:
+        put_samples(strm->next_out, x, count, 2, 1, stride);
+        break;
+    case 6:
+        put_samples(strm->next_out, x, count, 3, 0, stride);
+        break;
+    case 7:
+        put_samples(strm->next_out, x, count, 3, 1, stride);
+        break;
+    case 8:
+        put_samples(strm->next_out, x, count, 4, 0, stride);
+        break;
+    default:
+        put_samples(strm->next_out, x, count, 4, 1, stride);
+        break;
+    }
+    strm->next_out += count * stride;
+}
+
+static void postprocess_unsigned(uint32_t *x, size_t count,
+                                 uint32_t *last, uint32_t xmax)
+{
+    /**
+       Branch-free version of the unsigned postprocessing in
+       flush_output() over all lanes. x holds the mapped prediction
+       errors on entry and the samples on return.
+    */
+
+    uint32_t med = xmax / 2 + 1;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t *restrict xi = x + i * LANES;
+
+        for (size_t j = 0; j < LANES; j++) {
+            uint32_t data = last[j];
+            uint32_t d = xi[j];
+            uint32_t half_d = (d >> 1) + (d & 1);
+            uint32_t mask = xmax & (0U - ((data & med) != 0));
+            uint32_t add = data + ((d >> 1) ^ (0U - (d & 1)));
+            uint32_t sel = 0U - (uint32_t)(half_d <= (mask ^ data));
+
+            data = (add & sel) | ((mask ^ d) & ~sel);
+            xi[j] = data;
+            last[j] = data;
+        }
+    }
+}
+
+static void postprocess_signed(uint32_t *x, size_t count,
+                               uint32_t *last, uint32_t xmax)
+{
+    /**
+       Branch-free version of the signed postprocessing in
+       flush_output() over all lanes.
+    */
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t *restrict xi = x + i * LANES;
+
+        for (size_t j = 0; j < LANES; j++) {
+            uint32_t data = last[j];
+            uint32_t d = xi[j];
+            uint32_t half_d = (d >> 1) + (d & 1);
+            uint32_t neg = 0U - (data >> 31);
+            uint32_t limit = ((xmax + data + 1) & neg)
+                | ((xmax - data) & ~neg);
+            uint32_t alt = ((d - xmax - 1) & neg) | ((xmax - d) & ~neg);
+            uint32_t add = data + ((d >> 1) ^ (0U - (d & 1)));
+            uint32_t sel = 0U - (uint32_t)(half_d <= limit);
+
+            data = (add & sel) | (alt & ~sel);
+            xi[j] = data;
+            last[j] = data;
+        }
+    }
+}
+
+static void flush_lanes(struct aec_stream **lane, size_t m)
+{
+    /**
+       Flush the decoded samples of all lanes. The samples all lanes
+       have in common are postprocessed in lanes, the rest by
+       flush_output().
+    */
+
+    struct internal_state *state;
+    uint32_t x[TILE * LANES] = {0};
+    uint32_t last[LANES] = {0};
+    size_t common = SIZE_MAX;
+
+    if (m < 2 || !(lane[0]->flags & AEC_DATA_PREPROCESS))
+        goto tail;
+
+    for (size_t j = 0; j < m; j++) {
+        struct aec_stream *strm = lane[j];
+        state = strm->state;
+
+        if (state->flush_start == state->rsi_buffer
+            && state->rsip > state->rsi_buffer) {
+            state->last_out = *state->rsi_buffer;
+
+            if (strm->flags & AEC_DATA_SIGNED) {
+                uint32_t msb = UINT32_C(1) << (strm->bits_per_sample - 1);
+                /* Reference samples have to be sign extended */
+                state->last_out = (state->last_out ^ msb) - msb;
+            }
+            x[0] = (uint32_t)state->last_out;
+            put_tile(strm, x, 1);
+            state->flush_start++;
+        }
+        last[j] = (uint32_t)state->last_out;
+        common = MIN(common, (size_t)(state->rsip - state->flush_start));
+    }
+
+    state = lane[0]->state;
+    for (size_t done = 0; done < common; done += TILE) {
+        size_t count = MIN(TILE, common - done);
+
+        for (size_t j = 0; j < m; j++) {
+            const uint32_t *src = lane[j]->state->flush_start + done;
+            for (size_t i = 0; i < count; i++)
+                x[i * LANES + j] = src[i];
+        }
+
+        if (state->xmin == 0)
+            postprocess_unsigned(x, count, last, state->xmax);
+        else
+            postprocess_signed(x, count, last, state->xmax);
+
+        for (size_t j = 0; j < m; j++)
+            put_tile(lane[j], x + j, count);
+    }
+
+    for (size_t j = 0; j < m; j++) {
+        lane[j]->state->flush_start += common;
+        lane[j]->state->last_out = (int32_t)last[j];
+    }
+
+tail:
+    for (size_t j = 0; j < m; j++)
+        lane[j]->state->flush_output(lane[j]);
+}
+
+int aec_decode_multi(struct aec_stream *strm, size_t n, int flush)
+{
+    int result = AEC_OK;
+
+    for (size_t i = 1; i < n; i++) {
+        if (strm[i].bits_per_sample != strm[0].bits_per_sample
+            || strm[i].block_size != strm[0].block_size
+            || strm[i].rsi != strm[0].rsi
+            || strm[i].flags != strm[0].flags)
+            return AEC_CONF_ERROR;
+    }
+
+    for (size_t g = 0; g < n; g += LANES) {
+        struct aec_stream *lane[LANES];
+        size_t size = MIN(LANES, n - g);
+        size_t m = 0;
+
+        for (size_t j = 0; j < size; j++) {
+            if (strm[g + j].state->pipe
+                || strm[g + j].flags & AEC_DATA_PACKED) {
+                int status = aec_decode(&strm[g + j], flush);
+                if (status != AEC_OK && result == AEC_OK)
+                    result = status;
+            } else {
+                lane[m++] = &strm[g + j];
+            }
+        }
+
+        /* Decode up to the end of the current RSI or of the input,
+         * flush all lanes and continue with those which stopped at
+         * an RSI. */
+        while (m > 0) {
+            size_t ok = 0;
+            size_t next = 0;
+
+            for (size_t j = 0; j < m; j++) {
+                struct internal_state *state = lane[j]->state;
+                int status;
+
+                state->defer_flush = 1;
+                status = aec_decode(lane[j], flush);
+                state->defer_flush = 0;
+                if (status != AEC_OK) {
+                    if (result == AEC_OK)
+                        result = status;
+                    continue;
+                }
+                lane[ok++] = lane[j];
+            }
+
+            flush_lanes(lane, ok);
+
+            for (size_t j = 0; j < ok; j++) {
+                if (lane[j]->state->deferred) {
+                    lane[j]->state->deferred = 0;
+                    lane[next++] = lane[j];
+                }
+            }
+            m = next;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,247 @@
+/**
+ * @file decode_parallel.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Multithreaded decoding of a memory buffer
+ *
+ * A quick scan over the option IDs and code lengths locates the
+ * start of every RSI without decoding samples. RSIs carry no state
+ * from one to the next, so slices of consecutive RSIs can then be
+ * decoded concurrently, each into its final place in the output
+ * buffer. Slices which start inside a byte begin with the remaining
+ * bits of that byte in the accumulator.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "decode.h"
+#include "alloc.h"
+#include "scan.h"
+#include "threads.h"
+#include <stdint.h>
+#include <string.h>
+
+struct slice {
+    struct aec_stream strm;
+
+    /* 1 if slice has to fill its output buffer completely */
+    int exact;
+
+    int running;
+    int status;
+};
+
+static void *decode_slice(void *arg)
+{
+    struct slice *sl = arg;
+
+    sl->status = aec_decode(&sl->strm, AEC_FLUSH);
+    if (sl->status == AEC_OK && sl->exact && sl->strm.avail_out)
+        sl->status = AEC_DATA_ERROR;
+    return NULL;
+}
+
+int aec_buffer_decode_parallel(struct aec_stream *strm, unsigned int threads)
+{
+    struct aec_alloc alloc;
+    struct scanner s;
+    struct slice *slice = NULL;
+    aec_thread_t *thread = NULL;
+    size_t *offset = NULL;
+    size_t rsi_bytes;
+    size_t max_rsi;
+    size_t n_rsi;
+    size_t per_slice;
+    unsigned int initialized = 0;
+    int id_len;
+    int status;
+
+    /* 1 if the stream is to be decoded serially instead */
+    int serial = 0;
+
+    if (threads == 0)
+        threads = aec_cpu_count();
+    if (threads == 1)
+        return aec_buffer_decode(strm);
+
+    aec_alloc_init(&alloc, strm);
+    slice = aec_alloc(&alloc, threads * sizeof(struct slice));
+    thread = aec_alloc(&alloc, threads * sizeof(aec_thread_t));
+    if (slice == NULL || thread == NULL) {
+        serial = 1;
+        goto CLEANUP;
+    }
+
+    /* Slices are already decoded concurrently */
+    slice[0].strm = *strm;
+    slice[0].strm.flags &= ~AEC_PIPELINE;
+    status = aec_decode_init(&slice[0].strm);
+    if (status != AEC_OK) {
+        serial = status == AEC_MEM_ERROR;
+        goto CLEANUP;
+    }
+    initialized = 1;
+
+    rsi_bytes = (size_t)strm->rsi * strm->block_size
+        * slice[0].strm.state->bytes_per_sample;
+    if (strm->flags & AEC_DATA_PACKED)
+        rsi_bytes = rsi_bytes * strm->bits_per_sample / 8;
+    id_len = slice[0].strm.state->id_len;
+
+    /* The last RSI is always decoded by the last slice. */
+    max_rsi = strm->avail_out / rsi_bytes;
+    if (max_rsi * rsi_bytes == strm->avail_out && max_rsi > 0)
+        max_rsi--;
+
+    /* Every RSI holds at least one CDS of id_len + 2 bits, a zero
+     * block with the shortest FS */
+    max_rsi = MIN(max_rsi, strm->avail_in * 8 / ((size_t)id_len + 2));
+
+    offset = aec_alloc(&alloc, (max_rsi + 1) * sizeof(size_t));
+    if (offset == NULL) {
+        serial = 1;
+        goto CLEANUP;
+    }
+
+    s.data = strm->next_in;
+    s.pos = 0;
+    s.end = strm->avail_in * 8;
+    offset[0] = 0;
+    for (n_rsi = 0; n_rsi < max_rsi; n_rsi++) {
+        if (!scan_rsi(&s, strm, id_len))
+            break;
+        offset[n_rsi + 1] = s.pos;
+    }
+
+    /* Distribute the complete RSIs and the remainder of the stream
+     * over the slices. */
+    per_slice = (n_rsi + threads) / threads;
+    threads = (unsigned int)((n_rsi + per_slice) / per_slice);
+    if (threads < 2) {
+        serial = 1;
+        goto CLEANUP;
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        struct slice *sl = &slice[i];
+        size_t first = i * per_slice;
+        size_t in = offset[first] / 8;
+        size_t out = first * rsi_bytes;
+
+        if (i > 0) {
+            sl->strm = *strm;
+            sl->strm.flags &= ~AEC_PIPELINE;
+            status = aec_decode_init(&sl->strm);
+            if (status != AEC_OK) {
+                serial = 1;
+                goto CLEANUP;
+            }
+            initialized++;
+        }
+        sl->strm.next_in = strm->next_in + in;
+        sl->strm.next_out = strm->next_out + out;
+        sl->exact = i < threads - 1;
+        if (sl->exact) {
+            size_t last = first + per_slice;
+            sl->strm.avail_in = (offset[last] + 7) / 8 - in;
+            sl->strm.avail_out = (last - first) * rsi_bytes;
+        } else {
+            sl->strm.avail_in = strm->avail_in - in;
+            sl->strm.avail_out = strm->avail_out - out;
+        }
+        if (offset[first] % 8) {
+            sl->strm.state->acc = *sl->strm.next_in++;
+            sl->strm.avail_in--;
+            sl->strm.state->bitp = 8 - (int)(offset[first] % 8);
+        }
+    }
+
+    for (unsigned int i = 1; i < threads; i++) {
+        slice[i].running =
+            aec_thread_create(&thread[i], decode_slice, &slice[i]) == 0;
+        if (!slice[i].running)
+            decode_slice(&slice[i]);
+    }
+    decode_slice(&slice[0]);
+    for (unsigned int i = 1; i < threads; i++)
+        if (slice[i].running)
+            aec_thread_join(thread[i]);
+
+    status = AEC_OK;
+    for (unsigned int i = 0; i < threads; i++)
+        if (slice[i].status != AEC_OK)
+            status = slice[i].status;
+
+    if (status == AEC_OK) {
+        struct aec_stream *last = &slice[threads - 1].strm;
+        size_t total_in = (size_t)(last->next_in - strm->next_in);
+        size_t total_out = (size_t)(last->next_out - strm->next_out);
+
+        strm->next_in += total_in;
+        strm->avail_in -= total_in;
+        strm->total_in = total_in;
+        strm->next_out += total_out;
+        strm->avail_out -= total_out;
+        strm->total_out = total_out;
+    }
+
+CLEANUP:
+    if (slice) {
+        for (unsigned int i = 0; i < initialized; i++)
+            aec_decode_end(&slice[i].strm);
+        aec_free(&alloc, slice);
+    }
+    if (thread)
+        aec_free(&alloc, thread);
+    if (offset)
+        aec_free(&alloc, offset);
+
+    /* Only streams which we could not split, or for which memory
+     * ran out before decoding started, are left to the serial
+     * decoder. Errors of the slices are final. */
+    if (serial)
+        return aec_buffer_decode(strm);
+    return status;
+}
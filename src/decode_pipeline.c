@@ -0,0 +1,292 @@
+/**
+ * @file decode_pipeline.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Pipelined decoding of a single stream
+ *
+ * The calling thread decodes RSIs into a ring of RSI buffers while a
+ * flusher thread postprocesses complete RSIs and writes them to their
+ * place in the output. Buffers are handed over through two counters,
+ * submitted and flushed, each written by only one side. A thread
+ * only blocks on the condition variable if the ring is full or
+ * empty, and the other side only takes the mutex to wake it up if it
+ * announced that it waits. Before aec_decode() returns, all
+ * submitted RSIs are flushed.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "decode.h"
+#include "threads.h"
+#include <stdint.h>
+#include <string.h>
+
+struct job {
+    uint32_t *start;
+    uint32_t *end;
+    unsigned char *dest;
+};
+
+struct decode_pipeline {
+    /* copies of stream and state used by the flusher */
+    struct aec_stream strm;
+    struct internal_state state;
+
+    aec_thread_t thread;
+    aec_mutex_t mutex;
+    aec_cond_t cond;
+
+    /* 1 if thread, mutex and condition variable exist */
+    int started;
+
+    /* 1 if the thread could not be started */
+    int failed;
+
+    /* flusher should exit (mutex) */
+    int quit;
+
+    /* RSIs handed to the flusher and RSIs written to the output */
+    volatile size_t submitted;
+    volatile size_t flushed;
+
+    /* threads waiting for the other side to move a counter */
+    volatile size_t waiting;
+
+    uint32_t *buf[PIPELINE_SLOTS];
+    struct job job[PIPELINE_SLOTS];
+};
+
+static size_t load(volatile size_t *p)
+{
+    return aec_atomic_add(p, 0);
+}
+
+static void notify(struct decode_pipeline *pipe)
+{
+    /**
+       Wake up the other side after moving a counter. A waiter counts
+       itself in waiting before it checks the counters, so either it
+       sees the new count or we see it waiting.
+    */
+
+    if (load(&pipe->waiting)) {
+        aec_mutex_lock(&pipe->mutex);
+        aec_cond_broadcast(&pipe->cond);
+        aec_mutex_unlock(&pipe->mutex);
+    }
+}
+
+static void *flusher(void *arg)
+{
+    struct decode_pipeline *pipe = arg;
+    struct internal_state *state = &pipe->state;
+
+    for (;;) {
+        size_t n = load(&pipe->flushed);
+        struct job *job;
+
+        if (load(&pipe->submitted) == n) {
+            aec_mutex_lock(&pipe->mutex);
+            aec_atomic_add(&pipe->waiting, 1);
+            while (load(&pipe->submitted) == n && !pipe->quit)
+                aec_cond_wait(&pipe->cond, &pipe->mutex);
+            aec_atomic_sub(&pipe->waiting, 1);
+            aec_mutex_unlock(&pipe->mutex);
+            if (load(&pipe->submitted) == n)
+                break;
+        }
+
+        job = &pipe->job[n % PIPELINE_SLOTS];
+        state->rsi_buffer = pipe->buf[n % PIPELINE_SLOTS];
+        state->flush_start = job->start;
+        state->rsip = job->end;
+        pipe->strm.next_out = job->dest;
+        state->flush_output(&pipe->strm);
+
+        aec_atomic_add(&pipe->flushed, 1);
+        notify(pipe);
+    }
+    return NULL;
+}
+
+static int start(struct decode_pipeline *pipe)
+{
+    if (pipe->started)
+        return 1;
+    if (pipe->failed)
+        return 0;
+
+    if (aec_mutex_init(&pipe->mutex) == 0) {
+        if (aec_cond_init(&pipe->cond) == 0) {
+            if (aec_thread_create(&pipe->thread, flusher, pipe) == 0) {
+                pipe->started = 1;
+                return 1;
+            }
+            aec_cond_destroy(&pipe->cond);
+        }
+        aec_mutex_destroy(&pipe->mutex);
+    }
+    pipe->failed = 1;
+    return 0;
+}
+
+size_t aec_decode_pipeline_size(const struct aec_stream *strm)
+{
+    size_t buf = ALIGN_UP((size_t)strm->rsi * strm->block_size
+                          * sizeof(uint32_t));
+
+    return ALIGN_UP(sizeof(struct decode_pipeline))
+        + (PIPELINE_SLOTS - 1) * buf;
+}
+
+struct decode_pipeline *aec_decode_pipeline_setup(struct aec_stream *strm,
+                                                  uint8_t *ws)
+{
+    /**
+       Place the pipeline and additional RSI buffers at ws. The first
+       buffer of the ring is rsi_buffer.
+    */
+
+    struct decode_pipeline *pipe = (struct decode_pipeline *)ws;
+    size_t buf = ALIGN_UP((size_t)strm->rsi * strm->block_size
+                          * sizeof(uint32_t));
+
+    memset(pipe, 0, sizeof(*pipe));
+    ws += ALIGN_UP(sizeof(struct decode_pipeline));
+    pipe->buf[0] = strm->state->rsi_buffer;
+    for (int i = 1; i < PIPELINE_SLOTS; i++) {
+        pipe->buf[i] = (uint32_t *)ws;
+        ws += buf;
+    }
+    return pipe;
+}
+
+void aec_decode_pipeline_begin(struct aec_stream *strm)
+{
+    /**
+       Give the flusher a copy of the stream at the start of
+       aec_decode(). The flusher is idle.
+    */
+
+    struct decode_pipeline *pipe = strm->state->pipe;
+
+    pipe->strm = *strm;
+    pipe->state = *strm->state;
+    pipe->strm.state = &pipe->state;
+}
+
+int aec_decode_pipeline_flush(struct aec_stream *strm)
+{
+    /**
+       Hand the complete RSI in rsi_buffer to the flusher and continue
+       with the next buffer of the ring. Returns 0 if the RSI has to
+       be flushed by the caller.
+    */
+
+    struct internal_state *state = strm->state;
+    struct decode_pipeline *pipe = state->pipe;
+    size_t n = load(&pipe->submitted);
+    struct job *job = &pipe->job[n % PIPELINE_SLOTS];
+
+    if (!start(pipe))
+        return 0;
+
+    job->start = state->flush_start;
+    job->end = state->rsip;
+    job->dest = strm->next_out;
+    strm->next_out += (state->rsip - state->flush_start)
+        * state->bytes_per_sample;
+    aec_atomic_add(&pipe->submitted, 1);
+    notify(pipe);
+
+    n++;
+    if (n - load(&pipe->flushed) >= PIPELINE_SLOTS) {
+        aec_mutex_lock(&pipe->mutex);
+        aec_atomic_add(&pipe->waiting, 1);
+        while (n - load(&pipe->flushed) >= PIPELINE_SLOTS)
+            aec_cond_wait(&pipe->cond, &pipe->mutex);
+        aec_atomic_sub(&pipe->waiting, 1);
+        aec_mutex_unlock(&pipe->mutex);
+    }
+    state->rsi_buffer = pipe->buf[n % PIPELINE_SLOTS];
+    return 1;
+}
+
+void aec_decode_pipeline_drain(struct aec_stream *strm)
+{
+    /**
+       Wait until all submitted RSIs have been written and take over
+       the postprocessor state from the flusher.
+    */
+
+    struct internal_state *state = strm->state;
+    struct decode_pipeline *pipe = state->pipe;
+
+    if (!pipe->started)
+        return;
+
+    aec_mutex_lock(&pipe->mutex);
+    aec_atomic_add(&pipe->waiting, 1);
+    while (load(&pipe->flushed) != load(&pipe->submitted))
+        aec_cond_wait(&pipe->cond, &pipe->mutex);
+    aec_atomic_sub(&pipe->waiting, 1);
+    aec_mutex_unlock(&pipe->mutex);
+    state->last_out = pipe->state.last_out;
+}
+
+void aec_decode_pipeline_end(struct decode_pipeline *pipe)
+{
+    if (!pipe->started)
+        return;
+
+    aec_mutex_lock(&pipe->mutex);
+    pipe->quit = 1;
+    aec_cond_broadcast(&pipe->cond);
+    aec_mutex_unlock(&pipe->mutex);
+    aec_thread_join(pipe->thread);
+    aec_cond_destroy(&pipe->cond);
+    aec_mutex_destroy(&pipe->mutex);
+    pipe->started = 0;
+}
@@ -52,6 +52,8 @@
 #include "encode.h"
 #include "encode_accessors.h"
 #include "libaec.h"
+#include "snapshot.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -227,26 +229,29 @@ static inline void emitblock(struct aec_stream *strm, int k, int ref)
     state->bits = p % 8;
 }
 
-static void preprocess_unsigned(struct aec_stream *strm)
+static void preprocess_unsigned(const struct aec_stream *strm,
+                                uint32_t *x_in, uint32_t *d_out,
+                                size_t begin, size_t end)
 {
     /**
-       Preprocess RSI of unsigned samples.
+       Preprocess samples begin to end - 1 of an RSI of unsigned
+       samples x_in into d_out.
 
        Combining preprocessing and converting to uint32_t in one loop
        is slower due to the data dependence on x_i-1.
     */
 
     uint32_t D;
-    struct internal_state *state = strm->state;
-    const uint32_t *restrict x = state->data_raw;
-    uint32_t *restrict d = state->data_pp;
+    const struct internal_state *state = strm->state;
+    const uint32_t *restrict x = x_in;
+    uint32_t *restrict d = d_out;
     uint32_t xmax = state->xmax;
-    uint32_t rsi = strm->rsi * strm->block_size - 1;
 
-    state->ref = 1;
-    state->ref_sample = x[0];
-    d[0] = 0;
-    for (size_t i = 0; i < rsi; i++) {
+    if (begin == 0) {
+        d[0] = 0;
+        begin = 1;
+    }
+    for (size_t i = begin - 1; i < end - 1; i++) {
         if (x[i + 1] >= x[i]) {
             D = x[i + 1] - x[i];
             if (D <= x[i])
@@ -261,31 +266,34 @@ static void preprocess_unsigned(struct aec_stream *strm)
                 d[i + 1] = xmax - x[i + 1];
         }
     }
-    state->uncomp_len = (strm->block_size - 1) * strm->bits_per_sample;
 }
 
-static void preprocess_signed(struct aec_stream *strm)
+static void preprocess_signed(const struct aec_stream *strm,
+                              uint32_t *x_in, uint32_t *d_out,
+                              size_t begin, size_t end)
 {
     /**
-       Preprocess RSI of signed samples.
+       Preprocess samples begin to end - 1 of an RSI of signed
+       samples x_in into d_out. Samples in x_in are sign extended in
+       place.
     */
 
     uint32_t D;
-    struct internal_state *state = strm->state;
-    uint32_t *restrict x = state->data_raw;
-    uint32_t *restrict d = state->data_pp;
+    const struct internal_state *state = strm->state;
+    uint32_t *restrict x = x_in;
+    uint32_t *restrict d = d_out;
     uint32_t xmax = state->xmax;
     uint32_t xmin = state->xmin;
-    uint32_t rsi = strm->rsi * strm->block_size - 1;
     uint32_t m = UINT32_C(1) << (strm->bits_per_sample - 1);
 
-    state->ref = 1;
-    state->ref_sample = x[0];
-    d[0] = 0;
-    /* Sign extension */
-    x[0] = (x[0] ^ m) - m;
+    if (begin == 0) {
+        d[0] = 0;
+        /* Sign extension */
+        x[0] = (x[0] ^ m) - m;
+        begin = 1;
+    }
 
-    for (size_t i = 0; i < rsi; i++) {
+    for (size_t i = begin - 1; i < end - 1; i++) {
         x[i + 1] = (x[i + 1] ^ m) - m;
         if ((int32_t)x[i + 1] < (int32_t)x[i]) {
             D = x[i] - x[i + 1];
@@ -301,6 +309,19 @@ static void preprocess_signed(struct aec_stream *strm)
                 d[i + 1] = x[i + 1] - xmin;
         }
     }
+}
+
+static void set_reference(struct aec_stream *strm, uint32_t ref_sample)
+{
+    /**
+       Set up the first block of a preprocessed RSI. The reference
+       sample is the unprocessed first sample.
+    */
+
+    struct internal_state *state = strm->state;
+
+    state->ref = 1;
+    state->ref_sample = ref_sample;
     state->uncomp_len = (strm->block_size - 1) * strm->bits_per_sample;
 }
 
@@ -426,29 +447,102 @@ static uint32_t assess_se_option(struct aec_stream *strm)
     return (uint32_t)len;
 }
 
+static void drain_output(struct aec_stream *strm)
+{
+    /**
+       Copy as many complete bytes from the staging buffer to next_out
+       as fit. Once the staging buffer is empty, the pending partial
+       byte is moved to its start.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t n = MIN((size_t)(state->cds - state->flush_start),
+                   strm->avail_out);
+
+    memcpy(strm->next_out, state->flush_start, n);
+    strm->next_out += n;
+    strm->avail_out -= n;
+    state->flush_start += n;
+
+    if (state->flush_start == state->cds) {
+        *state->cds_buf = *state->cds;
+        state->cds = state->cds_buf;
+        state->flush_start = state->cds_buf;
+    }
+}
+
 static void init_output(struct aec_stream *strm)
 {
     /**
        Direct output to next_out if next_out can hold a Coded Data
-       Set, use internal buffer otherwise.
+       Set, use internal staging buffer otherwise.
+
+       Output in the staging buffer has to be drained before we can
+       switch back to direct output.
     */
 
     struct internal_state *state = strm->state;
 
-    if (strm->avail_out > CDSLEN) {
-        if (!state->direct_out) {
+    if (state->direct_out) {
+        if (strm->avail_out <= CDSLEN) {
+            /* copy leftover from last block */
+            *state->cds_buf = *state->cds;
+            state->cds = state->cds_buf;
+            state->flush_start = state->cds_buf;
+            state->direct_out = 0;
+        }
+    } else if (strm->avail_out > CDSLEN) {
+        if (state->flush_start < state->cds)
+            drain_output(strm);
+        if (state->flush_start == state->cds && strm->avail_out > CDSLEN) {
             state->direct_out = 1;
             *strm->next_out = *state->cds;
             state->cds = strm->next_out;
         }
-    } else {
-        if (state->zero_blocks == 0 || state->direct_out) {
-            /* copy leftover from last block */
-            *state->cds_buf = *state->cds;
-            state->cds = state->cds_buf;
+    }
+}
+
+static void index_rsi(struct aec_stream *strm, size_t samples)
+{
+    /**
+       Record the bit position of an RSI that is about to be encoded
+       in the index.
+    */
+
+    struct internal_state *state = strm->state;
+    struct aec_index *index = state->index;
+    size_t pending;
+    size_t interval;
+
+    if (index == NULL)
+        return;
+
+    interval = index->interval ? index->interval : 1;
+    if (state->rsi_count++ % interval == 0) {
+        if (index->count == index->capacity) {
+            size_t capacity = index->capacity ? 2 * index->capacity : 64;
+            uint64_t *offsets = realloc(index->offsets,
+                                        capacity * sizeof(uint64_t));
+            if (offsets == NULL) {
+                state->index_error = 1;
+                state->index = NULL;
+                return;
+            }
+            index->offsets = offsets;
+            index->capacity = capacity;
         }
-        state->direct_out = 0;
+
+        /* Output not yet accounted for in avail_out */
+        if (state->direct_out)
+            pending = (size_t)(state->cds - strm->next_out);
+        else
+            pending = (size_t)(state->cds - state->flush_start);
+
+        index->offsets[index->count++] =
+            (uint64_t)(strm->total_out - strm->avail_out + pending) * 8
+            + 8 - state->bits;
     }
+    index->samples += samples;
 }
 
 /*
@@ -460,18 +554,13 @@ static void init_output(struct aec_stream *strm)
 static int m_flush_block_resumable(struct aec_stream *strm)
 {
     /**
-       Slow and restartable flushing
+       Slow and restartable flushing of the staging buffer
     */
     struct internal_state *state = strm->state;
 
-    int n = (int)MIN((size_t)(state->cds - state->cds_buf - state->i),
-                     strm->avail_out);
-    memcpy(strm->next_out, state->cds_buf + state->i, n);
-    strm->next_out += n;
-    strm->avail_out -= n;
-    state->i += n;
+    drain_output(strm);
 
-    if (strm->avail_out == 0) {
+    if (state->flush_start < state->cds) {
         return M_EXIT;
     } else {
         state->mode = m_get_block;
@@ -479,22 +568,37 @@ static int m_flush_block_resumable(struct aec_stream *strm)
     }
 }
 
+static int m_flush_final(struct aec_stream *strm)
+{
+    /**
+       Drain remaining output after the last byte has been padded.
+    */
+    struct internal_state *state = strm->state;
+
+    if (!state->direct_out) {
+        drain_output(strm);
+        if (state->flush_start < state->cds)
+            return M_EXIT;
+    }
+    state->flushed = 1;
+    return M_EXIT;
+}
+
 static int m_flush_block(struct aec_stream *strm)
 {
     /**
        Flush block in direct_out mode by updating counters.
 
-       Fall back to slow flushing if in buffered mode.
+       In buffered mode, keep collecting CDSs in the staging buffer
+       and only drain it when it can't hold another CDS. copy64() may
+       write up to 7 bytes past the end of a CDS.
     */
     struct internal_state *state = strm->state;
 
-#ifdef ENABLE_RSI_PADDING
     if (state->blocks_avail == 0
         && strm->flags & AEC_PAD_RSI
-        && state->block_nonzero == 0
-        )
+        && state->block_nonzero == 0)
         emit(state, 0, state->bits % 8);
-#endif
 
     if (state->direct_out) {
         int n = (int)(state->cds - strm->next_out);
@@ -504,8 +608,10 @@ static int m_flush_block(struct aec_stream *strm)
         return M_CONTINUE;
     }
 
-    state->i = 0;
-    state->mode = m_flush_block_resumable;
+    if (state->cds_buf + CDS_BUF_LEN - state->cds > CDSLEN + 8)
+        state->mode = m_get_block;
+    else
+        state->mode = m_flush_block_resumable;
     return M_CONTINUE;
 }
 
@@ -561,8 +667,12 @@ static int m_encode_zero(struct aec_stream *strm)
     if (state->zero_ref)
         emit(state, state->zero_ref_sample, strm->bits_per_sample);
 
-    if (state->zero_blocks == ROS)
+    if (state->zero_blocks == ROS) {
         emitfs(state, 4);
+        /* The decoder would fill the RSI up to its end */
+        if (state->blocks_avail == 0 && state->tail_samples)
+            state->tail_ros = 1;
+    }
     else if (state->zero_blocks >= 5)
         emitfs(state, state->zero_blocks);
     else
@@ -653,49 +763,152 @@ static int m_get_rsi_resumable(struct aec_stream *strm)
     /**
        Get RSI while input buffer is short.
 
-       Let user provide more input. Once we got all input pad buffer
-       to full RSI.
+       Convert all complete samples available in one go and let user
+       provide more input. Once we got all input pad buffer to full
+       RSI.
     */
 
     struct internal_state *state = strm->state;
+    size_t rsi_samples = strm->rsi * strm->block_size;
+    size_t n = MIN(strm->avail_in / state->bytes_per_sample
+                   * state->unit_samples, rsi_samples - state->i);
+    size_t samples;
+
+    if (n > 0) {
+        state->get_samples(strm, state->data_raw + state->i, n);
+        state->i += (uint32_t)n;
+    }
 
-    do {
-        if (strm->avail_in >= state->bytes_per_sample) {
-            state->data_raw[state->i] = state->get_sample(strm);
-        } else {
-            if (state->flush == AEC_FLUSH) {
-                if (state->i > 0) {
-                    state->blocks_avail = state->i / strm->block_size - 1;
-                    if (state->i % strm->block_size)
-                        state->blocks_avail++;
-                    do
-                        state->data_raw[state->i] =
-                            state->data_raw[state->i - 1];
-                    while(++state->i < strm->rsi * strm->block_size);
-                } else {
-                    /* Finish encoding by padding the last byte with
-                     * zero bits. */
-                    emit(state, 0, state->bits);
-                    if (strm->avail_out > 0) {
-                        if (!state->direct_out)
-                            *strm->next_out++ = *state->cds;
-                        strm->avail_out--;
-                        state->flushed = 1;
-                    }
-                    return M_EXIT;
-                }
+    samples = state->i;
+    if (state->i < rsi_samples) {
+        if (state->flush == AEC_FLUSH) {
+            if (state->i > 0) {
+                state->tail_samples = state->i;
+                state->blocks_avail = state->i / strm->block_size - 1;
+                if (state->i % strm->block_size)
+                    state->blocks_avail++;
+                do
+                    state->data_raw[state->i] =
+                        state->data_raw[state->i - 1];
+                while(++state->i < rsi_samples);
+            } else if (state->synced && state->bits == 8) {
+                /* The last byte has already been completed by a
+                 * sync flush. */
+                state->final_bits = 8;
+                state->mode = m_flush_final;
+                return M_CONTINUE;
             } else {
-                return M_EXIT;
+                /* Finish encoding by padding the last byte with
+                 * zero bits. */
+                state->final_bits = 8 - state->bits;
+                emit(state, 0, state->bits);
+                state->tail_byte = *state->cds;
+                *++state->cds = 0;
+                state->bits = 8;
+                state->mode = m_flush_final;
+                return M_CONTINUE;
+            }
+        } else if (strm->flags & AEC_STREAM_BLOCKS
+                   && state->i >= strm->block_size) {
+            /* Start encoding the complete blocks, the number of
+             * samples is added to the index once it is known. */
+            index_rsi(strm, 0);
+            state->pp_samples = state->i - state->i % strm->block_size;
+            if (strm->flags & AEC_DATA_PREPROCESS) {
+                set_reference(strm, state->data_raw[0]);
+                state->preprocess(strm, state->data_raw, state->data_pp,
+                                  0, state->pp_samples);
             }
+            state->rsi_streaming = 1;
+            return m_check_zero_block(strm);
+        } else {
+            return M_EXIT;
         }
-    } while (++state->i < strm->rsi * strm->block_size);
+    }
 
-    if (strm->flags & AEC_DATA_PREPROCESS)
-        state->preprocess(strm);
+    index_rsi(strm, samples);
+    if (strm->flags & AEC_DATA_PREPROCESS) {
+        set_reference(strm, state->data_raw[0]);
+        state->preprocess(strm, state->data_raw, state->data_pp, 0,
+                          rsi_samples);
+    }
 
     return m_check_zero_block(strm);
 }
 
+static int m_get_block_stream(struct aec_stream *strm)
+{
+    /**
+       Get the samples of the next block of a streamed RSI.
+
+       Once the RSI is complete or the stream is flushed, the number
+       of blocks in the RSI is known. If its last block has already
+       been encoded, finish the RSI like m_check_zero_block and
+       m_flush_block would have done.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t rsi_samples = strm->rsi * strm->block_size;
+    size_t n = MIN(strm->avail_in / state->bytes_per_sample
+                   * state->unit_samples, rsi_samples - state->i);
+    size_t samples;
+    size_t ready;
+    int blocks = 0;
+
+    if (n > 0) {
+        state->get_samples(strm, state->data_raw + state->i, n);
+        state->i += (uint32_t)n;
+    }
+
+    samples = state->i;
+    if (state->i == rsi_samples) {
+        blocks = strm->rsi;
+    } else if (state->flush == AEC_FLUSH) {
+        /* Pad the last block. Samples from pp_samples on are not
+         * preprocessed yet. */
+        state->tail_samples = state->i;
+        while (state->i % strm->block_size) {
+            state->data_raw[state->i] = state->data_raw[state->i - 1];
+            state->i++;
+        }
+        blocks = (int)(state->i / strm->block_size);
+    }
+
+    ready = state->i - state->i % strm->block_size;
+    if (ready > state->pp_samples) {
+        if (strm->flags & AEC_DATA_PREPROCESS)
+            state->preprocess(strm, state->data_raw, state->data_pp,
+                              state->pp_samples, ready);
+        state->pp_samples = (uint32_t)ready;
+    }
+
+    if (blocks == 0) {
+        if ((state->blocks_dispensed + 1) * strm->block_size > ready)
+            return M_EXIT;
+        state->mode = m_get_block;
+        return M_CONTINUE;
+    }
+
+    /* A continued RSI started in the previous stream */
+    if (state->index && !state->resumed)
+        state->index->samples += samples;
+    state->rsi_streaming = 0;
+    state->resumed = 0;
+    state->blocks_avail = blocks - state->blocks_dispensed;
+    if (state->blocks_avail == 0) {
+        if (state->zero_blocks) {
+            if (state->zero_blocks > 4)
+                state->zero_blocks = ROS;
+            state->mode = m_encode_zero;
+            return M_CONTINUE;
+        }
+        if (strm->flags & AEC_PAD_RSI)
+            emit(state, 0, state->bits % 8);
+    }
+    state->mode = m_get_block;
+    return M_CONTINUE;
+}
+
 static int m_get_block(struct aec_stream *strm)
 {
     /**
@@ -706,6 +919,7 @@ static int m_get_block(struct aec_stream *strm)
     */
 
     struct internal_state *state = strm->state;
+    uint32_t ref_sample;
 
     init_output(strm);
 
@@ -720,10 +934,23 @@ static int m_get_block(struct aec_stream *strm)
         state->block = state->data_pp;
         state->blocks_dispensed = 1;
 
-        if (strm->avail_in >= state->rsi_len) {
-            state->get_rsi(strm);
+        if (state->pipe
+            && aec_pipeline_pop(strm, &state->block, &ref_sample)) {
+            index_rsi(strm, strm->rsi * strm->block_size);
             if (strm->flags & AEC_DATA_PREPROCESS)
-                state->preprocess(strm);
+                set_reference(strm, ref_sample);
+            return m_check_zero_block(strm);
+        }
+
+        if (strm->avail_in >= state->rsi_len) {
+            state->get_samples(strm, state->data_raw,
+                               strm->rsi * strm->block_size);
+            index_rsi(strm, strm->rsi * strm->block_size);
+            if (strm->flags & AEC_DATA_PREPROCESS) {
+                set_reference(strm, state->data_raw[0]);
+                state->preprocess(strm, state->data_raw, state->data_pp,
+                                  0, (size_t)strm->rsi * strm->block_size);
+            }
 
             return m_check_zero_block(strm);
         } else {
@@ -731,6 +958,12 @@ static int m_get_block(struct aec_stream *strm)
             state->mode = m_get_rsi_resumable;
         }
     } else {
+        if (state->rsi_streaming
+            && (state->blocks_dispensed + 1) * strm->block_size
+            > state->pp_samples) {
+            state->mode = m_get_block_stream;
+            return M_CONTINUE;
+        }
         if (state->ref) {
             state->ref = 0;
             state->uncomp_len = strm->block_size * strm->bits_per_sample;
@@ -747,27 +980,31 @@ static void cleanup(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
 
-    if (strm->flags & AEC_DATA_PREPROCESS && state->data_raw)
-        free(state->data_raw);
-    if (state->data_pp)
-        free(state->data_pp);
-    free(state);
+    if (state->pipe)
+        aec_pipeline_end(state->pipe);
+    if (state->own_workspace) {
+        /* The allocator lives in the workspace */
+        struct aec_alloc alloc = state->alloc;
+        aec_free(&alloc, state->workspace);
+    }
+    strm->state = NULL;
 }
 
-/*
- *
- * API functions
- *
- */
-
-int aec_encode_init(struct aec_stream *strm)
+static unsigned int packed_group(unsigned int bits_per_sample)
 {
-    struct internal_state *state;
+    /**
+       Smallest number of packed samples which fill whole bytes.
+    */
+    unsigned int low = bits_per_sample & (0U - bits_per_sample);
+    return low >= 8 ? 1 : 8 / low;
+}
 
+static int check_params(const struct aec_stream *strm, unsigned int flags)
+{
     if (strm->bits_per_sample > 32 || strm->bits_per_sample == 0)
         return AEC_CONF_ERROR;
 
-    if (strm->flags & AEC_NOT_ENFORCE) {
+    if (flags & AEC_NOT_ENFORCE) {
         /* All even block sizes are allowed. */
         if (strm->block_size & 1)
             return AEC_CONF_ERROR;
@@ -783,36 +1020,91 @@ int aec_encode_init(struct aec_stream *strm)
     if (strm->rsi > 4096)
         return AEC_CONF_ERROR;
 
-    state = malloc(sizeof(struct internal_state));
-    if (state == NULL)
-        return AEC_MEM_ERROR;
+    if (flags & AEC_RESTRICTED && strm->bits_per_sample > 4)
+        return AEC_CONF_ERROR;
 
-    memset(state, 0, sizeof(struct internal_state));
-    strm->state = state;
-    state->uncomp_len = strm->block_size * strm->bits_per_sample;
+    if (flags & AEC_CUSTOM_ALLOC
+        && (strm->alloc_func == NULL || strm->free_func == NULL))
+        return AEC_CONF_ERROR;
+
+    if (flags & AEC_DATA_STRIDED) {
+        unsigned int width;
+
+        if (strm->bits_per_sample > 16)
+            width = strm->bits_per_sample <= 24
+                && flags & AEC_DATA_3BYTE ? 3 : 4;
+        else
+            width = strm->bits_per_sample > 8 ? 2 : 1;
+        if (strm->sample_stride < width
+            || (uint64_t)strm->rsi * strm->block_size * strm->sample_stride
+            > UINT32_MAX)
+            return AEC_CONF_ERROR;
+    }
+
+    if (flags & AEC_DATA_PACKED
+        && (flags & AEC_DATA_STRIDED
+            || strm->block_size % packed_group(strm->bits_per_sample)))
+        return AEC_CONF_ERROR;
+
+    return AEC_OK;
+}
+
+static size_t buffer_size(const struct aec_stream *strm)
+{
+    /**
+       Bytes needed for one RSI of samples.
+    */
+    return ALIGN_UP((size_t)strm->rsi * strm->block_size * sizeof(uint32_t));
+}
+
+static size_t workspace_size(const struct aec_stream *strm,
+                             unsigned int flags)
+{
+    size_t size;
+
+    if (check_params(strm, flags) != AEC_OK)
+        return 0;
+
+    size = WORKSPACE_ALIGN - 1
+        + ALIGN_UP(sizeof(struct internal_state))
+        + buffer_size(strm);
+    if (flags & AEC_DATA_PREPROCESS)
+        size += buffer_size(strm);
+    if (flags & AEC_PIPELINE)
+        size += aec_pipeline_size(strm);
+    return size;
+}
+
+static void configure(struct aec_stream *strm)
+{
+    /**
+       Derive coding parameters from user settings.
+    */
+    struct internal_state *state = strm->state;
+    int strided = (state->flags & AEC_DATA_STRIDED) != 0;
 
     if (strm->bits_per_sample > 16) {
         /* 24/32 input bit settings */
         state->id_len = 5;
 
         if (strm->bits_per_sample <= 24
-            && strm->flags & AEC_DATA_3BYTE) {
+            && state->flags & AEC_DATA_3BYTE) {
             state->bytes_per_sample = 3;
-            if (strm->flags & AEC_DATA_MSB) {
-                state->get_sample = aec_get_msb_24;
-                state->get_rsi = aec_get_rsi_msb_24;
+            if (state->flags & AEC_DATA_MSB) {
+                state->get_samples = strided
+                    ? aec_get_samples_strided_msb_24 : aec_get_samples_msb_24;
             } else {
-                state->get_sample = aec_get_lsb_24;
-                state->get_rsi = aec_get_rsi_lsb_24;
+                state->get_samples = strided
+                    ? aec_get_samples_strided_lsb_24 : aec_get_samples_lsb_24;
             }
         } else {
             state->bytes_per_sample = 4;
-            if (strm->flags & AEC_DATA_MSB) {
-                state->get_sample = aec_get_msb_32;
-                state->get_rsi = aec_get_rsi_msb_32;
+            if (state->flags & AEC_DATA_MSB) {
+                state->get_samples = strided
+                    ? aec_get_samples_strided_msb_32 : aec_get_samples_msb_32;
             } else {
-                state->get_sample = aec_get_lsb_32;
-                state->get_rsi = aec_get_rsi_lsb_32;
+                state->get_samples = strided
+                    ? aec_get_samples_strided_lsb_32 : aec_get_samples_lsb_32;
             }
         }
     }
@@ -821,35 +1113,61 @@ int aec_encode_init(struct aec_stream *strm)
         state->id_len = 4;
         state->bytes_per_sample = 2;
 
-        if (strm->flags & AEC_DATA_MSB) {
-            state->get_sample = aec_get_msb_16;
-            state->get_rsi = aec_get_rsi_msb_16;
+        if (state->flags & AEC_DATA_MSB) {
+            state->get_samples = strided
+                ? aec_get_samples_strided_msb_16 : aec_get_samples_msb_16;
         } else {
-            state->get_sample = aec_get_lsb_16;
-            state->get_rsi = aec_get_rsi_lsb_16;
+            state->get_samples = strided
+                ? aec_get_samples_strided_lsb_16 : aec_get_samples_lsb_16;
         }
     } else {
         /* 8 bit settings */
-        if (strm->flags & AEC_RESTRICTED) {
-            if (strm->bits_per_sample <= 4) {
-                if (strm->bits_per_sample <= 2)
-                    state->id_len = 1;
-                else
-                    state->id_len = 2;
-            } else {
-                return AEC_CONF_ERROR;
-            }
+        if (state->flags & AEC_RESTRICTED) {
+            if (strm->bits_per_sample <= 2)
+                state->id_len = 1;
+            else
+                state->id_len = 2;
         } else {
             state->id_len = 3;
         }
         state->bytes_per_sample = 1;
 
-        state->get_sample = aec_get_8;
-        state->get_rsi = aec_get_rsi_8;
+        state->get_samples = strided
+            ? aec_get_samples_strided_8 : aec_get_samples_8;
     }
-    state->rsi_len = strm->rsi * strm->block_size * state->bytes_per_sample;
 
-    if (strm->flags & AEC_DATA_SIGNED) {
+    /* Counts of input bytes include the gaps between samples */
+    if (strided)
+        state->bytes_per_sample = strm->sample_stride;
+
+    /* Packed samples are read in groups which end on a byte boundary */
+    state->unit_samples = 1;
+    if (state->flags & AEC_DATA_PACKED) {
+        state->unit_samples = packed_group(strm->bits_per_sample);
+        state->bytes_per_sample =
+            state->unit_samples * strm->bits_per_sample / 8;
+        switch (strm->bits_per_sample) {
+        case 1:
+            state->get_samples = aec_get_samples_packed_1;
+            break;
+        case 2:
+            state->get_samples = aec_get_samples_packed_2;
+            break;
+        case 4:
+            state->get_samples = aec_get_samples_packed_4;
+            break;
+        case 12:
+            state->get_samples = aec_get_samples_packed_12;
+            break;
+        default:
+            state->get_samples = aec_get_samples_packed;
+            break;
+        }
+    }
+    state->rsi_len = strm->rsi * strm->block_size / state->unit_samples
+        * state->bytes_per_sample;
+
+    if (state->flags & AEC_DATA_SIGNED) {
         state->xmax = (INT64_C(1) << (strm->bits_per_sample - 1)) - 1;
         state->xmin = ~state->xmax;
         state->preprocess = preprocess_signed;
@@ -860,35 +1178,55 @@ int aec_encode_init(struct aec_stream *strm)
     }
 
     state->kmax = (1U << state->id_len) - 3;
+    state->uncomp_len = strm->block_size * strm->bits_per_sample;
+}
 
-    state->data_pp = malloc(strm->rsi
-                            * strm->block_size
-                            * sizeof(uint32_t));
-    if (state->data_pp == NULL) {
-        cleanup(strm);
+static int setup(struct aec_stream *strm, void *workspace, size_t size,
+                 int own_workspace, unsigned int flags)
+{
+    /**
+       Place state and buffers in workspace and start a new stream.
+    */
+    struct internal_state *state;
+    uint8_t *ws;
+    size_t offset;
+
+    offset = (WORKSPACE_ALIGN - (uintptr_t)workspace % WORKSPACE_ALIGN)
+        % WORKSPACE_ALIGN;
+    if (size < workspace_size(strm, flags))
         return AEC_MEM_ERROR;
-    }
 
-    if (strm->flags & AEC_DATA_PREPROCESS) {
-        state->data_raw = malloc(strm->rsi
-                                 * strm->block_size
-                                 * sizeof(uint32_t));
-        if (state->data_raw == NULL) {
-            cleanup(strm);
-            return AEC_MEM_ERROR;
-        }
+    ws = (uint8_t *)workspace + offset;
+    state = (struct internal_state *)ws;
+    memset(state, 0, offsetof(struct internal_state, cds_buf));
+    state->workspace = workspace;
+    state->workspace_size = size;
+    state->own_workspace = own_workspace;
+    state->flags = flags;
+    strm->state = state;
+
+    ws += ALIGN_UP(sizeof(struct internal_state));
+    state->data_pp = (uint32_t *)ws;
+    ws += buffer_size(strm);
+    if (flags & AEC_DATA_PREPROCESS) {
+        state->data_raw = (uint32_t *)ws;
+        ws += buffer_size(strm);
     } else {
         state->data_raw = state->data_pp;
     }
 
-    state->block = state->data_pp;
+    configure(strm);
+    if (flags & AEC_PIPELINE)
+        state->pipe = aec_pipeline_setup(strm, ws);
 
+    state->block = state->data_pp;
     state->ref = 0;
     strm->total_in = 0;
     strm->total_out = 0;
     state->flushed = 0;
 
     state->cds = state->cds_buf;
+    state->flush_start = state->cds_buf;
     *state->cds = 0;
     state->bits = 8;
     state->mode = m_get_block;
@@ -896,6 +1234,404 @@ int aec_encode_init(struct aec_stream *strm)
     return AEC_OK;
 }
 
+static int init(struct aec_stream *strm, unsigned int flags)
+{
+    struct aec_alloc alloc;
+    void *workspace;
+    size_t size;
+    int status = check_params(strm, flags);
+    if (status != AEC_OK)
+        return status;
+
+    size = workspace_size(strm, flags);
+    aec_alloc_init(&alloc, strm);
+    workspace = aec_alloc(&alloc, size);
+    if (workspace == NULL)
+        return AEC_MEM_ERROR;
+
+    status = setup(strm, workspace, size, 1, flags);
+    if (status != AEC_OK) {
+        aec_free(&alloc, workspace);
+        return status;
+    }
+    strm->state->alloc = alloc;
+    return AEC_OK;
+}
+
+/*
+ *
+ * API functions
+ *
+ */
+
+size_t aec_encode_workspace_size(const struct aec_stream *strm)
+{
+    return workspace_size(strm, strm->flags);
+}
+
+int aec_encode_init_workspace(struct aec_stream *strm,
+                              void *workspace, size_t size)
+{
+    int status = check_params(strm, strm->flags);
+    if (status != AEC_OK)
+        return status;
+
+    return setup(strm, workspace, size, 0, strm->flags);
+}
+
+int aec_encode_owns_workspace(const struct aec_stream *strm)
+{
+    return strm->state->own_workspace;
+}
+
+int aec_encode_init(struct aec_stream *strm)
+{
+    return init(strm, strm->flags);
+}
+
+int aec_encode_reset(struct aec_stream *strm)
+{
+    /**
+       Start a new stream reusing the memory of strm->state. Grow
+       the workspace if the new parameters need more memory and the
+       workspace is owned by the library.
+    */
+    struct internal_state *state = strm->state;
+    struct aec_alloc alloc = state->alloc;
+    void *workspace = state->workspace;
+    size_t size = state->workspace_size;
+    int own_workspace = state->own_workspace;
+    int status = check_params(strm, strm->flags);
+    if (status != AEC_OK)
+        return status;
+
+    if (state->pipe)
+        aec_pipeline_end(state->pipe);
+    if (size < aec_encode_workspace_size(strm)) {
+        if (!own_workspace)
+            return AEC_MEM_ERROR;
+        aec_free(&alloc, workspace);
+        strm->state = NULL;
+        return aec_encode_init(strm);
+    }
+    status = setup(strm, workspace, size, own_workspace, strm->flags);
+    if (status == AEC_OK)
+        strm->state->alloc = alloc;
+    return status;
+}
+
+int aec_encode_init_append(struct aec_stream *strm,
+                           const struct aec_tail *tail)
+{
+    /**
+       Start a new stream at the end of a finished one. The current
+       byte is prefilled with its bits and an incomplete RSI is
+       continued like a streamed RSI whose blocks have been encoded.
+    */
+    struct internal_state *state;
+    int status = check_params(strm, strm->flags);
+    if (status != AEC_OK)
+        return status;
+
+    if (tail->bits > 7 || tail->rsi_blocks >= strm->rsi
+        || (strm->flags & AEC_PAD_RSI && (tail->bits || tail->rsi_blocks)))
+        return AEC_CONF_ERROR;
+
+    status = aec_encode_init(strm);
+    if (status != AEC_OK)
+        return status;
+    state = strm->state;
+
+    if (tail->bits) {
+        *state->cds = tail->byte & (0xff << (8 - tail->bits));
+        state->bits = 8 - tail->bits;
+    } else {
+        state->synced = 1;
+    }
+
+    if (tail->rsi_blocks) {
+        uint32_t samples = tail->rsi_blocks * strm->block_size;
+        uint32_t x = tail->last_sample;
+
+        /* The preprocessor expects sign extended samples */
+        if ((strm->flags & AEC_DATA_PREPROCESS)
+            && (strm->flags & AEC_DATA_SIGNED)) {
+            uint32_t m = UINT32_C(1) << (strm->bits_per_sample - 1);
+            x = (x ^ m) - m;
+        }
+        state->data_raw[samples - 1] = x;
+        state->i = samples;
+        state->pp_samples = samples;
+        state->blocks_dispensed = (int)tail->rsi_blocks;
+        state->blocks_avail = (int)(strm->rsi - tail->rsi_blocks);
+        state->block = state->data_pp + samples - strm->block_size;
+        state->rsi_streaming = 1;
+        state->resumed = 1;
+    }
+    return AEC_OK;
+}
+
+int aec_encode_tail(struct aec_stream *strm, struct aec_tail *tail)
+{
+    struct internal_state *state = strm->state;
+    uint32_t samples = state->tail_samples;
+    uint32_t mask = UINT32_MAX >> (32 - strm->bits_per_sample);
+
+    if (!state->flushed)
+        return AEC_STREAM_ERROR;
+    if (samples % strm->block_size || state->tail_ros
+        || (samples && strm->flags & AEC_PAD_RSI))
+        return AEC_DATA_ERROR;
+
+    tail->bits = (unsigned int)state->final_bits % 8;
+    tail->byte = tail->bits ? state->tail_byte : 0;
+    tail->rsi_blocks = samples / strm->block_size;
+    tail->last_sample = samples ? state->data_raw[samples - 1] & mask : 0;
+    return AEC_OK;
+}
+
+/* States in which aec_encode() can return */
+static int (*const snapshot_modes[])(struct aec_stream *) = {
+    m_get_block, m_get_rsi_resumable, m_get_block_stream,
+    m_flush_block_resumable, m_flush_final
+};
+
+#define SNAPSHOT_MODES (sizeof(snapshot_modes) / sizeof(snapshot_modes[0]))
+
+static int save(struct aec_stream *strm, struct snapshot *s)
+{
+    /**
+       Write the state between two calls of aec_encode() to s. Of
+       the RSI buffers only the blocks still to be encoded and the
+       samples needed for preprocessing more input are kept.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t bs = strm->block_size;
+    size_t pp_begin = 0;
+    size_t pp_end = 0;
+    size_t raw_begin = 0;
+    size_t raw_end = 0;
+    size_t pending = state->pipe ? aec_pipeline_pending(strm) : 0;
+    uint32_t mode;
+
+    for (mode = 0; mode < SNAPSHOT_MODES; mode++)
+        if (state->mode == snapshot_modes[mode])
+            break;
+    if (mode == SNAPSHOT_MODES || state->direct_out)
+        return AEC_STREAM_ERROR;
+
+    if (state->mode != m_get_rsi_resumable && state->blocks_dispensed > 0) {
+        pp_begin = (state->blocks_dispensed - 1) * bs;
+        if (state->rsi_streaming)
+            pp_end = state->pp_samples;
+        else
+            pp_end = (state->blocks_dispensed + state->blocks_avail) * bs;
+    }
+    if (state->mode == m_get_rsi_resumable) {
+        raw_end = state->i;
+    } else if (state->rsi_streaming) {
+        raw_begin = state->pp_samples - 1;
+        raw_end = state->i;
+    } else if (state->tail_samples) {
+        raw_begin = state->tail_samples - 1;
+        raw_end = state->tail_samples;
+    }
+
+    snap_put_header(s, strm, SNAPSHOT_ENCODER);
+    snap_put32(s, mode);
+    snap_put32(s, state->i);
+    snap_put32(s, (uint32_t)state->rsi_streaming);
+    snap_put32(s, state->pp_samples);
+    snap_put32(s, (uint32_t)state->blocks_avail);
+    snap_put32(s, (uint32_t)state->blocks_dispensed);
+    snap_put32(s, (uint32_t)state->bits);
+    snap_put32(s, (uint32_t)state->ref);
+    snap_put32(s, state->ref_sample);
+    snap_put32(s, (uint32_t)state->zero_ref);
+    snap_put32(s, state->zero_ref_sample);
+    snap_put32(s, (uint32_t)state->zero_blocks);
+    snap_put32(s, (uint32_t)state->block_nonzero);
+    snap_put32(s, (uint32_t)state->k);
+    snap_put32(s, (uint32_t)state->flush);
+    snap_put32(s, (uint32_t)state->flushed);
+    snap_put32(s, (uint32_t)state->final_bits);
+    snap_put32(s, (uint32_t)state->synced);
+    snap_put32(s, state->tail_byte);
+    snap_put32(s, state->tail_samples);
+    snap_put32(s, (uint32_t)state->tail_ros);
+    snap_put32(s, (uint32_t)state->resumed);
+    snap_put32(s, (uint32_t)state->index_error);
+    snap_put32(s, state->uncomp_len);
+    snap_put64(s, state->rsi_count);
+
+    /* Output not handed out yet and the current byte */
+    snap_put32(s, (uint32_t)(state->cds - state->flush_start));
+    snap_put_bytes(s, state->flush_start,
+                   (size_t)(state->cds - state->flush_start) + 1);
+
+    snap_put32(s, (uint32_t)pp_begin);
+    snap_put32(s, (uint32_t)pp_end);
+    if (pp_end > pp_begin)
+        snap_put_words(s, state->block, pp_end - pp_begin);
+    snap_put32(s, (uint32_t)raw_begin);
+    snap_put32(s, (uint32_t)raw_end);
+    snap_put_words(s, state->data_raw + raw_begin, raw_end - raw_begin);
+
+    snap_put32(s, (uint32_t)pending);
+    for (size_t i = 0; i < pending; i++) {
+        uint32_t ref_sample;
+        uint32_t *pp = aec_pipeline_peek(strm, i, &ref_sample);
+
+        snap_put32(s, ref_sample);
+        snap_put_words(s, pp, (size_t)strm->rsi * bs);
+    }
+    return AEC_OK;
+}
+
+static int restore(struct aec_stream *strm, struct snapshot *s)
+{
+    /**
+       Read a state written by save() into the freshly initialized
+       state of strm. Values which could lead outside of the buffers
+       are rejected.
+    */
+
+    struct internal_state *state = strm->state;
+    size_t bs = strm->block_size;
+    size_t rsi_samples = (size_t)strm->rsi * bs;
+    uint32_t mode;
+    uint32_t n;
+    uint32_t begin;
+    uint32_t end;
+    int status = snap_get_header(s, strm, SNAPSHOT_ENCODER);
+    if (status != AEC_OK)
+        return status;
+
+    mode = snap_get32(s);
+    state->i = snap_get32(s);
+    state->rsi_streaming = (int)snap_get32(s);
+    state->pp_samples = snap_get32(s);
+    state->blocks_avail = (int)snap_get32(s);
+    state->blocks_dispensed = (int)snap_get32(s);
+    state->bits = (int)snap_get32(s);
+    state->ref = (int)snap_get32(s);
+    state->ref_sample = snap_get32(s);
+    state->zero_ref = (int)snap_get32(s);
+    state->zero_ref_sample = snap_get32(s);
+    state->zero_blocks = (int)snap_get32(s);
+    state->block_nonzero = (int)snap_get32(s);
+    state->k = (int)snap_get32(s);
+    state->flush = (int)snap_get32(s);
+    state->flushed = (int)snap_get32(s);
+    state->final_bits = (int)snap_get32(s);
+    state->synced = (int)snap_get32(s);
+    state->tail_byte = (uint8_t)snap_get32(s);
+    state->tail_samples = snap_get32(s);
+    state->tail_ros = (int)snap_get32(s);
+    state->resumed = (int)snap_get32(s);
+    state->index_error = (int)snap_get32(s);
+    /* Derived from ref below instead */
+    snap_get32(s);
+    state->rsi_count = (size_t)snap_get64(s);
+
+    /* kmax is negative and k stays 0 if there are no splitting
+     * options */
+    if (s->error || mode >= SNAPSHOT_MODES
+        || state->i > rsi_samples || state->pp_samples > rsi_samples
+        || (state->rsi_streaming && state->pp_samples > state->i)
+        || state->tail_samples > rsi_samples
+        || (state->rsi_streaming && state->pp_samples == 0)
+        || state->blocks_avail < 0 || state->blocks_dispensed < 0
+        || state->blocks_avail > (int)strm->rsi
+        || state->blocks_dispensed > (int)strm->rsi - state->blocks_avail
+        || state->bits < 0 || state->bits > 8
+        || state->zero_blocks < ROS || state->zero_blocks > 64
+        || state->k < 0 || (state->k > 0 && state->k > state->kmax)
+        || state->flush < AEC_NO_FLUSH || state->flush > AEC_SYNC_FLUSH
+        || (state->ref != 0 && state->ref != 1)
+        || (state->zero_ref != 0 && state->zero_ref != 1))
+        return AEC_DATA_ERROR;
+    state->mode = snapshot_modes[mode];
+    state->uncomp_len = (strm->block_size - state->ref)
+        * strm->bits_per_sample;
+
+    /* Only the flushing states may have less room than m_flush_block
+     * leaves for the next CDS */
+    n = snap_get32(s);
+    if (n >= CDS_BUF_LEN - 8
+        || (state->mode != m_flush_block_resumable
+            && state->mode != m_flush_final
+            && CDS_BUF_LEN - n <= CDSLEN + 8))
+        return AEC_DATA_ERROR;
+    snap_get_bytes(s, state->cds_buf, (size_t)n + 1);
+    state->cds = state->cds_buf + n;
+
+    begin = snap_get32(s);
+    end = snap_get32(s);
+    if (begin > end || end > rsi_samples)
+        return AEC_DATA_ERROR;
+    snap_get_words(s, state->data_pp + begin, end - begin);
+    if (state->blocks_dispensed > 0)
+        state->block = state->data_pp + (state->blocks_dispensed - 1) * bs;
+
+    begin = snap_get32(s);
+    end = snap_get32(s);
+    if (begin > end || end > rsi_samples)
+        return AEC_DATA_ERROR;
+    snap_get_words(s, state->data_raw + begin, end - begin);
+
+    n = snap_get32(s);
+    if (n && state->pipe == NULL)
+        return AEC_DATA_ERROR;
+    for (uint32_t i = 0; i < n && !s->error; i++) {
+        uint32_t *ref_sample;
+        uint32_t *pp = aec_pipeline_push(strm, &ref_sample);
+
+        if (pp == NULL)
+            return AEC_DATA_ERROR;
+        *ref_sample = snap_get32(s);
+        snap_get_words(s, pp, rsi_samples);
+    }
+    return s->error ? AEC_DATA_ERROR : AEC_OK;
+}
+
+size_t aec_encode_state_size(struct aec_stream *strm)
+{
+    struct snapshot s = {NULL, NULL, 0, 0, 0};
+
+    if (save(strm, &s) != AEC_OK)
+        return 0;
+    return s.pos;
+}
+
+int aec_encode_save_state(struct aec_stream *strm, void *buf, size_t *size)
+{
+    struct snapshot s = {buf, NULL, 0, *size, 0};
+    int status = save(strm, &s);
+    if (status != AEC_OK)
+        return status;
+
+    *size = s.pos;
+    if (s.pos > s.size)
+        return AEC_STREAM_ERROR;
+    return AEC_OK;
+}
+
+int aec_encode_restore_state(struct aec_stream *strm,
+                             const void *buf, size_t size)
+{
+    struct snapshot s = {NULL, buf, 0, size, 0};
+    int status = aec_encode_init(strm);
+    if (status != AEC_OK)
+        return status;
+
+    status = restore(strm, &s);
+    if (status != AEC_OK)
+        aec_encode_end(strm);
+    return status;
+}
+
 int aec_encode(struct aec_stream *strm, int flush)
 {
     /**
@@ -904,12 +1640,35 @@ int aec_encode(struct aec_stream *strm, int flush)
     */
     struct internal_state *state = strm->state;
 
+    /* Output can only be aligned to bytes where the decoder expects
+     * it */
+    if (flush == AEC_SYNC_FLUSH && !(strm->flags & AEC_PAD_RSI))
+        return AEC_CONF_ERROR;
+
     state->flush = flush;
     strm->total_in += strm->avail_in;
     strm->total_out += strm->avail_out;
 
+    if (state->pipe && !state->flushed && state->mode != m_flush_final) {
+        size_t skip = 0;
+        if (state->mode == m_get_rsi_resumable || state->rsi_streaming)
+            skip = (strm->rsi * strm->block_size - state->i)
+                / state->unit_samples * state->bytes_per_sample;
+        aec_pipeline_submit(strm, skip);
+    }
+
     while (state->mode(strm) == M_CONTINUE);
 
+    if (state->pipe)
+        aec_pipeline_pause(strm);
+
+    if (flush == AEC_SYNC_FLUSH && state->bits == 0) {
+        /* The current byte is full, hand it out with the rest */
+        *++state->cds = 0;
+        state->bits = 8;
+        state->synced = 1;
+    }
+
     if (state->direct_out) {
         int n = (int)(state->cds - strm->next_out);
         strm->next_out += n;
@@ -917,13 +1676,38 @@ int aec_encode(struct aec_stream *strm, int flush)
 
         *state->cds_buf = *state->cds;
         state->cds = state->cds_buf;
+        state->flush_start = state->cds_buf;
         state->direct_out = 0;
+    } else if (state->flush_start < state->cds) {
+        drain_output(strm);
     }
     strm->total_in -= strm->avail_in;
     strm->total_out -= strm->avail_out;
+
+    if (state->index_error)
+        return AEC_MEM_ERROR;
+    return AEC_OK;
+}
+
+int aec_encode_index(struct aec_stream *strm, struct aec_index *index)
+{
+    struct internal_state *state = strm->state;
+
+    if (state->rsi_count > 0)
+        return AEC_STREAM_ERROR;
+
+    state->index = index;
     return AEC_OK;
 }
 
+void aec_index_free(struct aec_index *index)
+{
+    free(index->offsets);
+    index->offsets = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
 int aec_encode_end(struct aec_stream *strm)
 {
     struct internal_state *state = strm->state;
@@ -947,3 +1731,57 @@ int aec_buffer_encode(struct aec_stream *strm)
     }
     return aec_encode_end(strm);
 }
+
+static int encode_typed(struct aec_stream *strm, const void *src,
+                        size_t count, unsigned int width, int is_signed,
+                        void (*get_samples)(struct aec_stream *,
+                                            uint32_t *, size_t))
+{
+    /**
+       Encode count native integers of width bytes like
+       aec_buffer_encode(). The sample layout comes from the array
+       type instead of strm->flags and samples are read with a kernel
+       for it.
+    */
+    unsigned int flags = strm->flags & ~(AEC_DATA_SIGNED | AEC_DATA_3BYTE
+                                         | AEC_DATA_MSB | AEC_DATA_STRIDED
+                                         | AEC_DATA_PACKED);
+    int status;
+
+    if (strm->bits_per_sample == 0
+        || strm->bits_per_sample > 8 * width
+        || (width > 1 && strm->bits_per_sample <= 4 * width)
+        || count > SIZE_MAX / width)
+        return AEC_CONF_ERROR;
+
+    if (is_signed)
+        flags |= AEC_DATA_SIGNED;
+
+    status = init(strm, flags);
+    if (status == AEC_OK) {
+        strm->state->get_samples = get_samples;
+        strm->next_in = (const unsigned char *)src;
+        strm->avail_in = count * width;
+        status = aec_encode(strm, AEC_FLUSH);
+        if (status == AEC_OK)
+            status = aec_encode_end(strm);
+        else
+            cleanup(strm);
+    }
+    return status;
+}
+
+#define ENCODE_TYPED(NAME, TYPE, BITS, SIGNED)                          \
+    int aec_encode_##NAME(struct aec_stream *strm, const TYPE *src,     \
+                          size_t count)                                 \
+    {                                                                   \
+        return encode_typed(strm, src, count, sizeof(TYPE), SIGNED,     \
+                            aec_get_samples_native_##BITS);             \
+    }
+
+ENCODE_TYPED(u8, uint8_t, 8, 0)
+ENCODE_TYPED(i8, int8_t, 8, 1)
+ENCODE_TYPED(u16, uint16_t, 16, 0)
+ENCODE_TYPED(i16, int16_t, 16, 1)
+ENCODE_TYPED(u32, uint32_t, 32, 0)
+ENCODE_TYPED(i32, int32_t, 32, 1)
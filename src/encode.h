@@ -52,26 +52,41 @@
 #define ENCODE_H 1
 
 #include "config.h"
+#include "alloc.h"
+#include <stddef.h>
 #include <stdint.h>
 
 #define M_CONTINUE 1
 #define M_EXIT 0
 #define MIN(a, b) (((a) < (b))? (a): (b))
 
+/* Alignment of buffers in the workspace */
+#define WORKSPACE_ALIGN 64
+#define ALIGN_UP(n) (((n) + WORKSPACE_ALIGN - 1)        \
+                     & ~(size_t)(WORKSPACE_ALIGN - 1))
+
 /* Maximum CDS length in bytes: 5 bits ID, 64 * 32 bits samples, 7
  * bits carry from previous CDS */
 #define CDSLEN ((5 + 64 * 32 + 7 + 7) / 8)
 
+/* Size of the internal output staging buffer. Must hold several CDS
+ * so that short output buffers can be served in bulk. */
+#define CDS_BUF_LEN (64 * CDSLEN)
+
+/* Number of RSI buffers of a pipelined encoder */
+#define PIPELINE_SLOTS 3
+
 /* Marker for Remainder Of Segment condition in zero block encoding */
 #define ROS -1
 
 struct aec_stream;
+struct aec_pipeline;
 
 struct internal_state {
     int (*mode)(struct aec_stream *);
-    uint32_t (*get_sample)(struct aec_stream *);
-    void (*get_rsi)(struct aec_stream *);
-    void (*preprocess)(struct aec_stream *);
+    void (*get_samples)(struct aec_stream *, uint32_t *, size_t);
+    void (*preprocess)(const struct aec_stream *, uint32_t *, uint32_t *,
+                       size_t, size_t);
 
     /* bit length of code option identification key */
     int id_len;
@@ -84,6 +99,13 @@ struct internal_state {
 
     uint32_t i;
 
+    /* 1 while the blocks of an RSI are encoded before the RSI is
+     * complete (AEC_STREAM_BLOCKS) */
+    int rsi_streaming;
+
+    /* number of samples of the streamed RSI preprocessed so far */
+    uint32_t pp_samples;
+
     /* RSI blocks of preprocessed input */
     uint32_t *data_pp;
 
@@ -105,9 +127,8 @@ struct internal_state {
     /* current Coded Data Set output */
     uint8_t *cds;
 
-    /* buffer for one CDS (only used if strm->next_out cannot hold
-     * full CDS) */
-    uint8_t cds_buf[CDSLEN];
+    /* first byte in cds_buf not yet copied to strm->next_out */
+    uint8_t *flush_start;
 
     /* cds points to strm->next_out (1) or cds_buf (0) */
     int direct_out;
@@ -128,9 +149,18 @@ struct internal_state {
     /* reference sample of zero block */
     uint32_t zero_ref_sample;
 
-    /* storage size of samples in bytes */
+    /* storage size of samples in bytes, with AEC_DATA_STRIDED the
+     * distance between samples, with AEC_DATA_PACKED the size of a
+     * group of unit_samples samples */
     uint32_t bytes_per_sample;
 
+    /* samples in bytes_per_sample bytes of input */
+    uint32_t unit_samples;
+
+    /* strm->flags with the sample layout in effect, which
+     * aec_encode_u8() and friends take from the array type */
+    unsigned int flags;
+
     /* number of contiguous zero blocks */
     int zero_blocks;
 
@@ -150,8 +180,69 @@ struct internal_state {
     /* 1 if flushing was successful */
     int flushed;
 
+    /* number of data bits in the last output byte after flushing */
+    int final_bits;
+
+    /* 1 if AEC_SYNC_FLUSH has handed out a completed byte or the
+     * stream continues one ending on a byte boundary, so that an
+     * empty current byte does not need padding */
+    int synced;
+
+    /* last output byte after flushing */
+    uint8_t tail_byte;
+
+    /* samples in the last RSI if it is incomplete */
+    uint32_t tail_samples;
+
+    /* 1 if an incomplete last RSI ends with a zero run to its end */
+    int tail_ros;
+
+    /* 1 while continuing the incomplete RSI of a previous stream */
+    int resumed;
+
+    /* optional index of RSI positions in the output */
+    struct aec_index *index;
+
+    /* number of RSIs started so far */
+    size_t rsi_count;
+
+    /* 1 if the index could not be extended */
+    int index_error;
+
+    /* producer of preprocessed RSIs if AEC_PIPELINE is set */
+    struct aec_pipeline *pipe;
+
     /* length of uncompressed CDS */
     uint32_t uncomp_len;
+
+    /* memory holding this state and all buffers */
+    void *workspace;
+
+    /* size of workspace in bytes */
+    size_t workspace_size;
+
+    /* 1 if workspace was allocated by the library */
+    int own_workspace;
+
+    /* allocator used for an owned workspace */
+    struct aec_alloc alloc;
+
+    /* staging buffer for CDSs (only used if strm->next_out cannot
+     * hold full CDS). Keep this last, it is not cleared on reset. */
+    uint8_t cds_buf[CDS_BUF_LEN];
 };
 
+size_t aec_pipeline_size(const struct aec_stream *strm);
+struct aec_pipeline *aec_pipeline_setup(struct aec_stream *strm,
+                                        uint8_t *ws);
+void aec_pipeline_submit(struct aec_stream *strm, size_t skip);
+int aec_pipeline_pop(struct aec_stream *strm, uint32_t **block,
+                     uint32_t *ref_sample);
+void aec_pipeline_pause(struct aec_stream *strm);
+size_t aec_pipeline_pending(struct aec_stream *strm);
+uint32_t *aec_pipeline_peek(struct aec_stream *strm, size_t i,
+                            uint32_t *ref_sample);
+uint32_t *aec_pipeline_push(struct aec_stream *strm, uint32_t **ref_sample);
+void aec_pipeline_end(struct aec_pipeline *pipe);
+
 #endif /* ENCODE_H */
@@ -54,193 +54,233 @@
 #include <stdint.h>
 #include <string.h>
 
-uint32_t aec_get_8(struct aec_stream *strm)
+void aec_get_samples_8(struct aec_stream *strm, uint32_t *out, size_t n)
 {
-    strm->avail_in--;
-    return *strm->next_in++;
-}
-
-uint32_t aec_get_lsb_16(struct aec_stream *strm)
-{
-    uint32_t data = ((uint32_t)strm->next_in[1] << 8)
-        | (uint32_t)strm->next_in[0];
-
-    strm->next_in += 2;
-    strm->avail_in -= 2;
-    return data;
-}
-
-uint32_t aec_get_msb_16(struct aec_stream *strm)
-{
-    uint32_t data = ((uint32_t)strm->next_in[0] << 8)
-        | (uint32_t)strm->next_in[1];
-
-    strm->next_in += 2;
-    strm->avail_in -= 2;
-    return data;
-}
-
-uint32_t aec_get_lsb_24(struct aec_stream *strm)
-{
-    uint32_t data = ((uint32_t)strm->next_in[2] << 16)
-        | ((uint32_t)strm->next_in[1] << 8)
-        | (uint32_t)strm->next_in[0];
-
-    strm->next_in += 3;
-    strm->avail_in -= 3;
-    return data;
-}
-
-uint32_t aec_get_msb_24(struct aec_stream *strm)
-{
-    uint32_t data = ((uint32_t)strm->next_in[0] << 16)
-        | ((uint32_t)strm->next_in[1] << 8)
-        | (uint32_t)strm->next_in[2];
-
-    strm->next_in += 3;
-    strm->avail_in -= 3;
-    return data;
-}
-
-uint32_t aec_get_lsb_32(struct aec_stream *strm)
-{
-    uint32_t data = ((uint32_t)strm->next_in[3] << 24)
-        | ((uint32_t)strm->next_in[2] << 16)
-        | ((uint32_t)strm->next_in[1] << 8)
-        | (uint32_t)strm->next_in[0];
-
-    strm->next_in += 4;
-    strm->avail_in -= 4;
-    return data;
-}
-
-uint32_t aec_get_msb_32(struct aec_stream *strm)
-{
-    uint32_t data = ((uint32_t)strm->next_in[0] << 24)
-        | ((uint32_t)strm->next_in[1] << 16)
-        | ((uint32_t)strm->next_in[2] << 8)
-        | (uint32_t)strm->next_in[3];
-
-    strm->next_in += 4;
-    strm->avail_in -= 4;
-    return data;
-}
-
-void aec_get_rsi_8(struct aec_stream *strm)
-{
-    uint32_t *restrict out = strm->state->data_raw;
-    unsigned const char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    const unsigned char *restrict in = strm->next_in;
+    uint32_t *restrict o = out;
 
-    for (int i = 0; i < rsi; i++)
-        out[i] = (uint32_t)in[i];
+    for (size_t i = 0; i < n; i++)
+        o[i] = (uint32_t)in[i];
 
-    strm->next_in += rsi;
-    strm->avail_in -= rsi;
+    strm->next_in += n;
+    strm->avail_in -= n;
 }
 
-void aec_get_rsi_lsb_16(struct aec_stream *strm)
+void aec_get_samples_lsb_16(struct aec_stream *strm, uint32_t *out, size_t n)
 {
-    uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    uint32_t *restrict o = out;
 
-    for (int i = 0; i < rsi; i++)
-        out[i] = (uint32_t)in[2 * i] | ((uint32_t)in[2 * i + 1] << 8);
+    for (size_t i = 0; i < n; i++)
+        o[i] = (uint32_t)in[2 * i] | ((uint32_t)in[2 * i + 1] << 8);
 
-    strm->next_in += 2 * rsi;
-    strm->avail_in -= 2 * rsi;
+    strm->next_in += 2 * n;
+    strm->avail_in -= 2 * n;
 }
 
-void aec_get_rsi_msb_16(struct aec_stream *strm)
+void aec_get_samples_msb_16(struct aec_stream *strm, uint32_t *out, size_t n)
 {
-    uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    uint32_t *restrict o = out;
 
-    for (int i = 0; i < rsi; i++)
-        out[i] = ((uint32_t)in[2 * i] << 8) | (uint32_t)in[2 * i + 1];
+    for (size_t i = 0; i < n; i++)
+        o[i] = ((uint32_t)in[2 * i] << 8) | (uint32_t)in[2 * i + 1];
 
-    strm->next_in += 2 * rsi;
-    strm->avail_in -= 2 * rsi;
+    strm->next_in += 2 * n;
+    strm->avail_in -= 2 * n;
 }
 
-void aec_get_rsi_lsb_24(struct aec_stream *strm)
+void aec_get_samples_lsb_24(struct aec_stream *strm, uint32_t *out, size_t n)
 {
-    uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    uint32_t *restrict o = out;
 
-    for (int i = 0; i < rsi; i++)
-        out[i] = (uint32_t)in[3 * i]
+    for (size_t i = 0; i < n; i++)
+        o[i] = (uint32_t)in[3 * i]
             | ((uint32_t)in[3 * i + 1] << 8)
             | ((uint32_t)in[3 * i + 2] << 16);
 
-    strm->next_in += 3 * rsi;
-    strm->avail_in -= 3 * rsi;
+    strm->next_in += 3 * n;
+    strm->avail_in -= 3 * n;
 }
 
-void aec_get_rsi_msb_24(struct aec_stream *strm)
+void aec_get_samples_msb_24(struct aec_stream *strm, uint32_t *out, size_t n)
 {
-    uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    uint32_t *restrict o = out;
 
-    for (int i = 0; i < rsi; i++)
-        out[i] = ((uint32_t)in[3 * i] << 16)
+    for (size_t i = 0; i < n; i++)
+        o[i] = ((uint32_t)in[3 * i] << 16)
             | ((uint32_t)in[3 * i + 1] << 8)
             | (uint32_t)in[3 * i + 2];
 
-    strm->next_in += 3 * rsi;
-    strm->avail_in -= 3 * rsi;
+    strm->next_in += 3 * n;
+    strm->avail_in -= 3 * n;
 }
 
-#define AEC_GET_RSI_NATIVE_32(BO)                       \
-    void aec_get_rsi_##BO##_32(struct aec_stream *strm) \
-    {                                               \
-        int rsi = strm->rsi * strm->block_size;     \
-        memcpy(strm->state->data_raw,               \
-               strm->next_in, 4 * rsi);             \
-        strm->next_in += 4 * rsi;                   \
-        strm->avail_in -= 4 * rsi;                  \
+#define AEC_GET_SAMPLES_NATIVE_32(BO)                                   \
+    void aec_get_samples_##BO##_32(struct aec_stream *strm,             \
+                                   uint32_t *out, size_t n)             \
+    {                                                                   \
+        memcpy(out, strm->next_in, 4 * n);                              \
+        strm->next_in += 4 * n;                                         \
+        strm->avail_in -= 4 * n;                                        \
     }
 
 #ifdef WORDS_BIGENDIAN
-void aec_get_rsi_lsb_32(struct aec_stream *strm)
+void aec_get_samples_lsb_32(struct aec_stream *strm, uint32_t *out, size_t n)
 {
-    uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
+    uint32_t *restrict o = out;
 
-    for (int i = 0; i < rsi; i++)
-        out[i] = (uint32_t)in[4 * i]
+    for (size_t i = 0; i < n; i++)
+        o[i] = (uint32_t)in[4 * i]
             | ((uint32_t)in[4 * i + 1] << 8)
             | ((uint32_t)in[4 * i + 2] << 16)
             | ((uint32_t)in[4 * i + 3] << 24);
 
-    strm->next_in += 4 * rsi;
-    strm->avail_in -= 4 * rsi;
+    strm->next_in += 4 * n;
+    strm->avail_in -= 4 * n;
 }
 
-AEC_GET_RSI_NATIVE_32(msb);
+AEC_GET_SAMPLES_NATIVE_32(msb)
 
 #else /* !WORDS_BIGENDIAN */
-void aec_get_rsi_msb_32(struct aec_stream *strm)
+void aec_get_samples_msb_32(struct aec_stream *strm, uint32_t *out, size_t n)
 {
-    uint32_t *restrict out = strm->state->data_raw;
     const unsigned char *restrict in = strm->next_in;
-    int rsi = strm->rsi * strm->block_size;
-
-    strm->next_in += 4 * rsi;
-    strm->avail_in -= 4 * rsi;
+    uint32_t *restrict o = out;
 
-    for (int i = 0; i < rsi; i++)
-        out[i] = ((uint32_t)in[4 * i] << 24)
+    for (size_t i = 0; i < n; i++)
+        o[i] = ((uint32_t)in[4 * i] << 24)
             | ((uint32_t)in[4 * i + 1] << 16)
             | ((uint32_t)in[4 * i + 2] << 8)
             | (uint32_t)in[4 * i + 3];
+
+    strm->next_in += 4 * n;
+    strm->avail_in -= 4 * n;
 }
 
-AEC_GET_RSI_NATIVE_32(lsb)
+AEC_GET_SAMPLES_NATIVE_32(lsb)
 
 #endif /* !WORDS_BIGENDIAN */
+
+/* Variants for aligned arrays of native integers. Samples are masked
+ * to bits_per_sample so that sign extended values of signed types are
+ * read like their byte order counterparts. */
+#define AEC_GET_SAMPLES_NATIVE(BITS)                                    \
+    void aec_get_samples_native_##BITS(struct aec_stream *strm,         \
+                                       uint32_t *out, size_t n)         \
+    {                                                                   \
+        const uint##BITS##_t *restrict in =                             \
+            (const uint##BITS##_t *)strm->next_in;                      \
+        uint32_t *restrict o = out;                                     \
+        uint32_t mask = UINT32_MAX >> (32 - strm->bits_per_sample);     \
+                                                                        \
+        for (size_t i = 0; i < n; i++)                                  \
+            o[i] = (uint32_t)in[i] & mask;                              \
+                                                                        \
+        strm->next_in += sizeof(*in) * n;                               \
+        strm->avail_in -= sizeof(*in) * n;                              \
+    }
+
+AEC_GET_SAMPLES_NATIVE(8)
+AEC_GET_SAMPLES_NATIVE(16)
+AEC_GET_SAMPLES_NATIVE(32)
+
+/* Variants for bit packed samples, most significant bit first. n is
+ * always a multiple of the samples in state->bytes_per_sample bytes,
+ * so every call starts on a byte boundary. */
+#define AEC_GET_SAMPLES_PACKED(BITS)                                    \
+    void aec_get_samples_packed_##BITS(struct aec_stream *strm,         \
+                                       uint32_t *out, size_t n)         \
+    {                                                                   \
+        const unsigned char *restrict in = strm->next_in;               \
+        uint32_t *restrict o = out;                                     \
+        const uint32_t mask = (UINT32_C(1) << BITS) - 1;                \
+                                                                        \
+        for (size_t i = 0; i < n / (8 / BITS); i++)                     \
+            for (int k = 0; k < 8 / BITS; k++)                          \
+                o[i * (8 / BITS) + k] =                                 \
+                    ((uint32_t)in[i] >> (8 - BITS - k * BITS)) & mask;  \
+                                                                        \
+        strm->next_in += n * BITS / 8;                                  \
+        strm->avail_in -= n * BITS / 8;                                 \
+    }
+
+AEC_GET_SAMPLES_PACKED(1)
+AEC_GET_SAMPLES_PACKED(2)
+AEC_GET_SAMPLES_PACKED(4)
+
+void aec_get_samples_packed_12(struct aec_stream *strm, uint32_t *out,
+                               size_t n)
+{
+    const unsigned char *restrict in = strm->next_in;
+    uint32_t *restrict o = out;
+
+    for (size_t i = 0; i < n / 2; i++) {
+        o[2 * i] = ((uint32_t)in[3 * i] << 4) | (in[3 * i + 1] >> 4);
+        o[2 * i + 1] = ((uint32_t)(in[3 * i + 1] & 0x0f) << 8)
+            | in[3 * i + 2];
+    }
+
+    strm->next_in += 3 * (n / 2);
+    strm->avail_in -= 3 * (n / 2);
+}
+
+void aec_get_samples_packed(struct aec_stream *strm, uint32_t *out,
+                            size_t n)
+{
+    const unsigned char *restrict in = strm->next_in;
+    uint32_t *restrict o = out;
+    unsigned int bits = strm->bits_per_sample;
+    uint32_t mask = UINT32_MAX >> (32 - bits);
+    uint64_t acc = 0;
+    unsigned int avail = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        while (avail < bits) {
+            acc = (acc << 8) | *in++;
+            avail += 8;
+        }
+        avail -= bits;
+        o[i] = (uint32_t)(acc >> avail) & mask;
+    }
+
+    strm->avail_in -= (size_t)(in - strm->next_in);
+    strm->next_in = in;
+}
+
+/* Variants for samples which are state->bytes_per_sample bytes
+ * apart. READ converts the sample at in. */
+#define AEC_GET_SAMPLES_STRIDED(KIND, READ)                             \
+    void aec_get_samples_strided_##KIND(struct aec_stream *strm,        \
+                                        uint32_t *out, size_t n)        \
+    {                                                                   \
+        const unsigned char *restrict in = strm->next_in;               \
+        size_t stride = strm->state->bytes_per_sample;                  \
+                                                                        \
+        for (size_t i = 0; i < n; i++, in += stride)                    \
+            out[i] = READ;                                              \
+                                                                        \
+        strm->next_in += stride * n;                                    \
+        strm->avail_in -= stride * n;                                   \
+    }
+
+AEC_GET_SAMPLES_STRIDED(8, (uint32_t)in[0])
+AEC_GET_SAMPLES_STRIDED(lsb_16, (uint32_t)in[0] | ((uint32_t)in[1] << 8))
+AEC_GET_SAMPLES_STRIDED(msb_16, ((uint32_t)in[0] << 8) | (uint32_t)in[1])
+AEC_GET_SAMPLES_STRIDED(lsb_24, (uint32_t)in[0]
+                        | ((uint32_t)in[1] << 8)
+                        | ((uint32_t)in[2] << 16))
+AEC_GET_SAMPLES_STRIDED(msb_24, ((uint32_t)in[0] << 16)
+                        | ((uint32_t)in[1] << 8)
+                        | (uint32_t)in[2])
+AEC_GET_SAMPLES_STRIDED(lsb_32, (uint32_t)in[0]
+                        | ((uint32_t)in[1] << 8)
+                        | ((uint32_t)in[2] << 16)
+                        | ((uint32_t)in[3] << 24))
+AEC_GET_SAMPLES_STRIDED(msb_32, ((uint32_t)in[0] << 24)
+                        | ((uint32_t)in[1] << 16)
+                        | ((uint32_t)in[2] << 8)
+                        | (uint32_t)in[3])
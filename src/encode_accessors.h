@@ -52,22 +52,54 @@
 
 #include "config.h"
 #include "libaec.h"
+#include <stddef.h>
 #include <stdint.h>
 
-uint32_t aec_get_8(struct aec_stream *strm);
-uint32_t aec_get_lsb_16(struct aec_stream *strm);
-uint32_t aec_get_msb_16(struct aec_stream *strm);
-uint32_t aec_get_lsb_32(struct aec_stream *strm);
-uint32_t aec_get_msb_24(struct aec_stream *strm);
-uint32_t aec_get_lsb_24(struct aec_stream *strm);
-uint32_t aec_get_msb_32(struct aec_stream *strm);
+/* Convert n samples from strm->next_in to out and advance next_in
+ * and avail_in accordingly. avail_in must hold at least n samples. */
+void aec_get_samples_8(struct aec_stream *strm, uint32_t *out, size_t n);
+void aec_get_samples_lsb_16(struct aec_stream *strm, uint32_t *out, size_t n);
+void aec_get_samples_msb_16(struct aec_stream *strm, uint32_t *out, size_t n);
+void aec_get_samples_lsb_24(struct aec_stream *strm, uint32_t *out, size_t n);
+void aec_get_samples_msb_24(struct aec_stream *strm, uint32_t *out, size_t n);
+void aec_get_samples_lsb_32(struct aec_stream *strm, uint32_t *out, size_t n);
+void aec_get_samples_msb_32(struct aec_stream *strm, uint32_t *out, size_t n);
 
-void aec_get_rsi_8(struct aec_stream *strm);
-void aec_get_rsi_lsb_16(struct aec_stream *strm);
-void aec_get_rsi_msb_16(struct aec_stream *strm);
-void aec_get_rsi_lsb_24(struct aec_stream *strm);
-void aec_get_rsi_msb_24(struct aec_stream *strm);
-void aec_get_rsi_lsb_32(struct aec_stream *strm);
-void aec_get_rsi_msb_32(struct aec_stream *strm);
+/* Same for aligned arrays of native uint8_t, uint16_t, or uint32_t */
+void aec_get_samples_native_8(struct aec_stream *strm, uint32_t *out,
+                              size_t n);
+void aec_get_samples_native_16(struct aec_stream *strm, uint32_t *out,
+                               size_t n);
+void aec_get_samples_native_32(struct aec_stream *strm, uint32_t *out,
+                               size_t n);
+
+/* Same for samples packed into bits_per_sample bits, n has to be a
+ * multiple of the samples in a whole number of bytes */
+void aec_get_samples_packed_1(struct aec_stream *strm, uint32_t *out,
+                              size_t n);
+void aec_get_samples_packed_2(struct aec_stream *strm, uint32_t *out,
+                              size_t n);
+void aec_get_samples_packed_4(struct aec_stream *strm, uint32_t *out,
+                              size_t n);
+void aec_get_samples_packed_12(struct aec_stream *strm, uint32_t *out,
+                               size_t n);
+void aec_get_samples_packed(struct aec_stream *strm, uint32_t *out,
+                            size_t n);
+
+/* Same for samples which are sample_stride bytes apart */
+void aec_get_samples_strided_8(struct aec_stream *strm, uint32_t *out,
+                               size_t n);
+void aec_get_samples_strided_lsb_16(struct aec_stream *strm, uint32_t *out,
+                                    size_t n);
+void aec_get_samples_strided_msb_16(struct aec_stream *strm, uint32_t *out,
+                                    size_t n);
+void aec_get_samples_strided_lsb_24(struct aec_stream *strm, uint32_t *out,
+                                    size_t n);
+void aec_get_samples_strided_msb_24(struct aec_stream *strm, uint32_t *out,
+                                    size_t n);
+void aec_get_samples_strided_lsb_32(struct aec_stream *strm, uint32_t *out,
+                                    size_t n);
+void aec_get_samples_strided_msb_32(struct aec_stream *strm, uint32_t *out,
+                                    size_t n);
 
 #endif /* ENCODE_ACCESSORS_H */
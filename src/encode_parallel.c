@@ -0,0 +1,530 @@
+/**
+ * @file encode_parallel.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Multithreaded encoding of a memory buffer
+ *
+ * Reference sample intervals (RSI) are preprocessed independently
+ * but the splitting position k found for the last block of an RSI is
+ * the starting point of the search in the next RSI. Groups of RSIs
+ * are therefore encoded speculatively with the k of the previous
+ * round. A group which started with the wrong k is re-encoded
+ * serially until k agrees with the speculative run at an RSI
+ * boundary. From there on both runs are identical. Finally, the
+ * bitstreams of all groups are stitched together with shifts.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "encode.h"
+#include "alloc.h"
+#include "threads.h"
+#include <stdint.h>
+#include <string.h>
+
+/* Input bytes per group and round */
+#define GROUP_BYTES ((size_t)4 << 20)
+
+struct segment {
+    /* encoded bits followed by some slack */
+    uint8_t *data;
+    size_t size;
+
+    /* number of RSIs encoded */
+    size_t n;
+
+    /* bit offset and k at the start of each RSI */
+    size_t *bits;
+    int *k;
+};
+
+struct group {
+    struct aec_stream strm;
+    const struct aec_alloc *alloc;
+
+    /* input of the RSIs in this group */
+    const unsigned char *in;
+    size_t len;
+
+    /* number of RSIs */
+    size_t n;
+
+    /* 1 if the group holds the last RSI of the buffer */
+    int final;
+
+    /* k assumed at the start of the group */
+    int k;
+
+    /* speculatively encoded RSIs */
+    struct segment spec;
+
+    /* first fix.n RSIs re-encoded with the correct k */
+    struct segment fix;
+
+    /* start of this group in the output */
+    uint8_t *out;
+    size_t out_bit;
+
+    int running;
+    int status;
+};
+
+static int grow(struct segment *seg, const struct aec_alloc *alloc,
+                size_t size)
+{
+    uint8_t *data;
+
+    if (seg->size >= size)
+        return AEC_OK;
+
+    if (size < 2 * seg->size)
+        size = 2 * seg->size;
+    data = aec_alloc(alloc, size);
+    if (data == NULL)
+        return AEC_MEM_ERROR;
+    if (seg->data) {
+        memcpy(data, seg->data, seg->size);
+        aec_free(alloc, seg->data);
+    }
+    seg->data = data;
+    seg->size = size;
+    return AEC_OK;
+}
+
+static int encode_rsis(struct group *g, struct segment *seg, int k,
+                       const int *stop_k)
+{
+    /**
+       Encode the RSIs of group g starting with k into seg. If stop_k
+       is given, stop as soon as k agrees with stop_k at an RSI
+       boundary.
+    */
+
+    struct aec_stream *strm = &g->strm;
+    struct internal_state *state;
+    size_t rsi_len;
+    size_t bound;
+    size_t i;
+    int status;
+
+    status = aec_encode_reset(strm);
+    if (status != AEC_OK)
+        return status;
+    state = strm->state;
+    state->k = k;
+    rsi_len = state->rsi_len;
+
+    /* Generous output estimate for one RSI */
+    bound = (size_t)strm->rsi
+        * ((size_t)strm->block_size * strm->bits_per_sample + 8) / 8
+        + CDSLEN + 16;
+
+    seg->bits[0] = 0;
+    seg->k[0] = k;
+    for (i = 0; i < g->n; i++) {
+        size_t offset = i * rsi_len;
+        int flush = g->final && i == g->n - 1 ? AEC_FLUSH : AEC_NO_FLUSH;
+
+        strm->next_in = g->in + offset;
+        strm->avail_in = MIN(rsi_len, g->len - offset);
+        for (;;) {
+            status = grow(seg, g->alloc, strm->total_out + bound);
+            if (status != AEC_OK)
+                return status;
+            strm->next_out = seg->data + strm->total_out;
+            strm->avail_out = seg->size - strm->total_out;
+            aec_encode(strm, flush);
+            if (flush == AEC_FLUSH) {
+                if (state->flushed)
+                    break;
+            } else if (strm->avail_in == 0
+                       && state->flush_start == state->cds) {
+                break;
+            }
+        }
+
+        if (flush == AEC_FLUSH)
+            seg->bits[i + 1] = (strm->total_out - 1) * 8 + state->final_bits;
+        else
+            seg->bits[i + 1] = strm->total_out * 8 + 8 - state->bits;
+        seg->k[i + 1] = state->k;
+
+        if (stop_k && state->k == stop_k[i + 1]) {
+            i++;
+            break;
+        }
+    }
+    seg->n = i;
+
+    /* Keep pending bits of the last byte with the data */
+    seg->data[strm->total_out] = g->final && i == g->n ? 0 : *state->cds;
+    return AEC_OK;
+}
+
+static void *encode_group(void *arg)
+{
+    struct group *g = arg;
+
+    g->status = encode_rsis(g, &g->spec, g->k, NULL);
+    return NULL;
+}
+
+static int end_k(const struct group *g)
+{
+    if (g->fix.n == g->n)
+        return g->fix.k[g->n];
+    return g->spec.k[g->n];
+}
+
+static size_t group_bits(const struct group *g)
+{
+    /**
+       The bits of a group are the fix.n re-encoded RSIs followed by
+       the remaining speculatively encoded RSIs.
+    */
+    size_t fix_bits = g->fix.n ? g->fix.bits[g->fix.n] : 0;
+
+    return fix_bits + g->spec.bits[g->n] - g->spec.bits[g->fix.n];
+}
+
+static uint32_t get_bits(const uint8_t *src, size_t pos, int n)
+{
+    const uint8_t *p = src + pos / 8;
+    uint32_t v = ((uint32_t)p[0] << 8) | p[1];
+
+    return (v >> (16 - pos % 8 - n)) & ((1U << n) - 1);
+}
+
+static void put_bits(uint8_t *dst, size_t dst_bit,
+                     const uint8_t *src, size_t src_bit, size_t nbits)
+{
+    /**
+       Copy nbits from src to dst. Bits in front of dst_bit are
+       preserved, bits following the copied ones in the last byte are
+       cleared.
+    */
+
+    uint8_t *d = dst + dst_bit / 8;
+    int used = dst_bit % 8;
+    size_t nbytes;
+
+    if (nbits == 0)
+        return;
+
+    if (used) {
+        int n = (int)MIN(nbits, (size_t)(8 - used));
+        *d = (uint8_t)((*d & (0xff00 >> used))
+                       | (get_bits(src, src_bit, n) << (8 - used - n)));
+        d++;
+        src_bit += n;
+        nbits -= n;
+    }
+
+    nbytes = nbits / 8;
+    if (src_bit % 8 == 0) {
+        memcpy(d, src + src_bit / 8, nbytes);
+    } else {
+        const uint8_t *s = src + src_bit / 8;
+        int shift = src_bit % 8;
+
+        for (size_t i = 0; i < nbytes; i++)
+            d[i] = (uint8_t)((s[i] << shift) | (s[i + 1] >> (8 - shift)));
+    }
+    d += nbytes;
+    src_bit += nbytes * 8;
+    nbits %= 8;
+
+    if (nbits)
+        *d = (uint8_t)(get_bits(src, src_bit, (int)nbits) << (8 - nbits));
+}
+
+static void write_group(struct group *g, size_t from, size_t to)
+{
+    /**
+       Write bits from to to of group g to the output.
+    */
+
+    size_t fix_bits = g->fix.n ? g->fix.bits[g->fix.n] : 0;
+    size_t skip = g->spec.bits[g->fix.n];
+
+    if (from < fix_bits) {
+        size_t n = MIN(to, fix_bits) - from;
+        put_bits(g->out, g->out_bit + from, g->fix.data, from, n);
+        from += n;
+    }
+    if (from < to)
+        put_bits(g->out, g->out_bit + from, g->spec.data,
+                 skip + from - fix_bits, to - from);
+}
+
+static void *stitch_group(void *arg)
+{
+    /**
+       Write all output bytes which only hold bits of this group.
+    */
+
+    struct group *g = arg;
+    size_t end = g->out_bit + group_bits(g);
+    size_t a = (g->out_bit + 7) & ~(size_t)7;
+    size_t b = end & ~(size_t)7;
+
+    if (a < b)
+        write_group(g, a - g->out_bit, b - g->out_bit);
+    return NULL;
+}
+
+static void stitch_seams(struct group *g)
+{
+    /**
+       Write the first and last bits of group g which share output
+       bytes with neighbouring groups.
+    */
+
+    size_t end = g->out_bit + group_bits(g);
+    size_t a = (g->out_bit + 7) & ~(size_t)7;
+    size_t b = end & ~(size_t)7;
+    size_t head = MIN(a, end);
+    size_t tail = b > head ? b : head;
+
+    if (g->out_bit < head)
+        write_group(g, 0, head - g->out_bit);
+    if (tail < end)
+        write_group(g, tail - g->out_bit, end - g->out_bit);
+}
+
+static void run(struct group *group, aec_thread_t *thread, size_t n,
+                aec_thread_fn fn)
+{
+    /**
+       Call fn for all groups, group 0 in the calling thread.
+    */
+
+    for (size_t i = 1; i < n; i++) {
+        group[i].running = aec_thread_create(&thread[i], fn, &group[i]) == 0;
+        if (!group[i].running)
+            fn(&group[i]);
+    }
+    fn(&group[0]);
+    for (size_t i = 1; i < n; i++)
+        if (group[i].running)
+            aec_thread_join(thread[i]);
+}
+
+static void free_segment(struct segment *seg, const struct aec_alloc *alloc)
+{
+    if (seg->data)
+        aec_free(alloc, seg->data);
+    if (seg->bits)
+        aec_free(alloc, seg->bits);
+    if (seg->k)
+        aec_free(alloc, seg->k);
+}
+
+static int alloc_segment(struct segment *seg, const struct aec_alloc *alloc,
+                         size_t n)
+{
+    seg->bits = aec_alloc(alloc, (n + 1) * sizeof(size_t));
+    seg->k = aec_alloc(alloc, (n + 1) * sizeof(int));
+    if (seg->bits == NULL || seg->k == NULL)
+        return AEC_MEM_ERROR;
+    return AEC_OK;
+}
+
+int aec_buffer_encode_parallel(struct aec_stream *strm, unsigned int threads)
+{
+    struct aec_alloc alloc;
+    struct group *group;
+    aec_thread_t *thread;
+    size_t rsi_len;
+    size_t len;
+    size_t n_rsi;
+    size_t group_rsis;
+    size_t done;
+    size_t bit;
+    size_t need;
+    unsigned int initialized = 0;
+    int serial = 0;
+    int k;
+    int status;
+
+    if (threads == 0)
+        threads = aec_cpu_count();
+    if (threads == 1)
+        return aec_buffer_encode(strm);
+    if (aec_encode_workspace_size(strm) == 0)
+        return AEC_CONF_ERROR;
+
+    aec_alloc_init(&alloc, strm);
+    group = aec_alloc(&alloc, threads * sizeof(struct group));
+    thread = aec_alloc(&alloc, threads * sizeof(aec_thread_t));
+    if (group == NULL || thread == NULL) {
+        status = AEC_MEM_ERROR;
+        goto CLEANUP;
+    }
+    memset(group, 0, threads * sizeof(struct group));
+
+    /* Groups are already encoded concurrently */
+    group[0].strm = *strm;
+    group[0].strm.flags &= ~AEC_PIPELINE;
+    status = aec_encode_init(&group[0].strm);
+    if (status != AEC_OK)
+        goto CLEANUP;
+    initialized = 1;
+
+    rsi_len = group[0].strm.state->rsi_len;
+    len = strm->avail_in
+        - strm->avail_in % group[0].strm.state->bytes_per_sample;
+    n_rsi = (len + rsi_len - 1) / rsi_len;
+    if (n_rsi < 2) {
+        serial = 1;
+        goto CLEANUP;
+    }
+
+    if (threads > n_rsi)
+        threads = (unsigned int)n_rsi;
+    group_rsis = MIN(GROUP_BYTES / rsi_len,
+                     (n_rsi + threads - 1) / threads);
+    if (group_rsis == 0)
+        group_rsis = 1;
+
+    for (unsigned int i = 0; i < threads; i++) {
+        struct group *g = &group[i];
+
+        if (i > 0) {
+            g->strm = *strm;
+            g->strm.flags &= ~AEC_PIPELINE;
+            status = aec_encode_init(&g->strm);
+            if (status != AEC_OK)
+                goto CLEANUP;
+            initialized++;
+        }
+        g->alloc = &alloc;
+        g->out = strm->next_out;
+        status = alloc_segment(&g->spec, &alloc, group_rsis);
+        if (status == AEC_OK)
+            status = alloc_segment(&g->fix, &alloc, group_rsis);
+        if (status != AEC_OK)
+            goto CLEANUP;
+    }
+
+    k = 0;
+    bit = 0;
+    done = 0;
+    while (done < n_rsi) {
+        size_t n = 0;
+
+        while (n < threads && done < n_rsi) {
+            struct group *g = &group[n++];
+
+            g->n = MIN(group_rsis, n_rsi - done);
+            g->in = strm->next_in + done * rsi_len;
+            g->len = MIN(g->n * rsi_len, len - done * rsi_len);
+            done += g->n;
+            g->final = done == n_rsi;
+            g->k = k;
+            g->fix.n = 0;
+        }
+
+        run(group, thread, n, encode_group);
+        for (size_t i = 0; i < n; i++) {
+            if (group[i].status != AEC_OK) {
+                status = group[i].status;
+                goto CLEANUP;
+            }
+        }
+
+        /* Only group 0 is guaranteed to have started with the right
+         * k. */
+        for (size_t i = 1; i < n; i++) {
+            struct group *g = &group[i];
+            int true_k = end_k(&group[i - 1]);
+
+            if (true_k != g->spec.k[0]) {
+                status = encode_rsis(g, &g->fix, true_k, g->spec.k);
+                if (status != AEC_OK)
+                    goto CLEANUP;
+            }
+        }
+        k = end_k(&group[n - 1]);
+
+        for (size_t i = 0; i < n; i++) {
+            group[i].out_bit = bit;
+            bit += group_bits(&group[i]);
+        }
+        if ((bit + 7) / 8 > strm->avail_out) {
+            status = AEC_STREAM_ERROR;
+            goto CLEANUP;
+        }
+
+        run(group, thread, n, stitch_group);
+        for (size_t i = 0; i < n; i++)
+            stitch_seams(&group[i]);
+    }
+
+    need = (bit + 7) / 8;
+    strm->next_in += len;
+    strm->avail_in -= len;
+    strm->total_in = len;
+    strm->next_out += need;
+    strm->avail_out -= need;
+    strm->total_out = need;
+    status = AEC_OK;
+
+CLEANUP:
+    if (group) {
+        for (unsigned int i = 0; i < threads; i++) {
+            free_segment(&group[i].spec, &alloc);
+            free_segment(&group[i].fix, &alloc);
+        }
+        for (unsigned int i = 0; i < initialized; i++)
+            aec_encode_end(&group[i].strm);
+        aec_free(&alloc, group);
+    }
+    if (thread)
+        aec_free(&alloc, thread);
+    if (serial)
+        return aec_buffer_encode(strm);
+    return status;
+}
@@ -0,0 +1,423 @@
+/**
+ * @file encode_pipeline.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Pipelined encoding of a single stream
+ *
+ * A producer thread converts and preprocesses complete RSIs from the
+ * input of the current aec_encode() call into a small ring of slots
+ * while the calling thread selects code options and emits the RSI
+ * before. Slots are handed over through two counters, produced and
+ * consumed, each written by only one side. A thread only blocks on
+ * the condition variable if the ring is full or empty, and the other
+ * side only takes the mutex to wake it up if it announced that it
+ * waits.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "encode.h"
+#include "threads.h"
+#include <stdint.h>
+#include <string.h>
+
+struct slot {
+    uint32_t *raw;
+    uint32_t *pp;
+    uint32_t ref_sample;
+};
+
+struct aec_pipeline {
+    /* copy of the stream parameters for the producer */
+    struct aec_stream strm;
+    size_t rsi_len;
+
+    aec_thread_t thread;
+    aec_mutex_t mutex;
+    aec_cond_t cond;
+
+    /* 1 if thread, mutex and condition variable exist */
+    int started;
+
+    /* 1 if the thread could not be started */
+    int failed;
+
+    /* producer has a job, should exit (mutex) */
+    int busy;
+    int quit;
+
+    /* producer should pause (set with mutex) */
+    volatile size_t stop;
+
+    /* RSIs filled by the producer and released by the consumer */
+    volatile size_t produced;
+    volatile size_t consumed;
+
+    /* threads waiting for the other side to move a counter */
+    volatile size_t waiting;
+
+    /* RSIs handed to the producer so far */
+    size_t reserved;
+
+    /* RSIs taken by the consumer. The last one taken is in use
+     * until the next one is taken. */
+    size_t taken;
+
+    /* RSIs whose input has been removed from strm->next_in */
+    size_t accounted;
+
+    /* input of RSI job_first and bytes available from there */
+    const unsigned char *job_in;
+    size_t job_first;
+    size_t job_avail;
+
+    struct slot slot[PIPELINE_SLOTS];
+};
+
+static size_t load(volatile size_t *p)
+{
+    return aec_atomic_add(p, 0);
+}
+
+static void notify(struct aec_pipeline *pipe)
+{
+    /**
+       Wake up the other side after moving a counter. A waiter counts
+       itself in waiting before it checks the counters, so either it
+       sees the new count or we see it waiting.
+    */
+
+    if (load(&pipe->waiting)) {
+        aec_mutex_lock(&pipe->mutex);
+        aec_cond_broadcast(&pipe->cond);
+        aec_mutex_unlock(&pipe->mutex);
+    }
+}
+
+static int fill(struct aec_pipeline *pipe)
+{
+    /**
+       Convert and preprocess the next RSI of the job into a free
+       slot. Returns 0 if the producer has been asked to pause.
+    */
+
+    struct aec_stream *strm = &pipe->strm;
+    struct internal_state *state = strm->state;
+    size_t n = load(&pipe->produced);
+    struct slot *slot = &pipe->slot[n % PIPELINE_SLOTS];
+
+    if (n - load(&pipe->consumed) >= PIPELINE_SLOTS || load(&pipe->stop)) {
+        aec_mutex_lock(&pipe->mutex);
+        aec_atomic_add(&pipe->waiting, 1);
+        while (n - load(&pipe->consumed) >= PIPELINE_SLOTS
+               && !load(&pipe->stop))
+            aec_cond_wait(&pipe->cond, &pipe->mutex);
+        aec_atomic_sub(&pipe->waiting, 1);
+        aec_mutex_unlock(&pipe->mutex);
+        if (load(&pipe->stop))
+            return 0;
+    }
+
+    strm->next_in = pipe->job_in + (n - pipe->job_first) * pipe->rsi_len;
+    strm->avail_in = pipe->rsi_len;
+    state->get_samples(strm, slot->raw, strm->rsi * strm->block_size);
+    if (strm->flags & AEC_DATA_PREPROCESS) {
+        slot->ref_sample = slot->raw[0];
+        state->preprocess(strm, slot->raw, slot->pp, 0,
+                          (size_t)strm->rsi * strm->block_size);
+    }
+
+    aec_atomic_add(&pipe->produced, 1);
+    notify(pipe);
+    return 1;
+}
+
+static void *producer(void *arg)
+{
+    struct aec_pipeline *pipe = arg;
+
+    aec_mutex_lock(&pipe->mutex);
+    for (;;) {
+        while (!pipe->busy && !pipe->quit)
+            aec_cond_wait(&pipe->cond, &pipe->mutex);
+        if (pipe->quit)
+            break;
+        aec_mutex_unlock(&pipe->mutex);
+
+        while (load(&pipe->produced) < pipe->reserved && fill(pipe));
+
+        aec_mutex_lock(&pipe->mutex);
+        pipe->busy = 0;
+        aec_cond_broadcast(&pipe->cond);
+    }
+    aec_mutex_unlock(&pipe->mutex);
+    return NULL;
+}
+
+static int start(struct aec_pipeline *pipe)
+{
+    if (pipe->started)
+        return 1;
+    if (pipe->failed)
+        return 0;
+
+    if (aec_mutex_init(&pipe->mutex) == 0) {
+        if (aec_cond_init(&pipe->cond) == 0) {
+            if (aec_thread_create(&pipe->thread, producer, pipe) == 0) {
+                pipe->started = 1;
+                return 1;
+            }
+            aec_cond_destroy(&pipe->cond);
+        }
+        aec_mutex_destroy(&pipe->mutex);
+    }
+    pipe->failed = 1;
+    return 0;
+}
+
+size_t aec_pipeline_size(const struct aec_stream *strm)
+{
+    size_t buf = ALIGN_UP((size_t)strm->rsi * strm->block_size
+                          * sizeof(uint32_t));
+
+    if (strm->flags & AEC_DATA_PREPROCESS)
+        buf *= 2;
+    return ALIGN_UP(sizeof(struct aec_pipeline)) + PIPELINE_SLOTS * buf;
+}
+
+struct aec_pipeline *aec_pipeline_setup(struct aec_stream *strm,
+                                        uint8_t *ws)
+{
+    /**
+       Place the pipeline and its slots at ws.
+    */
+
+    struct aec_pipeline *pipe = (struct aec_pipeline *)ws;
+    size_t buf = ALIGN_UP((size_t)strm->rsi * strm->block_size
+                          * sizeof(uint32_t));
+
+    memset(pipe, 0, sizeof(*pipe));
+    pipe->rsi_len = strm->state->rsi_len;
+    ws += ALIGN_UP(sizeof(struct aec_pipeline));
+    for (int i = 0; i < PIPELINE_SLOTS; i++) {
+        pipe->slot[i].raw = (uint32_t *)ws;
+        ws += buf;
+        if (strm->flags & AEC_DATA_PREPROCESS) {
+            pipe->slot[i].pp = (uint32_t *)ws;
+            ws += buf;
+        } else {
+            pipe->slot[i].pp = pipe->slot[i].raw;
+        }
+    }
+    return pipe;
+}
+
+void aec_pipeline_submit(struct aec_stream *strm, size_t skip)
+{
+    /**
+       Hand all complete RSIs of the input to the producer. The first
+       skip bytes are needed to complete an RSI which the encoder has
+       started to collect.
+    */
+
+    struct aec_pipeline *pipe = strm->state->pipe;
+    size_t n;
+
+    if (strm->avail_in < skip)
+        return;
+    n = (strm->avail_in - skip) / pipe->rsi_len;
+    if (n == 0 || !start(pipe))
+        return;
+
+    pipe->strm = *strm;
+    pipe->job_in = strm->next_in + skip;
+    pipe->job_first = pipe->reserved;
+    pipe->job_avail = strm->avail_in - skip;
+    pipe->reserved += n;
+
+    aec_mutex_lock(&pipe->mutex);
+    pipe->busy = 1;
+    aec_cond_broadcast(&pipe->cond);
+    aec_mutex_unlock(&pipe->mutex);
+}
+
+static void release(struct aec_pipeline *pipe)
+{
+    if (pipe->taken > load(&pipe->consumed)) {
+        aec_atomic_add(&pipe->consumed, 1);
+        notify(pipe);
+    }
+}
+
+int aec_pipeline_pop(struct aec_stream *strm, uint32_t **block,
+                     uint32_t *ref_sample)
+{
+    /**
+       Take the next RSI from the ring. Returns 0 if all RSIs handed
+       to the producer have been taken and the encoder has to read
+       the next RSI itself.
+    */
+
+    struct aec_pipeline *pipe = strm->state->pipe;
+    struct slot *slot;
+
+    release(pipe);
+    if (pipe->taken == pipe->reserved)
+        return 0;
+
+    if (load(&pipe->produced) == pipe->taken) {
+        aec_mutex_lock(&pipe->mutex);
+        aec_atomic_add(&pipe->waiting, 1);
+        while (load(&pipe->produced) == pipe->taken)
+            aec_cond_wait(&pipe->cond, &pipe->mutex);
+        aec_atomic_sub(&pipe->waiting, 1);
+        aec_mutex_unlock(&pipe->mutex);
+    }
+
+    slot = &pipe->slot[pipe->taken % PIPELINE_SLOTS];
+    pipe->taken++;
+    if (pipe->taken > pipe->accounted) {
+        size_t used = (pipe->taken - pipe->job_first) * pipe->rsi_len;
+        strm->next_in = pipe->job_in + used;
+        strm->avail_in = pipe->job_avail - used;
+        pipe->accounted = pipe->taken;
+    }
+    *block = slot->pp;
+    *ref_sample = slot->ref_sample;
+    return 1;
+}
+
+void aec_pipeline_pause(struct aec_stream *strm)
+{
+    /**
+       Stop the producer before aec_encode() returns. RSIs which have
+       been converted already count as consumed input, the others are
+       left in next_in.
+    */
+
+    struct aec_pipeline *pipe = strm->state->pipe;
+
+    if (!pipe->started)
+        return;
+
+    aec_mutex_lock(&pipe->mutex);
+    aec_atomic_add(&pipe->stop, 1);
+    aec_cond_broadcast(&pipe->cond);
+    while (pipe->busy)
+        aec_cond_wait(&pipe->cond, &pipe->mutex);
+    aec_atomic_sub(&pipe->stop, 1);
+    aec_mutex_unlock(&pipe->mutex);
+
+    pipe->reserved = load(&pipe->produced);
+    if (pipe->reserved > pipe->accounted) {
+        size_t used = (pipe->reserved - pipe->job_first) * pipe->rsi_len;
+        strm->next_in = pipe->job_in + used;
+        strm->avail_in = pipe->job_avail - used;
+        pipe->accounted = pipe->reserved;
+    }
+}
+
+size_t aec_pipeline_pending(struct aec_stream *strm)
+{
+    /**
+       Number of RSIs converted from consumed input but not taken yet.
+       Only valid between calls of aec_encode().
+    */
+
+    struct aec_pipeline *pipe = strm->state->pipe;
+
+    return load(&pipe->produced) - pipe->taken;
+}
+
+uint32_t *aec_pipeline_peek(struct aec_stream *strm, size_t i,
+                            uint32_t *ref_sample)
+{
+    /**
+       Preprocessed samples of the i-th pending RSI.
+    */
+
+    struct aec_pipeline *pipe = strm->state->pipe;
+    struct slot *slot = &pipe->slot[(pipe->taken + i) % PIPELINE_SLOTS];
+
+    *ref_sample = slot->ref_sample;
+    return slot->pp;
+}
+
+uint32_t *aec_pipeline_push(struct aec_stream *strm, uint32_t **ref_sample)
+{
+    /**
+       Reserve the next slot of a new pipeline for an RSI restored from
+       a snapshot. It is taken like an RSI converted by the producer.
+       Returns NULL if all slots are in use or the producer cannot be
+       started.
+    */
+
+    struct aec_pipeline *pipe = strm->state->pipe;
+    struct slot *slot = &pipe->slot[pipe->produced % PIPELINE_SLOTS];
+
+    if (pipe->produced - pipe->taken >= PIPELINE_SLOTS || !start(pipe))
+        return NULL;
+
+    aec_atomic_add(&pipe->produced, 1);
+    pipe->reserved = pipe->produced;
+    pipe->accounted = pipe->produced;
+    *ref_sample = &slot->ref_sample;
+    return slot->pp;
+}
+
+void aec_pipeline_end(struct aec_pipeline *pipe)
+{
+    if (!pipe->started)
+        return;
+
+    aec_mutex_lock(&pipe->mutex);
+    pipe->quit = 1;
+    aec_cond_broadcast(&pipe->cond);
+    aec_mutex_unlock(&pipe->mutex);
+    aec_thread_join(pipe->thread);
+    aec_cond_destroy(&pipe->cond);
+    aec_mutex_destroy(&pipe->mutex);
+    pipe->started = 0;
+}
@@ -51,6 +51,7 @@
 #define LIBAEC_H 1
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "libaec_Export.h"
 
@@ -90,6 +91,17 @@ struct aec_stream {
     unsigned int flags;
 
     struct internal_state *state;
+
+    /* Memory allocation functions and their first argument. Only
+     * used if AEC_CUSTOM_ALLOC is set in flags, otherwise these
+     * fields are ignored and may be left uninitialized. */
+    void *(*alloc_func)(void *opaque, size_t size);
+    void (*free_func)(void *opaque, void *ptr);
+    void *opaque;
+
+    /* Distance in bytes from one sample to the next at next_in or
+     * next_out. Only used if AEC_DATA_STRIDED is set in flags. */
+    unsigned int sample_stride;
 };
 
 /*********************************/
@@ -119,6 +131,47 @@ struct aec_stream {
 /* Do not enforce standard regarding legal block sizes. */
 #define AEC_NOT_ENFORCE 64
 
+/* Allocate internal memory with alloc_func and free_func of
+ * aec_stream instead of malloc and free. This covers the workspace
+ * of the stream and temporary memory of functions which take
+ * streams, where batches use the allocator of their first stream.
+ * Objects which outlive a stream or are not created from one, like
+ * pools, asynchronous job queues, and the offsets of an aec_index,
+ * always use malloc and free. */
+#define AEC_CUSTOM_ALLOC 128
+
+/* Back large internal buffers by transparent huge pages where the
+ * system supports it. Ignored together with AEC_CUSTOM_ALLOC. */
+#define AEC_HUGE_PAGES 256
+
+/* Work on two threads. The encoder converts and preprocesses the
+ * next RSIs while the current one is encoded, the decoder
+ * postprocesses and writes complete RSIs while the next one is
+ * decoded. Output is identical. */
+#define AEC_PIPELINE 512
+
+/* Encode every block as soon as its samples have arrived instead of
+ * waiting for a complete RSI. Only affects encoding, output is
+ * identical. */
+#define AEC_STREAM_BLOCKS 1024
+
+/* Samples are sample_stride bytes apart, e.g. one component of
+ * interleaved data. The bytes in between are neither read nor
+ * written. avail_in and avail_out count sample_stride bytes per
+ * sample, also for the last one. */
+#define AEC_DATA_STRIDED 2048
+
+/* Samples are packed without gaps, bits_per_sample bits each with the
+ * most significant bit first, e.g. 8 samples of 1 bit per byte or 2
+ * samples of 12 bit in 3 bytes. The encoder consumes input in groups
+ * of samples which end on a byte boundary, block_size has to be a
+ * multiple of the samples in a group. The decoder fills avail_out
+ * completely and keeps the bits which did not fit until the next
+ * call, aec_decode_save_state() fails while it keeps bits. The
+ * decoder ignores AEC_PIPELINE, both ignore AEC_DATA_3BYTE and
+ * AEC_DATA_MSB. */
+#define AEC_DATA_PACKED 4096
+
 /*************************************/
 /* Return codes of library functions */
 /*************************************/
@@ -127,6 +180,9 @@ struct aec_stream {
 #define AEC_STREAM_ERROR (-2)
 #define AEC_DATA_ERROR (-3)
 #define AEC_MEM_ERROR (-4)
+/* Passed to the completion callback of a job stopped by
+ * aec_cancel() */
+#define AEC_CANCELLED (-5)
 
 /************************/
 /* Options for flushing */
@@ -141,9 +197,18 @@ struct aec_stream {
  *
  * It is not possible to continue encoding of the same stream after it
  * has been flushed because the last byte may be padded with fill
- * bits. */
+ * bits. A new stream can append to it with aec_encode_init_append(). */
 #define AEC_FLUSH 1
 
+/* Encode all complete RSIs of the input and write them out, but keep
+ * the samples of an incomplete RSI for later calls. Encoding
+ * continues normally afterwards. Only allowed with AEC_PAD_RSI, where
+ * every RSI ends on a byte boundary, otherwise AEC_CONF_ERROR is
+ * returned. If avail_out is not 0 after the call, next_out holds
+ * all encoded RSIs and the stream can be decoded up to there. A
+ * stream ending at an RSI boundary is complete without AEC_FLUSH. */
+#define AEC_SYNC_FLUSH 2
+
 /*********************************************/
 /* Streaming encoding and decoding functions */
 /*********************************************/
@@ -161,6 +226,387 @@ libaec_EXPORT int aec_decode_end(struct aec_stream *strm);
 libaec_EXPORT int aec_buffer_encode(struct aec_stream *strm);
 libaec_EXPORT int aec_buffer_decode(struct aec_stream *strm);
 
+/* Encode a memory buffer like aec_buffer_encode() with up to threads
+ * threads (0 for one per processor). Groups of RSIs are encoded
+ * concurrently and their bitstreams joined. The output is identical
+ * to that of aec_buffer_encode(). Returns AEC_STREAM_ERROR if the
+ * output does not fit into avail_out. */
+libaec_EXPORT int aec_buffer_encode_parallel(struct aec_stream *strm,
+                                             unsigned int threads);
+
+/* Decode a memory buffer like aec_buffer_decode() with up to threads
+ * threads (0 for one per processor). The stream is split at RSI
+ * boundaries found by a quick scan before decoding. Streams which
+ * cannot be split are decoded serially. Errors while decoding the
+ * slices are returned as they are. */
+libaec_EXPORT int aec_buffer_decode_parallel(struct aec_stream *strm,
+                                             unsigned int threads);
+
+/* Encode or decode n independent buffers like aec_buffer_encode() or
+ * aec_buffer_decode() with up to threads threads (0 for one per
+ * processor). Each element of strm describes one buffer with its own
+ * parameters. next_in, avail_in, next_out, avail_out, total_in, and
+ * total_out of every element are updated as by the single buffer
+ * functions and status[i] receives the result for strm[i] unless
+ * status is NULL. Returns AEC_OK if all buffers were coded, otherwise
+ * the result for the first buffer that failed. */
+libaec_EXPORT int aec_buffer_encode_batch(struct aec_stream *strm, size_t n,
+                                          int *status,
+                                          unsigned int threads);
+libaec_EXPORT int aec_buffer_decode_batch(struct aec_stream *strm, size_t n,
+                                          int *status,
+                                          unsigned int threads);
+
+/* Encode count samples from an aligned array of native integers like
+ * aec_buffer_encode(). The output goes to next_out and avail_out,
+ * next_in and avail_in are overwritten. bits_per_sample must map to
+ * the size of the element type: 1 to 8 bits for 8 bit types, 9 to 16
+ * for 16 bit types and 17 to 32 for 32 bit types, otherwise
+ * AEC_CONF_ERROR is returned. The signedness comes from the type, so
+ * AEC_DATA_SIGNED, AEC_DATA_MSB, AEC_DATA_3BYTE, AEC_DATA_STRIDED, and
+ * AEC_DATA_PACKED in flags are ignored. Samples of signed types may be
+ * sign extended. */
+libaec_EXPORT int aec_encode_u8(struct aec_stream *strm,
+                                const uint8_t *src, size_t count);
+libaec_EXPORT int aec_encode_i8(struct aec_stream *strm,
+                                const int8_t *src, size_t count);
+libaec_EXPORT int aec_encode_u16(struct aec_stream *strm,
+                                 const uint16_t *src, size_t count);
+libaec_EXPORT int aec_encode_i16(struct aec_stream *strm,
+                                 const int16_t *src, size_t count);
+libaec_EXPORT int aec_encode_u32(struct aec_stream *strm,
+                                 const uint32_t *src, size_t count);
+libaec_EXPORT int aec_encode_i32(struct aec_stream *strm,
+                                 const int32_t *src, size_t count);
+
+/* Decode next_in and avail_in into count native integers like
+ * aec_buffer_decode() with the same rules for bits_per_sample and
+ * flags. next_out and avail_out are overwritten. Samples of signed
+ * types are sign extended. */
+libaec_EXPORT int aec_decode_u8(struct aec_stream *strm,
+                                uint8_t *dst, size_t count);
+libaec_EXPORT int aec_decode_i8(struct aec_stream *strm,
+                                int8_t *dst, size_t count);
+libaec_EXPORT int aec_decode_u16(struct aec_stream *strm,
+                                 uint16_t *dst, size_t count);
+libaec_EXPORT int aec_decode_i16(struct aec_stream *strm,
+                                 int16_t *dst, size_t count);
+libaec_EXPORT int aec_decode_u32(struct aec_stream *strm,
+                                 uint32_t *dst, size_t count);
+libaec_EXPORT int aec_decode_i32(struct aec_stream *strm,
+                                 int32_t *dst, size_t count);
+
+/* Decode n streams like calling aec_decode(&strm[i], flush) for each
+ * of them, e.g. many channels of telemetry which each bring a few
+ * bytes at a time. All streams must have been initialized with the
+ * same bits_per_sample, block_size, rsi, and flags, otherwise
+ * AEC_CONF_ERROR is returned before any input is consumed. Returns
+ * AEC_OK or the first error. */
+libaec_EXPORT int aec_decode_multi(struct aec_stream *strm, size_t n,
+                                   int flush);
+
+/************************************************/
+/* Joining independently encoded segments       */
+/************************************************/
+
+/* Join n segments of encoded data, segment[i] of length[i] bytes,
+ * into one stream at next_out without re-encoding. All segments must
+ * have been encoded with the parameters set in strm and all but the
+ * last one must hold a multiple of rsi * block_size samples. These
+ * are scanned to find the end of their last RSI, and AEC_DATA_ERROR
+ * is returned if anything but zero padding follows it. With
+ * AEC_PAD_RSI the last RSI has to end with the segment, which is then
+ * copied as it is. The joined stream is never longer than the sum of
+ * all lengths. Returns AEC_STREAM_ERROR if it does not fit into
+ * avail_out. */
+libaec_EXPORT int aec_concat(struct aec_stream *strm,
+                             const unsigned char *const *segment,
+                             const size_t *length, size_t n);
+
+/************************************************/
+/* Appending to a finished stream               */
+/************************************************/
+
+/* End of a finished stream from which encoding can be resumed */
+struct aec_tail {
+    /* last byte of the stream */
+    unsigned char byte;
+
+    /* number of bits in byte which belong to the stream, counted from
+     * the most significant bit. 0 if the stream ends on a byte
+     * boundary. */
+    unsigned int bits;
+
+    /* number of blocks in the last RSI if it is incomplete, 0
+     * otherwise */
+    unsigned int rsi_blocks;
+
+    /* last sample of the stream, only needed if rsi_blocks is not 0 */
+    uint32_t last_sample;
+};
+
+/* Get the tail of strm after aec_encode() was called with AEC_FLUSH
+ * and has drained all output. Returns AEC_STREAM_ERROR if strm is
+ * not flushed yet and AEC_DATA_ERROR if the stream cannot be
+ * continued, i.e. its last RSI is incomplete and either ends with a
+ * partial block or a zero run to the end of the RSI, or is padded
+ * with AEC_PAD_RSI. */
+libaec_EXPORT int aec_encode_tail(struct aec_stream *strm,
+                                  struct aec_tail *tail);
+
+/* Initialize like aec_encode_init() but continue the finished stream
+ * described by tail, which was encoded with the same parameters. If
+ * tail->bits is not 0, the first output byte replaces the last byte
+ * of the existing stream, so next_out has to point to that byte.
+ * With AEC_PAD_RSI the stream has to end with a complete RSI on a
+ * byte boundary. The tail can also be set up by hand from the bit
+ * length of a stream of complete RSIs. Returns AEC_CONF_ERROR if
+ * tail does not fit the parameters. */
+libaec_EXPORT int aec_encode_init_append(struct aec_stream *strm,
+                                         const struct aec_tail *tail);
+
+/************************************************/
+/* Asynchronous encoding and decoding           */
+/************************************************/
+
+/* Jobs are coded by a set of library owned threads. */
+struct aec_async;
+
+/* Called from a worker thread when a job completes with the status
+ * aec_buffer_encode() or aec_buffer_decode() would have returned, or
+ * AEC_CANCELLED. total_in and total_out of strm hold the byte
+ * counts. From then on strm belongs to the caller again. */
+typedef void (*aec_done_fn)(struct aec_stream *strm, int status, void *arg);
+
+/* Start threads workers, one per processor if threads is 0. At most
+ * queue_length jobs wait for a worker, 0 selects twice the number of
+ * workers. Returns NULL on failure. */
+libaec_EXPORT struct aec_async *aec_async_create(unsigned int threads,
+                                                 size_t queue_length);
+
+/* Cancel all waiting jobs, complete the running ones, and stop the
+ * workers. */
+libaec_EXPORT void aec_async_destroy(struct aec_async *async);
+
+/* Queue a job which codes strm like aec_buffer_encode() or
+ * aec_buffer_decode() and then calls done(strm, status, arg). Blocks
+ * while the queue is full. strm must not be touched until done is
+ * called. Callbacks must not submit jobs themselves. */
+libaec_EXPORT int aec_submit_encode(struct aec_async *async,
+                                    struct aec_stream *strm,
+                                    aec_done_fn done, void *arg);
+libaec_EXPORT int aec_submit_decode(struct aec_async *async,
+                                    struct aec_stream *strm,
+                                    aec_done_fn done, void *arg);
+
+/* Cancel the job of strm. A waiting job is completed with
+ * AEC_CANCELLED before aec_cancel() returns. A running job stops
+ * after its current chunk of input, or completes normally if it was
+ * about to finish. Returns AEC_STREAM_ERROR if strm has no waiting
+ * or running job. */
+libaec_EXPORT int aec_cancel(struct aec_async *async,
+                             struct aec_stream *strm);
+
+/* Wait until all submitted jobs are completed. */
+libaec_EXPORT void aec_async_wait(struct aec_async *async);
+
+/************************************************/
+/* Random access through an index of RSIs       */
+/************************************************/
+
+/* Positions of RSIs in an encoded stream. Clear all fields and set
+ * interval before handing the index to aec_encode_index(). */
+struct aec_index {
+    /* Record every interval-th RSI. 0 is treated as 1. */
+    size_t interval;
+
+    /* number of recorded RSIs */
+    size_t count;
+
+    /* number of entries allocated in offsets */
+    size_t capacity;
+
+    /* offsets[i] is the bit offset of RSI i * interval in the encoded
+     * stream */
+    uint64_t *offsets;
+
+    /* total number of samples encoded */
+    uint64_t samples;
+};
+
+/* Record RSI positions in index while encoding strm. Has to be called
+ * after aec_encode_init() or aec_encode_reset() and before any input
+ * has been encoded. The index is extended with realloc(). */
+libaec_EXPORT int aec_encode_index(struct aec_stream *strm,
+                                   struct aec_index *index);
+
+/* Free memory allocated for the offsets in index. */
+libaec_EXPORT void aec_index_free(struct aec_index *index);
+
+/* Decode count samples starting at sample offset from the encoded
+ * stream at next_in with the help of index. Only the RSIs from the
+ * closest indexed one up to the end of the range are decoded. Like
+ * aec_buffer_decode(), the stream is initialized and ended
+ * internally. AEC_DATA_PACKED is not supported. */
+libaec_EXPORT int aec_decode_range(struct aec_stream *strm,
+                                   const struct aec_index *index,
+                                   size_t offset, size_t count);
+
+/************************************************/
+/* Checkpointing streams                        */
+/************************************************/
+
+/* Snapshots hold the state of a stream between two calls of
+ * aec_encode() or aec_decode() in a compact form without pointers,
+ * so that a stream can be continued in another process or on another
+ * host. A restored stream continues with the input following the
+ * first total_in bytes and its output follows the first total_out
+ * bytes, which the caller has to keep. An index attached with
+ * aec_encode_index() is not part of the snapshot. */
+
+/* Size of a snapshot of strm in bytes, 0 on error. */
+libaec_EXPORT size_t aec_encode_state_size(struct aec_stream *strm);
+libaec_EXPORT size_t aec_decode_state_size(struct aec_stream *strm);
+
+/* Write a snapshot of strm to buf. On input *size is the size of buf,
+ * on return the size of the snapshot. Returns AEC_STREAM_ERROR if buf
+ * is too small. */
+libaec_EXPORT int aec_encode_save_state(struct aec_stream *strm,
+                                        void *buf, size_t *size);
+libaec_EXPORT int aec_decode_save_state(struct aec_stream *strm,
+                                        void *buf, size_t *size);
+
+/* Initialize strm like aec_encode_init() or aec_decode_init() and
+ * continue from the snapshot of size bytes at buf. bits_per_sample,
+ * block_size, rsi, and flags must be set as when the snapshot was
+ * taken, except for AEC_CUSTOM_ALLOC and AEC_HUGE_PAGES, otherwise
+ * AEC_CONF_ERROR is returned. total_in and total_out are restored.
+ * Returns AEC_DATA_ERROR for a damaged snapshot. */
+libaec_EXPORT int aec_encode_restore_state(struct aec_stream *strm,
+                                           const void *buf, size_t size);
+libaec_EXPORT int aec_decode_restore_state(struct aec_stream *strm,
+                                           const void *buf, size_t size);
+
+/************************************************/
+/* Callback driven encoding and decoding        */
+/************************************************/
+
+/* Set *data to the next span of input and return its length in
+ * bytes, or 0 at the end of input. The span has to stay valid until
+ * the source is called again. Samples may be split between spans. */
+typedef size_t (*aec_source_func)(void *opaque, const unsigned char **data);
+
+/* Receive len bytes of output at data, len is 0 on the first call.
+ * The sink may set *next and *avail to a buffer for the following
+ * output, of which the decoder only uses whole samples. Otherwise
+ * output is staged in a buffer of the library which is only valid
+ * during the call. Return nonzero to stop. */
+typedef int (*aec_sink_func)(void *opaque, const unsigned char *data,
+                             size_t len, unsigned char **next,
+                             size_t *avail);
+
+/* Encode or decode all input of source into sink with the stream
+ * strm initialized by aec_encode_init() or aec_decode_init(). The
+ * encoder ends with AEC_FLUSH. next_in, avail_in, next_out, and
+ * avail_out are managed by the library, total_in and total_out are
+ * updated. Returns AEC_CANCELLED if the sink stopped, and
+ * AEC_CONF_ERROR for streams with AEC_DATA_STRIDED or AEC_DATA_PACKED.
+ * The stream still has to be ended by the caller. */
+libaec_EXPORT int aec_encode_callback(struct aec_stream *strm,
+                                      aec_source_func source,
+                                      aec_sink_func sink, void *opaque);
+libaec_EXPORT int aec_decode_callback(struct aec_stream *strm,
+                                      aec_source_func source,
+                                      aec_sink_func sink, void *opaque);
+
+/************************************************/
+/* Scatter-gather encoding and decoding         */
+/************************************************/
+
+/* Segment of input or output */
+struct aec_iovec {
+    void *base;
+    size_t len;
+};
+
+/* Like aec_encode() and aec_decode() with input taken from in_count
+ * segments at in and output written to out_count segments at out
+ * instead of next_in and next_out. Samples may straddle segment
+ * boundaries. total_in and total_out grow by the bytes consumed and
+ * written. Input which was not consumed, because the output segments
+ * are full or it ends with part of a sample, has to be passed again
+ * with the next call. AEC_DATA_STRIDED and AEC_DATA_PACKED are not
+ * supported. */
+libaec_EXPORT int aec_encode_v(struct aec_stream *strm,
+                               const struct aec_iovec *in, size_t in_count,
+                               const struct aec_iovec *out,
+                               size_t out_count, int flush);
+libaec_EXPORT int aec_decode_v(struct aec_stream *strm,
+                               const struct aec_iovec *in, size_t in_count,
+                               const struct aec_iovec *out,
+                               size_t out_count, int flush);
+
+/************************************************/
+/* Reusing streams and caller provided memory   */
+/************************************************/
+
+/* Start a new stream on an initialized stream without ending it
+ * first. Parameters in strm may have changed since initialization.
+ * Memory is only allocated if the new parameters need more of it
+ * than was used before. Streams initialized with a caller provided
+ * workspace return AEC_MEM_ERROR in that case. */
+libaec_EXPORT int aec_encode_reset(struct aec_stream *strm);
+libaec_EXPORT int aec_decode_reset(struct aec_stream *strm);
+
+/* Size in bytes of the workspace needed to encode or decode with the
+ * parameters set in strm. Returns 0 if the parameters are invalid. */
+libaec_EXPORT size_t aec_encode_workspace_size(const struct aec_stream *strm);
+libaec_EXPORT size_t aec_decode_workspace_size(const struct aec_stream *strm);
+
+/* Initialize like aec_encode_init() or aec_decode_init() but place
+ * all internal data in the caller provided workspace of size
+ * bytes. The library does not allocate memory for such streams. The
+ * workspace has to stay valid until aec_encode_end() or
+ * aec_decode_end() are called, which won't free it. */
+libaec_EXPORT int aec_encode_init_workspace(struct aec_stream *strm,
+                                            void *workspace, size_t size);
+libaec_EXPORT int aec_decode_init_workspace(struct aec_stream *strm,
+                                            void *workspace, size_t size);
+
+/*********************************************/
+/* Thread-safe pool of initialized streams   */
+/*********************************************/
+
+/* A pool caches up to capacity initialized encoder or decoder states
+ * keyed by bits_per_sample, block_size, rsi, and flags. Acquiring a
+ * stream takes a cached state with matching parameters (hit) or
+ * initializes a new one (miss). Released streams are returned to the
+ * pool or ended if the pool is full or the stream was initialized
+ * with a workspace of the caller. All functions may be called
+ * concurrently on the same pool. */
+struct aec_pool;
+
+libaec_EXPORT struct aec_pool *aec_pool_create(size_t capacity);
+libaec_EXPORT void aec_pool_destroy(struct aec_pool *pool);
+
+/* Replacements for aec_encode_init() and aec_decode_init(). */
+libaec_EXPORT int aec_pool_encode_acquire(struct aec_pool *pool,
+                                          struct aec_stream *strm);
+libaec_EXPORT int aec_pool_decode_acquire(struct aec_pool *pool,
+                                          struct aec_stream *strm);
+
+/* Replacements for aec_encode_end() and aec_decode_end(). Stream
+ * parameters must not have changed since acquiring. */
+libaec_EXPORT void aec_pool_encode_release(struct aec_pool *pool,
+                                           struct aec_stream *strm);
+libaec_EXPORT void aec_pool_decode_release(struct aec_pool *pool,
+                                           struct aec_stream *strm);
+
+/* Number of acquisitions served from the pool (hits) and of those
+ * that needed initialization (misses). */
+libaec_EXPORT void aec_pool_stats(struct aec_pool *pool,
+                                  size_t *hits, size_t *misses);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,310 @@
+/**
+ * @file pool.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Thread-safe pool of initialized encoder and decoder states
+ *
+ */
+
+#include "config.h"
+#include "alloc.h"
+#include "libaec.h"
+#include "threads.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_SHARDS 16
+
+struct pool_key {
+    unsigned int bits_per_sample;
+    unsigned int block_size;
+    unsigned int rsi;
+    unsigned int flags;
+
+    /* 1 for encoder, 0 for decoder states */
+    int encode;
+};
+
+struct pool_entry {
+    struct pool_key key;
+    struct internal_state *state;
+};
+
+/* Every thread releases states to its home shard and acquires from
+ * there first, so threads working with the same parameters don't
+ * contend for the same lock. A miss in the home shard takes a state
+ * from one of the other shards. */
+struct pool_shard {
+    aec_mutex_t lock;
+
+    /* cached states */
+    struct pool_entry *entries;
+
+    /* number of cached states */
+    size_t count;
+
+    /* number of allocated entries */
+    size_t size;
+};
+
+struct aec_pool {
+    struct pool_shard shard[POOL_SHARDS];
+
+    /* maximum number of cached states in all shards */
+    size_t capacity;
+
+    /* number of cached states in all shards */
+    volatile size_t count;
+
+    volatile size_t hits;
+    volatile size_t misses;
+};
+
+static void make_key(struct pool_key *key,
+                     const struct aec_stream *strm, int encode)
+{
+    key->bits_per_sample = strm->bits_per_sample;
+    key->block_size = strm->block_size;
+    key->rsi = strm->rsi;
+    key->flags = strm->flags;
+    key->encode = encode;
+}
+
+static int same_key(const struct pool_key *a, const struct pool_key *b)
+{
+    return a->bits_per_sample == b->bits_per_sample
+        && a->block_size == b->block_size
+        && a->rsi == b->rsi
+        && a->flags == b->flags
+        && a->encode == b->encode;
+}
+
+static size_t home_shard(void)
+{
+    uint64_t h = aec_thread_id();
+
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return (size_t)(h % POOL_SHARDS);
+}
+
+static void end_state(const struct pool_entry *entry)
+{
+    struct aec_stream strm;
+
+    memset(&strm, 0, sizeof(strm));
+    strm.bits_per_sample = entry->key.bits_per_sample;
+    strm.block_size = entry->key.block_size;
+    strm.rsi = entry->key.rsi;
+    strm.flags = entry->key.flags;
+    strm.state = entry->state;
+    if (entry->key.encode)
+        aec_encode_end(&strm);
+    else
+        aec_decode_end(&strm);
+}
+
+static struct internal_state *take(struct pool_shard *shard,
+                                   const struct pool_key *key)
+{
+    struct internal_state *state = NULL;
+
+    aec_mutex_lock(&shard->lock);
+    for (size_t i = shard->count; i > 0; i--) {
+        if (same_key(&shard->entries[i - 1].key, key)) {
+            state = shard->entries[i - 1].state;
+            shard->entries[i - 1] = shard->entries[--shard->count];
+            break;
+        }
+    }
+    aec_mutex_unlock(&shard->lock);
+    return state;
+}
+
+static int put(struct aec_pool *pool, struct pool_shard *shard,
+               const struct pool_entry *entry)
+{
+    /**
+       Cache entry in shard. The shard grows up to the capacity of
+       the whole pool. Returns 0 if there was no space.
+    */
+
+    int stored = 0;
+
+    aec_mutex_lock(&shard->lock);
+    if (shard->count == shard->size) {
+        size_t size = shard->size ? 2 * shard->size : 4;
+        struct pool_entry *entries;
+
+        if (size > pool->capacity)
+            size = pool->capacity;
+        entries = realloc(shard->entries, size * sizeof(struct pool_entry));
+        if (entries) {
+            shard->entries = entries;
+            shard->size = size;
+        }
+    }
+    if (shard->count < shard->size) {
+        shard->entries[shard->count++] = *entry;
+        stored = 1;
+    }
+    aec_mutex_unlock(&shard->lock);
+    return stored;
+}
+
+static int acquire(struct aec_pool *pool, struct aec_stream *strm,
+                   int encode)
+{
+    struct pool_key key;
+    struct internal_state *state = NULL;
+    size_t home = home_shard();
+
+    make_key(&key, strm, encode);
+    for (size_t i = 0; i < POOL_SHARDS && state == NULL; i++) {
+        if (aec_atomic_add(&pool->count, 0) == 0)
+            break;
+        state = take(&pool->shard[(home + i) % POOL_SHARDS], &key);
+    }
+
+    if (state == NULL) {
+        aec_atomic_add(&pool->misses, 1);
+        return encode ? aec_encode_init(strm) : aec_decode_init(strm);
+    }
+    aec_atomic_sub(&pool->count, 1);
+    aec_atomic_add(&pool->hits, 1);
+
+    strm->state = state;
+    return encode ? aec_encode_reset(strm) : aec_decode_reset(strm);
+}
+
+static void release(struct aec_pool *pool, struct aec_stream *strm,
+                    int encode)
+{
+    struct pool_entry entry;
+
+    if (strm->state == NULL)
+        return;
+
+    /* The workspace of the caller may go away after this */
+    if (!(encode ? aec_encode_owns_workspace(strm)
+          : aec_decode_owns_workspace(strm))) {
+        if (encode)
+            aec_encode_end(strm);
+        else
+            aec_decode_end(strm);
+        strm->state = NULL;
+        return;
+    }
+
+    make_key(&entry.key, strm, encode);
+    entry.state = strm->state;
+    strm->state = NULL;
+
+    if (aec_atomic_add(&pool->count, 1) > pool->capacity
+        || !put(pool, &pool->shard[home_shard()], &entry)) {
+        aec_atomic_sub(&pool->count, 1);
+        end_state(&entry);
+    }
+}
+
+struct aec_pool *aec_pool_create(size_t capacity)
+{
+    struct aec_pool *pool;
+
+    pool = malloc(sizeof(struct aec_pool));
+    if (pool == NULL)
+        return NULL;
+    memset(pool, 0, sizeof(struct aec_pool));
+    pool->capacity = capacity;
+
+    for (int i = 0; i < POOL_SHARDS; i++)
+        aec_mutex_init(&pool->shard[i].lock);
+    return pool;
+}
+
+void aec_pool_destroy(struct aec_pool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    for (int i = 0; i < POOL_SHARDS; i++) {
+        struct pool_shard *shard = &pool->shard[i];
+
+        for (size_t j = 0; j < shard->count; j++)
+            end_state(&shard->entries[j]);
+        free(shard->entries);
+        aec_mutex_destroy(&shard->lock);
+    }
+    free(pool);
+}
+
+int aec_pool_encode_acquire(struct aec_pool *pool, struct aec_stream *strm)
+{
+    return acquire(pool, strm, 1);
+}
+
+int aec_pool_decode_acquire(struct aec_pool *pool, struct aec_stream *strm)
+{
+    return acquire(pool, strm, 0);
+}
+
+void aec_pool_encode_release(struct aec_pool *pool, struct aec_stream *strm)
+{
+    release(pool, strm, 1);
+}
+
+void aec_pool_decode_release(struct aec_pool *pool, struct aec_stream *strm)
+{
+    release(pool, strm, 0);
+}
+
+void aec_pool_stats(struct aec_pool *pool, size_t *hits, size_t *misses)
+{
+    if (hits)
+        *hits = aec_atomic_add(&pool->hits, 0);
+    if (misses)
+        *misses = aec_atomic_add(&pool->misses, 0);
+}
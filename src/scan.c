@@ -0,0 +1,185 @@
+/**
+ * @file scan.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Locating RSIs in an encoded stream without decoding samples
+ *
+ * Only the option IDs and code lengths are read, which is much
+ * faster than decoding and finds where every RSI ends.
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "decode.h"
+#include "scan.h"
+#include <stdint.h>
+
+static int scan_bits(struct scanner *s, int n, uint32_t *value)
+{
+    /**
+       Read n <= 32 bits.
+    */
+
+    const unsigned char *p = s->data + s->pos / 8;
+    int bits = (int)(s->pos % 8) + n;
+    uint64_t acc = 0;
+
+    if (s->end - s->pos < (size_t)n)
+        return 0;
+
+    for (int i = 0; i < (bits + 7) / 8; i++)
+        acc = (acc << 8) | p[i];
+    acc >>= ((bits + 7) / 8) * 8 - bits;
+    *value = (uint32_t)(acc & ((UINT64_C(1) << n) - 1));
+    s->pos += n;
+    return 1;
+}
+
+static int scan_skip(struct scanner *s, size_t n)
+{
+    if (s->end - s->pos < n)
+        return 0;
+    s->pos += n;
+    return 1;
+}
+
+static int scan_fs(struct scanner *s, uint32_t *fs)
+{
+    /**
+       Read fundamental sequence.
+    */
+
+    size_t p = s->pos;
+
+    while (p < s->end) {
+        unsigned int byte = (s->data[p / 8] << (p % 8)) & 0xff;
+
+        if (byte == 0) {
+            p += 8 - p % 8;
+            continue;
+        }
+        while ((byte & 0x80) == 0) {
+            byte <<= 1;
+            p++;
+        }
+        if (p >= s->end)
+            return 0;
+        *fs = (uint32_t)(p - s->pos);
+        s->pos = p + 1;
+        return 1;
+    }
+    return 0;
+}
+
+int scan_rsi(struct scanner *s, const struct aec_stream *strm, int id_len)
+{
+    /**
+       Skip one RSI. Returns 0 if the input ends before the RSI is
+       complete or the RSI is malformed.
+    */
+
+    uint32_t uncomp_id = (1U << id_len) - 1;
+    uint32_t blocks = 0;
+    uint32_t id, fs;
+    int ref = (strm->flags & AEC_DATA_PREPROCESS) != 0;
+    int bps = (int)strm->bits_per_sample;
+
+    while (blocks < strm->rsi) {
+        size_t encoded_block_size = strm->block_size - ref;
+
+        if (!scan_bits(s, id_len, &id))
+            return 0;
+
+        if (id == 0) {
+            if (!scan_bits(s, 1, &id))
+                return 0;
+            if (ref && !scan_skip(s, bps))
+                return 0;
+            if (id == 1) {
+                /* Second Extension */
+                for (size_t i = 0; i < strm->block_size / 2; i++) {
+                    if (!scan_fs(s, &fs) || fs > SE_TABLE_SIZE)
+                        return 0;
+                }
+                blocks++;
+            } else {
+                /* Zero blocks */
+                uint32_t zero_blocks;
+
+                if (!scan_fs(s, &fs))
+                    return 0;
+                zero_blocks = fs + 1;
+                if (zero_blocks == ROS) {
+                    zero_blocks = MIN(strm->rsi - blocks, 64 - blocks % 64);
+                } else if (zero_blocks > ROS) {
+                    zero_blocks--;
+                }
+                if (zero_blocks > strm->rsi - blocks)
+                    return 0;
+                blocks += zero_blocks;
+            }
+        } else if (id == uncomp_id) {
+            if (!scan_skip(s, (size_t)strm->block_size * bps))
+                return 0;
+            blocks++;
+        } else {
+            /* Splitting with k = id - 1 */
+            if (ref && !scan_skip(s, bps))
+                return 0;
+            for (size_t i = 0; i < encoded_block_size; i++)
+                if (!scan_fs(s, &fs))
+                    return 0;
+            if (!scan_skip(s, (id - 1) * encoded_block_size))
+                return 0;
+            blocks++;
+        }
+        ref = 0;
+    }
+
+    /* Padding to the next byte */
+    if (strm->flags & AEC_PAD_RSI)
+        s->pos = (s->pos + 7) & ~(size_t)7;
+    return s->pos <= s->end;
+}
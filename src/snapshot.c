@@ -0,0 +1,161 @@
+/**
+ * @file snapshot.c
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Writing and reading snapshots of encoder and decoder states
+ *
+ */
+
+#include "config.h"
+#include "libaec.h"
+#include "snapshot.h"
+#include <string.h>
+
+void snap_put32(struct snapshot *s, uint32_t v)
+{
+    if (s->out && s->pos + 4 <= s->size)
+        for (int i = 0; i < 4; i++)
+            s->out[s->pos + i] = (uint8_t)(v >> (8 * i));
+    s->pos += 4;
+}
+
+void snap_put64(struct snapshot *s, uint64_t v)
+{
+    snap_put32(s, (uint32_t)v);
+    snap_put32(s, (uint32_t)(v >> 32));
+}
+
+void snap_put_bytes(struct snapshot *s, const uint8_t *p, size_t n)
+{
+    if (s->out && s->pos + n <= s->size)
+        memcpy(s->out + s->pos, p, n);
+    s->pos += n;
+}
+
+void snap_put_words(struct snapshot *s, const uint32_t *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        snap_put32(s, p[i]);
+}
+
+uint32_t snap_get32(struct snapshot *s)
+{
+    uint32_t v = 0;
+
+    if (s->pos + 4 > s->size) {
+        s->error = 1;
+        return 0;
+    }
+    for (int i = 0; i < 4; i++)
+        v |= (uint32_t)s->in[s->pos + i] << (8 * i);
+    s->pos += 4;
+    return v;
+}
+
+uint64_t snap_get64(struct snapshot *s)
+{
+    uint64_t v = snap_get32(s);
+    return v | (uint64_t)snap_get32(s) << 32;
+}
+
+void snap_get_bytes(struct snapshot *s, uint8_t *p, size_t n)
+{
+    if (n > s->size - s->pos) {
+        s->error = 1;
+        return;
+    }
+    memcpy(p, s->in + s->pos, n);
+    s->pos += n;
+}
+
+void snap_get_words(struct snapshot *s, uint32_t *p, size_t n)
+{
+    if (n > (s->size - s->pos) / 4) {
+        s->error = 1;
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        p[i] = snap_get32(s);
+}
+
+void snap_put_header(struct snapshot *s, const struct aec_stream *strm,
+                     int kind)
+{
+    const uint8_t magic[4] = {'A', 'E', 'C', (uint8_t)kind};
+
+    snap_put_bytes(s, magic, 4);
+    snap_put32(s, SNAPSHOT_VERSION);
+    snap_put32(s, strm->bits_per_sample);
+    snap_put32(s, strm->block_size);
+    snap_put32(s, strm->rsi);
+    snap_put32(s, strm->flags & ~SNAPSHOT_FREE_FLAGS);
+    snap_put64(s, strm->total_in);
+    snap_put64(s, strm->total_out);
+}
+
+int snap_get_header(struct snapshot *s, struct aec_stream *strm, int kind)
+{
+    /**
+       Check that the snapshot is of the right kind and was taken
+       with the parameters in strm, and restore the counters.
+    */
+
+    const uint8_t magic[4] = {'A', 'E', 'C', (uint8_t)kind};
+    uint8_t m[4];
+
+    snap_get_bytes(s, m, 4);
+    if (s->error || memcmp(m, magic, 4)
+        || snap_get32(s) != SNAPSHOT_VERSION)
+        return AEC_DATA_ERROR;
+
+    if (snap_get32(s) != strm->bits_per_sample
+        || snap_get32(s) != strm->block_size
+        || snap_get32(s) != strm->rsi
+        || snap_get32(s) != (strm->flags & ~SNAPSHOT_FREE_FLAGS))
+        return s->error ? AEC_DATA_ERROR : AEC_CONF_ERROR;
+
+    strm->total_in = (size_t)snap_get64(s);
+    strm->total_out = (size_t)snap_get64(s);
+    return s->error ? AEC_DATA_ERROR : AEC_OK;
+}
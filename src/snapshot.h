@@ -0,0 +1,95 @@
+/**
+ * @file snapshot.h
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Writing and reading snapshots of encoder and decoder states
+ *
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H 1
+
+#include "config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+struct aec_stream;
+
+/* Kinds of snapshots */
+#define SNAPSHOT_ENCODER 'E'
+#define SNAPSHOT_DECODER 'D'
+
+/* Layout version, increment on any change */
+#define SNAPSHOT_VERSION 1
+
+/* Flags which do not change the stream and may differ between saving
+ * and restoring */
+#define SNAPSHOT_FREE_FLAGS (AEC_CUSTOM_ALLOC | AEC_HUGE_PAGES)
+
+/* Cursor in a snapshot. Fields are stored little endian with fixed
+ * sizes. Snapshots are written to out and read from in. If out is
+ * NULL, only the size is counted. Reading past size sets error and
+ * returns zeros. */
+struct snapshot {
+    uint8_t *out;
+    const uint8_t *in;
+    size_t pos;
+    size_t size;
+    int error;
+};
+
+void snap_put32(struct snapshot *s, uint32_t v);
+void snap_put64(struct snapshot *s, uint64_t v);
+void snap_put_bytes(struct snapshot *s, const uint8_t *p, size_t n);
+void snap_put_words(struct snapshot *s, const uint32_t *p, size_t n);
+uint32_t snap_get32(struct snapshot *s);
+uint64_t snap_get64(struct snapshot *s);
+void snap_get_bytes(struct snapshot *s, uint8_t *p, size_t n);
+void snap_get_words(struct snapshot *s, uint32_t *p, size_t n);
+
+void snap_put_header(struct snapshot *s, const struct aec_stream *strm,
+                     int kind);
+int snap_get_header(struct snapshot *s, struct aec_stream *strm, int kind);
+
+#endif /* SNAPSHOT_H */
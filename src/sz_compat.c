@@ -49,6 +49,7 @@
 
 #include "config.h"
 #include "szlib.h"
+#include "threads.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,6 +57,30 @@
 #define NOPTS 129
 #define MIN(a, b) (((a) < (b))? (a): (b))
 
+/* Buffers are only split if every thread gets at least this many
+ * bytes. */
+#define MIN_PART_SIZE ((size_t)64 << 10)
+
+/* Upper limit for threads of one preparation step */
+#define MAX_THREADS 64
+
+enum task_kind { INTERLEAVE, DEINTERLEAVE, ADD_PADDING };
+
+/* Part of a preparation step with the range of pixels or scanlines
+ * [begin, end) */
+struct task {
+    enum task_kind kind;
+    void *dest;
+    const void *src;
+    size_t n;
+    int wordsize;
+    size_t line_size;
+    size_t padding_size;
+    int pp;
+    size_t begin;
+    size_t end;
+};
+
 static int convert_options(int sz_opts)
 {
     int co[NOPTS];
@@ -82,38 +107,89 @@ static int bits_to_bytes(int bit_length)
         return 1;
 }
 
+static unsigned int env_threads(void)
+{
+    /**
+       Number of threads requested with LIBAEC_SZ_THREADS. Anything
+       but a non-negative number means a single thread. The
+       environment is only read on the first call.
+    */
+
+    static volatile size_t cached;
+    size_t threads = aec_atomic_add(&cached, 0);
+    const char *env;
+    char *end;
+    long n;
+
+    if (threads)
+        return (unsigned int)(threads - 1);
+
+    threads = 1;
+    env = getenv("LIBAEC_SZ_THREADS");
+    if (env && *env) {
+        n = strtol(env, &end, 10);
+        if (*end == '\0' && n >= 0)
+            threads = (size_t)MIN(n, MAX_THREADS);
+    }
+    /* Cached as threads + 1, racing callers store the same value */
+    aec_atomic_cas(&cached, 0, threads + 1);
+    return (unsigned int)threads;
+}
+
+static unsigned int sz_threads(const SZ_com_t *param)
+{
+    /**
+       Number of threads for coding with param, 0 for one per
+       processor. Multithreading is enabled with
+       SZ_THREADS_OPTION_MASK or, for applications which pass options
+       through unchanged, with the environment variable
+       LIBAEC_SZ_THREADS.
+    */
+
+    if (param->options_mask & SZ_THREADS_OPTION_MASK)
+        return 0;
+    return env_threads();
+}
+
 static void interleave_buffer(void *dest, const void *src,
-                              size_t n, int wordsize)
+                              size_t n, int wordsize,
+                              size_t begin, size_t end)
 {
     const unsigned char *src8 = (unsigned char *)src;
     unsigned char *dest8 = (unsigned char *)dest;
 
-    for (size_t i = 0; i < n / wordsize; i++)
+    for (size_t i = begin; i < end; i++)
         for (size_t j = 0; j < wordsize; j++)
             dest8[j * (n / wordsize) + i] = src8[i * wordsize + j];
 }
 
 static void deinterleave_buffer(void *dest, const void *src,
-                                size_t n, int wordsize)
+                                size_t n, int wordsize,
+                                size_t begin, size_t end)
 {
     const unsigned char *src8 = (unsigned char *)src;
     unsigned char *dest8 = (unsigned char *)dest;
 
-    for (size_t i = 0; i < n / wordsize; i++)
+    for (size_t i = begin; i < end; i++)
         for (size_t j = 0; j < wordsize; j++)
             dest8[i * wordsize + j] = src8[j * (n / wordsize) + i];
 }
 
 static void add_padding(void *dest, const void *src, size_t src_length,
                         size_t line_size, size_t padding_size,
-                        int pixel_size, int pp)
+                        int pixel_size, int pp,
+                        size_t begin, size_t end)
 {
+    /**
+       Copy scanlines begin to end - 1 and pad them to full RSIs.
+    */
+
     const char zero_pixel[] = {0, 0, 0, 0};
 
     const char *pixel = zero_pixel;
-    size_t j = 0;
-    size_t i = 0;
-    while (i < src_length) {
+    size_t j = begin * (line_size + padding_size);
+    size_t i = begin * line_size;
+    while (i < src_length && i < end * line_size) {
         size_t ps;
         size_t ls = MIN(src_length - i, line_size);
         memcpy((char *)dest + j, (char *)src + i, ls);
@@ -128,6 +204,67 @@ static void add_padding(void *dest, const void *src, size_t src_length,
     }
 }
 
+static void *run_task(void *arg)
+{
+    struct task *t = arg;
+
+    switch (t->kind) {
+    case INTERLEAVE:
+        interleave_buffer(t->dest, t->src, t->n, t->wordsize,
+                          t->begin, t->end);
+        break;
+    case DEINTERLEAVE:
+        deinterleave_buffer(t->dest, t->src, t->n, t->wordsize,
+                            t->begin, t->end);
+        break;
+    case ADD_PADDING:
+        add_padding(t->dest, t->src, t->n, t->line_size, t->padding_size,
+                    t->wordsize, t->pp, t->begin, t->end);
+        break;
+    }
+    return NULL;
+}
+
+static void run_parallel(struct task *task, size_t count,
+                         unsigned int threads)
+{
+    /**
+       Split task over up to threads threads by pixels or scanlines.
+       Parts which cannot be started on a thread of their own run on
+       the calling thread.
+    */
+
+    struct task part[MAX_THREADS];
+    aec_thread_t thread[MAX_THREADS];
+    int running[MAX_THREADS];
+
+    if (threads == 0)
+        threads = aec_cpu_count();
+    threads = (unsigned int)MIN(threads, MAX_THREADS);
+    threads = (unsigned int)MIN(threads, task->n / MIN_PART_SIZE);
+    if (threads < 2) {
+        task->begin = 0;
+        task->end = count;
+        run_task(task);
+        return;
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        part[i] = *task;
+        part[i].begin = count * i / threads;
+        part[i].end = count * (i + 1) / threads;
+    }
+    for (unsigned int i = 1; i < threads; i++) {
+        running[i] = aec_thread_create(&thread[i], run_task, &part[i]) == 0;
+        if (!running[i])
+            run_task(&part[i]);
+    }
+    run_task(&part[0]);
+    for (unsigned int i = 1; i < threads; i++)
+        if (running[i])
+            aec_thread_join(thread[i]);
+}
+
 static void remove_padding(void *buf, size_t buf_length,
                            size_t line_size, size_t padding_size,
                            int pixel_size)
@@ -146,6 +283,8 @@ int SZ_BufftoBuffCompress(void *dest, size_t *destLen,
                           SZ_com_t *param)
 {
     struct aec_stream strm;
+    struct task task;
+    unsigned int threads = sz_threads(param);
     void *buf = 0;
     void *padbuf = 0;
     int status;
@@ -171,7 +310,12 @@ int SZ_BufftoBuffCompress(void *dest, size_t *destLen,
             status = SZ_MEM_ERROR;
             goto CLEANUP;
         }
-        interleave_buffer(buf, source, sourceLen, param->bits_per_pixel / 8);
+        task.kind = INTERLEAVE;
+        task.dest = buf;
+        task.src = source;
+        task.n = sourceLen;
+        task.wordsize = param->bits_per_pixel / 8;
+        run_parallel(&task, sourceLen / task.wordsize, threads);
     } else {
         strm.bits_per_sample = param->bits_per_pixel;
         buf = (void *)source;
@@ -192,14 +336,22 @@ int SZ_BufftoBuffCompress(void *dest, size_t *destLen,
         (strm.rsi * strm.block_size - param->pixels_per_scanline)
         * pixel_size;
 
-    add_padding(padbuf, buf, sourceLen,
-                param->pixels_per_scanline * pixel_size,
-                padding_size, pixel_size,
-                strm.flags & AEC_DATA_PREPROCESS);
+    task.kind = ADD_PADDING;
+    task.dest = padbuf;
+    task.src = buf;
+    task.n = sourceLen;
+    task.line_size = param->pixels_per_scanline * pixel_size;
+    task.padding_size = padding_size;
+    task.wordsize = pixel_size;
+    task.pp = strm.flags & AEC_DATA_PREPROCESS;
+    run_parallel(&task, scanlines, threads);
     strm.next_in = padbuf;
     strm.avail_in = padbuf_size;
 
-    aec_status = aec_buffer_encode(&strm);
+    if (threads == 1)
+        aec_status = aec_buffer_encode(&strm);
+    else
+        aec_status = aec_buffer_encode_parallel(&strm, threads);
     if (aec_status == AEC_STREAM_ERROR)
         status = SZ_OUTBUFF_FULL;
     else
@@ -219,6 +371,8 @@ int SZ_BufftoBuffDecompress(void *dest, size_t *destLen,
                             SZ_com_t *param)
 {
     struct aec_stream strm;
+    struct task task;
+    unsigned int threads = sz_threads(param);
     void *buf = 0;
     int status;
     int pad_scanline;
@@ -268,7 +422,10 @@ int SZ_BufftoBuffDecompress(void *dest, size_t *destLen,
         strm.avail_out = *destLen;
     }
 
-    status = aec_buffer_decode(&strm);
+    if (threads == 1)
+        status = aec_buffer_decode(&strm);
+    else
+        status = aec_buffer_decode_parallel(&strm, threads);
     if (status != AEC_OK)
         goto CLEANUP;
 
@@ -287,10 +444,16 @@ int SZ_BufftoBuffDecompress(void *dest, size_t *destLen,
     if (total_out < *destLen)
         *destLen = total_out;
 
-    if (deinterleave)
-        deinterleave_buffer(dest, buf, *destLen, param->bits_per_pixel / 8);
-    else if (pad_scanline)
+    if (deinterleave) {
+        task.kind = DEINTERLEAVE;
+        task.dest = dest;
+        task.src = buf;
+        task.n = *destLen;
+        task.wordsize = param->bits_per_pixel / 8;
+        run_parallel(&task, *destLen / task.wordsize, threads);
+    } else if (pad_scanline) {
         memcpy(dest, buf, *destLen);
+    }
 
 CLEANUP:
     if (extra_buffer && buf)
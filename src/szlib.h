@@ -60,6 +60,12 @@
 #define SZ_NN_OPTION_MASK 32
 #define SZ_RAW_OPTION_MASK 128
 
+/* libaec extension: code on all processors. Output is identical. The
+ * environment variable LIBAEC_SZ_THREADS has the same effect with the
+ * given number of threads (0 for one per processor). It is read once,
+ * other values than non-negative numbers mean a single thread. */
+#define SZ_THREADS_OPTION_MASK 256
+
 #define SZ_OK AEC_OK
 #define SZ_OUTBUFF_FULL 2
 
@@ -0,0 +1,283 @@
+/**
+ * @file threads.h
+ *
+ * @section LICENSE
+ * Copyright 2012 - 2019
+ *
+ * Mathis Rosenhauer, Moritz Hanke, Joerg Behrens
+ * Deutsches Klimarechenzentrum GmbH
+ * Bundesstr. 45a
+ * 20146 Hamburg Germany
+ *
+ * Luis Kornblueh
+ * Max-Planck-Institut fuer Meteorologie
+ * Bundesstr. 53
+ * 20146 Hamburg
+ * Germany
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @section DESCRIPTION
+ *
+ * Minimal portable threading primitives used internally
+ *
+ */
+
+#ifndef THREADS_H
+#define THREADS_H 1
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef void *(*aec_thread_fn)(void *);
+
+#ifdef _WIN32
+
+typedef HANDLE aec_thread_t;
+typedef CRITICAL_SECTION aec_mutex_t;
+typedef CONDITION_VARIABLE aec_cond_t;
+
+struct aec_thread_start {
+    aec_thread_fn fn;
+    void *arg;
+};
+
+static inline DWORD WINAPI aec_thread_trampoline(LPVOID p)
+{
+    struct aec_thread_start start = *(struct aec_thread_start *)p;
+    free(p);
+    start.fn(start.arg);
+    return 0;
+}
+
+static inline int aec_thread_create(aec_thread_t *thread,
+                                    aec_thread_fn fn, void *arg)
+{
+    struct aec_thread_start *start = malloc(sizeof(*start));
+    if (start == NULL)
+        return -1;
+    start->fn = fn;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, aec_thread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void aec_thread_join(aec_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+/* Number identifying the calling thread while it runs */
+static inline size_t aec_thread_id(void)
+{
+    return (size_t)GetCurrentThreadId();
+}
+
+static inline int aec_mutex_init(aec_mutex_t *m)
+{
+    InitializeCriticalSection(m);
+    return 0;
+}
+
+static inline void aec_mutex_destroy(aec_mutex_t *m)
+{
+    DeleteCriticalSection(m);
+}
+
+static inline void aec_mutex_lock(aec_mutex_t *m)
+{
+    EnterCriticalSection(m);
+}
+
+static inline void aec_mutex_unlock(aec_mutex_t *m)
+{
+    LeaveCriticalSection(m);
+}
+
+static inline int aec_cond_init(aec_cond_t *c)
+{
+    InitializeConditionVariable(c);
+    return 0;
+}
+
+static inline void aec_cond_destroy(aec_cond_t *c)
+{
+    (void)c;
+}
+
+static inline void aec_cond_wait(aec_cond_t *c, aec_mutex_t *m)
+{
+    SleepConditionVariableCS(c, m, INFINITE);
+}
+
+static inline void aec_cond_signal(aec_cond_t *c)
+{
+    WakeConditionVariable(c);
+}
+
+static inline void aec_cond_broadcast(aec_cond_t *c)
+{
+    WakeAllConditionVariable(c);
+}
+
+static inline size_t aec_atomic_add(volatile size_t *p, size_t v)
+{
+    return InterlockedExchangeAddSizeT(p, v) + v;
+}
+
+static inline size_t aec_atomic_sub(volatile size_t *p, size_t v)
+{
+    return InterlockedExchangeAddSizeT(p, -(SSIZE_T)v) - v;
+}
+
+static inline size_t aec_atomic_cas(volatile size_t *p, size_t expected,
+                                    size_t desired)
+{
+#ifdef _WIN64
+    return (size_t)InterlockedCompareExchange64((volatile LONG64 *)p,
+                                                (LONG64)desired,
+                                                (LONG64)expected);
+#else
+    return (size_t)InterlockedCompareExchange((volatile LONG *)p,
+                                              (LONG)desired,
+                                              (LONG)expected);
+#endif
+}
+
+static inline unsigned int aec_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+#else /* !_WIN32 */
+
+typedef pthread_t aec_thread_t;
+typedef pthread_mutex_t aec_mutex_t;
+typedef pthread_cond_t aec_cond_t;
+
+static inline int aec_thread_create(aec_thread_t *thread,
+                                    aec_thread_fn fn, void *arg)
+{
+    return pthread_create(thread, NULL, fn, arg) ? -1 : 0;
+}
+
+static inline void aec_thread_join(aec_thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+/* Number identifying the calling thread while it runs */
+static inline size_t aec_thread_id(void)
+{
+    return (size_t)pthread_self();
+}
+
+static inline int aec_mutex_init(aec_mutex_t *m)
+{
+    return pthread_mutex_init(m, NULL) ? -1 : 0;
+}
+
+static inline void aec_mutex_destroy(aec_mutex_t *m)
+{
+    pthread_mutex_destroy(m);
+}
+
+static inline void aec_mutex_lock(aec_mutex_t *m)
+{
+    pthread_mutex_lock(m);
+}
+
+static inline void aec_mutex_unlock(aec_mutex_t *m)
+{
+    pthread_mutex_unlock(m);
+}
+
+static inline int aec_cond_init(aec_cond_t *c)
+{
+    return pthread_cond_init(c, NULL) ? -1 : 0;
+}
+
+static inline void aec_cond_destroy(aec_cond_t *c)
+{
+    pthread_cond_destroy(c);
+}
+
+static inline void aec_cond_wait(aec_cond_t *c, aec_mutex_t *m)
+{
+    pthread_cond_wait(c, m);
+}
+
+static inline void aec_cond_signal(aec_cond_t *c)
+{
+    pthread_cond_signal(c);
+}
+
+static inline void aec_cond_broadcast(aec_cond_t *c)
+{
+    pthread_cond_broadcast(c);
+}
+
+static inline size_t aec_atomic_add(volatile size_t *p, size_t v)
+{
+    return __atomic_add_fetch(p, v, __ATOMIC_ACQ_REL);
+}
+
+static inline size_t aec_atomic_sub(volatile size_t *p, size_t v)
+{
+    return __atomic_sub_fetch(p, v, __ATOMIC_ACQ_REL);
+}
+
+static inline size_t aec_atomic_cas(volatile size_t *p, size_t expected,
+                                    size_t desired)
+{
+    __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return expected;
+}
+
+static inline unsigned int aec_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int)n : 1;
+}
+
+#endif /* !_WIN32 */
+
+#endif /* THREADS_H */
@@ -308,3 +308,111 @@ int encode_decode_large(struct test_state *state)
     aec_decode_end(strm);
     return 0;
 }
+
+size_t test_sample_bytes(const struct test_config *c)
+{
+    if (c->bits_per_sample > 16)
+        return c->flags & AEC_DATA_3BYTE ? 3 : 4;
+    else if (c->bits_per_sample > 8)
+        return 2;
+    else
+        return 1;
+}
+
+void test_init(struct aec_stream *strm, const struct test_config *c)
+{
+    strm->bits_per_sample = c->bits_per_sample;
+    strm->block_size = c->block_size;
+    strm->rsi = c->rsi;
+    strm->flags = c->flags;
+}
+
+void test_fill(unsigned char *buf, const struct test_config *c,
+               size_t samples, size_t run, unsigned int phase)
+{
+    /**
+       Fill buf with runs of run samples which are zero, small steps,
+       noise of varying amplitude or random. Buffers with different
+       phase get different data and runs in a different order.
+    */
+
+    size_t bytes = test_sample_bytes(c);
+    unsigned int bps = c->bits_per_sample;
+    unsigned int mask = bps == 32 ? 0xffffffff : (1U << bps) - 1;
+    unsigned int seed = bps + phase;
+    unsigned int x = 0;
+
+    for (size_t i = 0; i < samples; i++) {
+        unsigned int v;
+
+        seed = seed * 1103515245 + 12345;
+        switch ((i / run + phase) % 4) {
+        case 0:
+            v = 0;
+            break;
+        case 1:
+            x += (seed >> 16) % 5 - 2;
+            v = x;
+            break;
+        case 2:
+            v = (seed >> 8) >> ((i / 2000 + phase) % 20);
+            break;
+        default:
+            v = seed ^ (seed << 16);
+        }
+        v &= mask;
+
+        for (size_t b = 0; b < bytes; b++) {
+            size_t shift = c->flags & AEC_DATA_MSB ? bytes - 1 - b : b;
+            buf[i * bytes + b] = (unsigned char)(v >> (8 * shift));
+        }
+    }
+}
+
+int test_encode(const struct test_config *c,
+                const unsigned char *in, size_t len,
+                unsigned char *out, size_t size, size_t *out_len)
+{
+    /**
+       Reference encoding of len bytes at in with aec_buffer_encode.
+    */
+
+    struct aec_stream strm;
+
+    test_init(&strm, c);
+    strm.next_in = in;
+    strm.avail_in = len;
+    strm.next_out = out;
+    strm.avail_out = size;
+    if (aec_buffer_encode(&strm) != AEC_OK) {
+        printf("%s: reference encoding failed.\n", CHECK_FAIL);
+        return 99;
+    }
+    *out_len = strm.total_out;
+    return 0;
+}
+
+int test_decode(const struct test_config *c,
+                const unsigned char *in, size_t len, unsigned char *out,
+                const unsigned char *expect, size_t expect_len)
+{
+    /**
+       Decode len bytes at in with aec_buffer_decode and compare with
+       the expect_len bytes at expect.
+    */
+
+    struct aec_stream strm;
+
+    test_init(&strm, c);
+    strm.next_in = in;
+    strm.avail_in = len;
+    strm.next_out = out;
+    strm.avail_out = expect_len;
+    if (aec_buffer_decode(&strm) != AEC_OK
+        || strm.total_out != expect_len
+        || memcmp(out, expect, expect_len)) {
+        printf("%s: stream does not decode to the input.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
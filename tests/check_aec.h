@@ -26,6 +26,25 @@ int update_state(struct test_state *state);
 int encode_decode_small(struct test_state *state);
 int encode_decode_large(struct test_state *state);
 
+/* Coding parameters of a test case */
+struct test_config {
+    unsigned int bits_per_sample;
+    unsigned int block_size;
+    unsigned int rsi;
+    unsigned int flags;
+};
+
+size_t test_sample_bytes(const struct test_config *c);
+void test_init(struct aec_stream *strm, const struct test_config *c);
+void test_fill(unsigned char *buf, const struct test_config *c,
+               size_t samples, size_t run, unsigned int phase);
+int test_encode(const struct test_config *c,
+                const unsigned char *in, size_t len,
+                unsigned char *out, size_t size, size_t *out_len);
+int test_decode(const struct test_config *c,
+                const unsigned char *in, size_t len, unsigned char *out,
+                const unsigned char *expect, size_t expect_len);
+
 #ifndef HAVE_SNPRINTF
 #ifdef HAVE__SNPRINTF_S
 #define snprintf(d, n, ...) _snprintf_s((d), (n), _TRUNCATE, __VA_ARGS__)
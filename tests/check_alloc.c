@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define BUF_SIZE (1024 * 16)
+
+struct counter {
+    int allocs;
+    int frees;
+    int fail;
+};
+
+static void *count_alloc(void *opaque, size_t size)
+{
+    struct counter *c = opaque;
+    unsigned char *p;
+
+    if (c->fail)
+        return NULL;
+    /* Deliberately misaligned to check that the library aligns
+     * buffers itself. */
+    p = malloc(size + 1);
+    if (p == NULL)
+        return NULL;
+    c->allocs++;
+    return p + 1;
+}
+
+static void count_free(void *opaque, void *ptr)
+{
+    struct counter *c = opaque;
+
+    c->frees++;
+    free((unsigned char *)ptr - 1);
+}
+
+static void set_params(struct aec_stream *strm, struct counter *c,
+                       unsigned int rsi)
+{
+    strm->bits_per_sample = 16;
+    strm->block_size = 16;
+    strm->rsi = rsi;
+    strm->flags = AEC_DATA_PREPROCESS | AEC_CUSTOM_ALLOC;
+    strm->alloc_func = count_alloc;
+    strm->free_func = count_free;
+    strm->opaque = c;
+}
+
+static int expect(const char *call, struct counter *c,
+                  int allocs, int frees)
+{
+    if (c->allocs != allocs || c->frees != frees) {
+        printf("%s: %s: %i allocations and %i frees, expected %i and %i.\n",
+               CHECK_FAIL, call, c->allocs, c->frees, allocs, frees);
+        return 99;
+    }
+    return 0;
+}
+
+static int check_counts(unsigned char *ubuf, unsigned char *cbuf,
+                        unsigned char *obuf)
+{
+    struct aec_stream enc, dec;
+    struct counter ce = {0, 0, 0};
+    struct counter cd = {0, 0, 0};
+    size_t clen;
+
+    printf("Checking allocations per call ... ");
+
+    set_params(&enc, &ce, 64);
+    if (aec_encode_init(&enc) != AEC_OK || expect("aec_encode_init", &ce, 1, 0))
+        return 99;
+    enc.next_in = ubuf;
+    enc.avail_in = BUF_SIZE;
+    enc.next_out = cbuf;
+    enc.avail_out = 2 * BUF_SIZE;
+    if (aec_encode(&enc, AEC_FLUSH) != AEC_OK || expect("aec_encode", &ce, 1, 0))
+        return 99;
+    clen = enc.total_out;
+
+    /* Same or smaller parameters reuse memory */
+    enc.rsi = 32;
+    if (aec_encode_reset(&enc) != AEC_OK
+        || expect("aec_encode_reset", &ce, 1, 0))
+        return 99;
+    /* Larger parameters reallocate */
+    enc.rsi = 128;
+    if (aec_encode_reset(&enc) != AEC_OK
+        || expect("aec_encode_reset", &ce, 2, 1))
+        return 99;
+    if (aec_encode_end(&enc) != AEC_OK || expect("aec_encode_end", &ce, 2, 2))
+        return 99;
+
+    set_params(&dec, &cd, 64);
+    dec.next_in = cbuf;
+    dec.avail_in = clen;
+    dec.next_out = obuf;
+    dec.avail_out = BUF_SIZE;
+    if (aec_decode_init(&dec) != AEC_OK || expect("aec_decode_init", &cd, 1, 0))
+        return 99;
+    if (aec_decode(&dec, AEC_FLUSH) != AEC_OK
+        || expect("aec_decode", &cd, 1, 0))
+        return 99;
+    if (dec.total_out != BUF_SIZE || memcmp(ubuf, obuf, BUF_SIZE)) {
+        printf("%s: output differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    if (aec_decode_end(&dec) != AEC_OK || expect("aec_decode_end", &cd, 1, 1))
+        return 99;
+
+    ce.allocs = ce.frees = 0;
+    set_params(&enc, &ce, 64);
+    enc.next_in = ubuf;
+    enc.avail_in = BUF_SIZE;
+    enc.next_out = cbuf;
+    enc.avail_out = 2 * BUF_SIZE;
+    if (aec_buffer_encode(&enc) != AEC_OK
+        || expect("aec_buffer_encode", &ce, 1, 1))
+        return 99;
+
+    /* Bookkeeping of the worker and its stream */
+    ce.allocs = ce.frees = 0;
+    set_params(&enc, &ce, 64);
+    enc.next_in = ubuf;
+    enc.avail_in = BUF_SIZE;
+    enc.next_out = cbuf;
+    enc.avail_out = 2 * BUF_SIZE;
+    if (aec_buffer_encode_batch(&enc, 1, NULL, 1) != AEC_OK
+        || expect("aec_buffer_encode_batch", &ce, 4, 4))
+        return 99;
+
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static int check_errors(void)
+{
+    struct aec_stream strm;
+    struct counter c = {0, 0, 1};
+
+    printf("Checking allocator errors ... ");
+
+    set_params(&strm, &c, 64);
+    if (aec_encode_init(&strm) != AEC_MEM_ERROR
+        || aec_decode_init(&strm) != AEC_MEM_ERROR) {
+        printf("%s: failed allocation not reported.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    strm.free_func = NULL;
+    if (aec_encode_init(&strm) != AEC_CONF_ERROR
+        || aec_decode_init(&strm) != AEC_CONF_ERROR) {
+        printf("%s: incomplete allocator accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static int check_huge_pages(unsigned char *ubuf, unsigned char *cbuf,
+                            unsigned char *obuf)
+{
+    struct aec_stream strm;
+
+    printf("Checking huge pages ... ");
+
+    /* Large enough for huge pages */
+    strm.bits_per_sample = 16;
+    strm.block_size = 64;
+    strm.rsi = 4096;
+    strm.flags = AEC_DATA_PREPROCESS | AEC_HUGE_PAGES;
+    strm.next_in = ubuf;
+    strm.avail_in = BUF_SIZE;
+    strm.next_out = cbuf;
+    strm.avail_out = 2 * BUF_SIZE;
+    if (aec_buffer_encode(&strm) != AEC_OK)
+        return 99;
+
+    strm.next_in = cbuf;
+    strm.avail_in = strm.total_out;
+    strm.next_out = obuf;
+    strm.avail_out = BUF_SIZE;
+    if (aec_buffer_decode(&strm) != AEC_OK)
+        return 99;
+    if (strm.total_out != BUF_SIZE || memcmp(ubuf, obuf, BUF_SIZE)) {
+        printf("%s: output differs.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+int main(void)
+{
+    unsigned char *ubuf, *cbuf, *obuf;
+    unsigned int seed = 1;
+    int status;
+
+    ubuf = malloc(BUF_SIZE);
+    cbuf = malloc(2 * BUF_SIZE);
+    obuf = malloc(BUF_SIZE);
+    if (ubuf == NULL || cbuf == NULL || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    for (size_t i = 0; i < BUF_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        ubuf[i] = (unsigned char)((seed >> 16) & 0x07) + (unsigned char)(i >> 7);
+    }
+
+    status = check_counts(ubuf, cbuf, obuf);
+    if (status == 0)
+        status = check_errors();
+    if (status == 0)
+        status = check_huge_pages(ubuf, cbuf, obuf);
+
+    free(ubuf);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
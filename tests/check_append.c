@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define MAX_SAMPLES 40000
+#define PIECES 6
+
+static unsigned char *ubuf, *cbuf, *obuf;
+
+static int check(const struct test_config *c)
+{
+    /**
+       Encode the input in pieces, each appended to the stream of
+       the previous ones. Pieces end at RSI and at block boundaries.
+    */
+
+    struct aec_stream strm;
+    struct aec_tail tail;
+    size_t bytes = test_sample_bytes(c);
+    size_t blocks[PIECES] = {3, 1, 7, 1, 2, 5};
+    size_t len = 0;
+    size_t in = 0;
+
+    for (size_t i = 0; i < PIECES; i++) {
+        size_t samples = blocks[i] * c->block_size;
+        int status;
+
+        /* Pieces of whole RSIs with AEC_PAD_RSI */
+        if (c->flags & AEC_PAD_RSI)
+            samples *= c->rsi;
+        if ((in + samples) * bytes > MAX_SAMPLES * 4) {
+            printf("%s: test data too short.\n", CHECK_FAIL);
+            return 99;
+        }
+
+        test_init(&strm, c);
+        if (i == 0) {
+            status = aec_encode_init(&strm);
+        } else {
+            status = aec_encode_init_append(&strm, &tail);
+            if (tail.bits)
+                len--;
+        }
+        if (status != AEC_OK) {
+            printf("%s: init failed with %i.\n", CHECK_FAIL, status);
+            return 99;
+        }
+        strm.next_in = ubuf + in * bytes;
+        strm.avail_in = samples * bytes;
+        strm.next_out = cbuf + len;
+        strm.avail_out = 2 * MAX_SAMPLES * 4 - len;
+        status = aec_encode(&strm, AEC_FLUSH);
+        if (status == AEC_OK)
+            status = aec_encode_tail(&strm, &tail);
+        aec_encode_end(&strm);
+        if (status != AEC_OK) {
+            printf("%s: encoding piece %zu failed with %i.\n", CHECK_FAIL,
+                   i, status);
+            return 99;
+        }
+        len += strm.total_out;
+        in += samples;
+    }
+    return test_decode(c, cbuf, len, obuf, ubuf, in * bytes);
+}
+
+static int check_bit_offset(const struct test_config *c)
+{
+    /**
+       Cut an encoded stream after an RSI found in the index and
+       append the rest with a tail set up by hand.
+    */
+
+    struct aec_stream strm;
+    struct aec_index index = {0};
+    struct aec_tail tail = {0};
+    size_t bytes = test_sample_bytes(c);
+    size_t rsi_samples = c->rsi * c->block_size;
+    size_t samples = 9 * rsi_samples + c->block_size + 1;
+    size_t cut = 4;
+    size_t len;
+    uint64_t offset;
+    int status;
+
+    test_fill(ubuf, c, samples, 300, 1);
+    test_init(&strm, c);
+    strm.next_in = ubuf;
+    strm.avail_in = samples * bytes;
+    strm.next_out = cbuf;
+    strm.avail_out = 2 * MAX_SAMPLES * 4;
+    if (aec_encode_init(&strm) != AEC_OK
+        || aec_encode_index(&strm, &index) != AEC_OK
+        || aec_encode(&strm, AEC_FLUSH) != AEC_OK) {
+        printf("%s: reference encoding failed.\n", CHECK_FAIL);
+        return 99;
+    }
+    aec_encode_end(&strm);
+    offset = index.offsets[cut];
+    aec_index_free(&index);
+
+    len = (size_t)(offset / 8);
+    tail.bits = (unsigned int)(offset % 8);
+    tail.byte = cbuf[len];
+    /* Garbage after the cut must not matter */
+    cbuf[len] |= 0xff >> tail.bits;
+
+    test_init(&strm, c);
+    status = aec_encode_init_append(&strm, &tail);
+    if (status != AEC_OK) {
+        printf("%s: init failed with %i.\n", CHECK_FAIL, status);
+        return 99;
+    }
+    strm.next_in = ubuf + cut * rsi_samples * bytes;
+    strm.avail_in = (samples - cut * rsi_samples) * bytes;
+    strm.next_out = cbuf + len;
+    strm.avail_out = 2 * MAX_SAMPLES * 4 - len;
+    status = aec_encode(&strm, AEC_FLUSH);
+    aec_encode_end(&strm);
+    if (status != AEC_OK) {
+        printf("%s: appending failed with %i.\n", CHECK_FAIL, status);
+        return 99;
+    }
+    return test_decode(c, cbuf, len + strm.total_out, obuf, ubuf,
+                       samples * bytes);
+}
+
+static int tail_status(const struct test_config *c, size_t samples)
+{
+    struct aec_stream strm;
+    struct aec_tail tail;
+    int status;
+
+    test_init(&strm, c);
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    strm.next_in = ubuf;
+    strm.avail_in = samples * test_sample_bytes(c);
+    strm.next_out = cbuf;
+    strm.avail_out = 2 * MAX_SAMPLES * 4;
+    status = aec_encode(&strm, AEC_NO_FLUSH);
+    if (status == AEC_OK && aec_encode_tail(&strm, &tail)
+        != AEC_STREAM_ERROR)
+        status = 99;
+    if (status == AEC_OK)
+        status = aec_encode(&strm, AEC_FLUSH);
+    if (status == AEC_OK)
+        status = aec_encode_tail(&strm, &tail);
+    aec_encode_end(&strm);
+    return status;
+}
+
+static int check_errors(void)
+{
+    static const struct test_config c = {16, 16, 32, AEC_DATA_PREPROCESS};
+    static const struct test_config cpad = {16, 16, 32,
+                                       AEC_DATA_PREPROCESS | AEC_PAD_RSI};
+    struct aec_stream strm;
+    struct aec_tail tail = {0};
+
+    test_fill(ubuf, &c, 1000, 300, 1);
+    if (tail_status(&c, 16 * 40 + 16 * 3) != AEC_OK
+        || tail_status(&c, 16 * 40 + 3) != AEC_DATA_ERROR
+        || tail_status(&cpad, 16 * 32 * 2) != AEC_OK
+        || tail_status(&cpad, 16 * 40) != AEC_DATA_ERROR) {
+        printf("%s: wrong status of aec_encode_tail().\n", CHECK_FAIL);
+        return 99;
+    }
+
+    /* Only a zero run to the end of an incomplete RSI is a problem */
+    memset(ubuf, 0, 16 * 6 * 2);
+    if (tail_status(&c, 16 * 6) != AEC_DATA_ERROR
+        || tail_status(&c, 16 * 4) != AEC_OK) {
+        printf("%s: wrong status of aec_encode_tail().\n", CHECK_FAIL);
+        return 99;
+    }
+
+    test_init(&strm, &c);
+    tail.bits = 8;
+    if (aec_encode_init_append(&strm, &tail) != AEC_CONF_ERROR) {
+        printf("%s: invalid tail accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+    tail.bits = 0;
+    tail.rsi_blocks = 32;
+    if (aec_encode_init_append(&strm, &tail) != AEC_CONF_ERROR) {
+        printf("%s: invalid tail accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+    test_init(&strm, &cpad);
+    tail.rsi_blocks = 0;
+    tail.bits = 3;
+    if (aec_encode_init_append(&strm, &tail) != AEC_CONF_ERROR) {
+        printf("%s: unpadded tail accepted with AEC_PAD_RSI.\n",
+               CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+        {24, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE | AEC_DATA_SIGNED},
+        {32, 64, 2, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {12, 8, 16, 0},
+        {2, 8, 16, AEC_DATA_PREPROCESS | AEC_RESTRICTED},
+        {16, 16, 32, AEC_DATA_PREPROCESS | AEC_STREAM_BLOCKS},
+        {16, 16, 128, AEC_DATA_PREPROCESS | AEC_PIPELINE},
+    };
+    int status = 0;
+
+    ubuf = malloc(MAX_SAMPLES * 4);
+    cbuf = malloc(2 * MAX_SAMPLES * 4);
+    obuf = malloc(MAX_SAMPLES * 4);
+    if (ubuf == NULL || cbuf == NULL || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking appending to finished streams ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        /* Zero runs come last, pieces must not end in them */
+        test_fill(ubuf, &configs[i], MAX_SAMPLES, 300, 1);
+        status = check(&configs[i]);
+        if (status == 0 && !(configs[i].flags & AEC_PAD_RSI))
+            status = check_bit_offset(&configs[i]);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        status = check_errors();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
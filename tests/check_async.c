@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+#include "threads.h"
+
+#define JOBS 9
+#define MAX_BYTES (5 << 19)
+
+struct job {
+    struct aec_stream strm;
+    unsigned char *in;
+    size_t in_len;
+    unsigned char *out;
+    int status;
+    int calls;
+    aec_mutex_t *gate;
+    struct aec_async *async;
+};
+
+static void init(struct aec_stream *strm)
+{
+    strm->bits_per_sample = 16;
+    strm->block_size = 32;
+    strm->rsi = 64;
+    strm->flags = AEC_DATA_PREPROCESS;
+}
+
+static void fill(struct job *job, size_t len, unsigned int seed)
+{
+    unsigned int x = 0;
+
+    job->in_len = len;
+    for (size_t i = 0; i < len / 2; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i / 1000 % 3)
+            x += (seed >> 16) % 9 - 4;
+        else
+            x = seed >> 8;
+        job->in[2 * i] = (unsigned char)x;
+        job->in[2 * i + 1] = (unsigned char)(x >> 8);
+    }
+}
+
+static void done(struct aec_stream *strm, int status, void *arg)
+{
+    struct job *job = arg;
+
+    if (&job->strm != strm)
+        status = 99;
+    job->status = status;
+    job->calls++;
+    if (job->gate) {
+        /* Keep the worker busy until the test lets it go */
+        aec_mutex_lock(job->gate);
+        aec_mutex_unlock(job->gate);
+    }
+}
+
+static void *cancel_alloc(void *opaque, size_t size)
+{
+    /**
+       Cancel the job while it initializes so that it is stopped
+       after its first chunk.
+    */
+
+    struct job *job = opaque;
+
+    aec_cancel(job->async, &job->strm);
+    return malloc(size);
+}
+
+static void cancel_free(void *opaque, void *ptr)
+{
+    (void)opaque;
+    free(ptr);
+}
+
+static void submit_encode(struct aec_async *async, struct job *job)
+{
+    init(&job->strm);
+    job->strm.next_in = job->in;
+    job->strm.avail_in = job->in_len;
+    job->strm.next_out = job->out;
+    job->strm.avail_out = 2 * MAX_BYTES;
+    job->status = 1;
+    job->calls = 0;
+    aec_submit_encode(async, &job->strm, done, job);
+}
+
+static int check_jobs(struct job *job)
+{
+    struct aec_async *async = aec_async_create(3, 2);
+    unsigned char *ref = malloc(2 * MAX_BYTES);
+    unsigned char *dec = malloc(JOBS * MAX_BYTES);
+    size_t clen[JOBS];
+    int status = 0;
+
+    if (async == NULL || ref == NULL || dec == NULL) {
+        printf("%s: setup failed.\n", CHECK_FAIL);
+        status = 99;
+        goto DESTROY;
+    }
+
+    /* More jobs than queue slots */
+    for (size_t i = 0; i < JOBS; i++)
+        submit_encode(async, &job[i]);
+    aec_async_wait(async);
+
+    for (size_t i = 0; i < JOBS; i++) {
+        struct aec_stream strm;
+
+        init(&strm);
+        strm.next_in = job[i].in;
+        strm.avail_in = job[i].in_len;
+        strm.next_out = ref;
+        strm.avail_out = 2 * MAX_BYTES;
+        if (job[i].calls != 1 || job[i].status != AEC_OK
+            || aec_buffer_encode(&strm) != AEC_OK
+            || job[i].strm.total_in != job[i].in_len
+            || job[i].strm.total_out != strm.total_out
+            || memcmp(ref, job[i].out, strm.total_out)) {
+            printf("%s: asynchronous encoding of job %zu failed.\n",
+                   CHECK_FAIL, i);
+            status = 99;
+            goto DESTROY;
+        }
+        clen[i] = strm.total_out;
+    }
+
+    /* Output space ends before the padding of the last block */
+    for (size_t i = 0; i < JOBS; i++) {
+        init(&job[i].strm);
+        job[i].strm.next_in = job[i].out;
+        job[i].strm.avail_in = clen[i];
+        job[i].strm.next_out = dec + i * MAX_BYTES;
+        job[i].strm.avail_out = job[i].in_len;
+        job[i].status = 1;
+        job[i].calls = 0;
+        aec_submit_decode(async, &job[i].strm, done, &job[i]);
+    }
+    aec_async_wait(async);
+
+    for (size_t i = 0; i < JOBS; i++) {
+        if (job[i].calls != 1 || job[i].status != AEC_OK
+            || job[i].strm.total_out != job[i].in_len
+            || memcmp(dec + i * MAX_BYTES, job[i].in, job[i].in_len)) {
+            printf("%s: asynchronous decoding of job %zu failed.\n",
+                   CHECK_FAIL, i);
+            status = 99;
+            goto DESTROY;
+        }
+    }
+
+DESTROY:
+    aec_async_destroy(async);
+    free(ref);
+    free(dec);
+    return status;
+}
+
+static int check_cancel(struct job *job)
+{
+    struct aec_async *async = aec_async_create(1, 4);
+    aec_mutex_t gate;
+    struct aec_stream other;
+    int status = 0;
+
+    if (async == NULL) {
+        printf("%s: setup failed.\n", CHECK_FAIL);
+        return 99;
+    }
+    aec_mutex_init(&gate);
+
+    /* The only worker is held in the callback of job 0, so jobs 1 and
+     * 2 keep waiting in the queue. */
+    aec_mutex_lock(&gate);
+    job[0].gate = &gate;
+    submit_encode(async, &job[0]);
+    submit_encode(async, &job[1]);
+    submit_encode(async, &job[2]);
+    if (aec_cancel(async, &job[2].strm) != AEC_OK
+        || job[2].calls != 1 || job[2].status != AEC_CANCELLED) {
+        printf("%s: waiting job not cancelled.\n", CHECK_FAIL);
+        status = 99;
+    }
+    if (aec_cancel(async, &other) != AEC_STREAM_ERROR) {
+        printf("%s: unknown job cancelled.\n", CHECK_FAIL);
+        status = 99;
+    }
+    aec_mutex_unlock(&gate);
+    aec_async_wait(async);
+    job[0].gate = NULL;
+    if (status == 0
+        && (job[1].status != AEC_OK || job[2].calls != 1)) {
+        printf("%s: job next to a cancelled one failed.\n", CHECK_FAIL);
+        status = 99;
+    }
+
+    /* Cancel a running job of several chunks */
+    init(&job[3].strm);
+    job[3].strm.flags |= AEC_CUSTOM_ALLOC;
+    job[3].strm.alloc_func = cancel_alloc;
+    job[3].strm.free_func = cancel_free;
+    job[3].strm.opaque = &job[3];
+    job[3].async = async;
+    job[3].strm.next_in = job[3].in;
+    job[3].strm.avail_in = job[3].in_len;
+    job[3].strm.next_out = job[3].out;
+    job[3].strm.avail_out = 2 * MAX_BYTES;
+    job[3].calls = 0;
+    aec_submit_encode(async, &job[3].strm, done, &job[3]);
+    aec_async_wait(async);
+    if (status == 0
+        && (job[3].calls != 1 || job[3].status != AEC_CANCELLED
+            || job[3].strm.total_in >= job[3].in_len)) {
+        printf("%s: running job not cancelled.\n", CHECK_FAIL);
+        status = 99;
+    }
+
+    aec_async_destroy(async);
+    aec_mutex_destroy(&gate);
+    return status;
+}
+
+int main(void)
+{
+    struct job job[JOBS];
+    int status = 0;
+
+    memset(job, 0, sizeof(job));
+    for (size_t i = 0; i < JOBS; i++) {
+        job[i].in = malloc(MAX_BYTES);
+        job[i].out = malloc(2 * MAX_BYTES);
+        if (job[i].in == NULL || job[i].out == NULL) {
+            printf("Not enough memory.\n");
+            return 99;
+        }
+        /* Jobs of one and of several chunks */
+        fill(&job[i], i % 3 ? (i * 7919) & ~(size_t)1 : MAX_BYTES,
+             (unsigned int)i);
+    }
+
+    printf("Checking asynchronous encoding and decoding ... ");
+    status = check_jobs(job);
+    if (status == 0)
+        status = check_cancel(job);
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    for (size_t i = 0; i < JOBS; i++) {
+        free(job[i].in);
+        free(job[i].out);
+    }
+    return status;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define ITEMS 200
+#define MAX_SIZE 4096
+
+static unsigned char *ubuf, *cbuf, *obuf, *rbuf;
+
+static void params(struct aec_stream *strm, size_t i)
+{
+    static const unsigned int bps[] = {8, 12, 16, 24, 32};
+    static const unsigned int bs[] = {8, 16, 32, 64};
+
+    strm->bits_per_sample = bps[i % 5];
+    strm->block_size = bs[(i / 5) % 4];
+    strm->rsi = 1 + (unsigned int)(i % 7) * 20;
+    strm->flags = AEC_DATA_PREPROCESS;
+    if (i % 3 == 0)
+        strm->flags |= AEC_DATA_MSB;
+    if (i % 4 == 0)
+        strm->flags |= AEC_PAD_RSI;
+}
+
+static size_t item_size(size_t i)
+{
+    size_t bytes = (i % 5) < 1 ? 1 : (i % 5) < 3 ? 2 : 4;
+    return (1 + (i * 37) % MAX_SIZE) / bytes * bytes;
+}
+
+static int check(unsigned int threads)
+{
+    struct aec_stream strm[ITEMS];
+    int status[ITEMS];
+    int result;
+
+    for (size_t i = 0; i < ITEMS; i++) {
+        params(&strm[i], i);
+        strm[i].next_in = ubuf + i * MAX_SIZE;
+        strm[i].avail_in = item_size(i);
+        strm[i].next_out = cbuf + i * 2 * MAX_SIZE;
+        strm[i].avail_out = 2 * MAX_SIZE;
+    }
+    result = aec_buffer_encode_batch(strm, ITEMS, status, threads);
+    if (result != AEC_OK) {
+        printf("%s: batch encoding failed with %i.\n", CHECK_FAIL, result);
+        return 99;
+    }
+
+    for (size_t i = 0; i < ITEMS; i++) {
+        struct aec_stream ref;
+
+        params(&ref, i);
+        ref.next_in = ubuf + i * MAX_SIZE;
+        ref.avail_in = item_size(i);
+        ref.next_out = rbuf;
+        ref.avail_out = 2 * MAX_SIZE;
+        if (status[i] != AEC_OK
+            || aec_buffer_encode(&ref) != AEC_OK
+            || ref.total_out != strm[i].total_out
+            || strm[i].total_in != item_size(i)
+            || memcmp(rbuf, cbuf + i * 2 * MAX_SIZE, ref.total_out)) {
+            printf("%s: batch encoding of buffer %zu differs.\n",
+                   CHECK_FAIL, i);
+            return 99;
+        }
+
+        strm[i].next_in = cbuf + i * 2 * MAX_SIZE;
+        strm[i].avail_in = strm[i].total_out;
+        strm[i].next_out = obuf + i * MAX_SIZE;
+        strm[i].avail_out = item_size(i);
+    }
+
+    result = aec_buffer_decode_batch(strm, ITEMS, NULL, threads);
+    if (result != AEC_OK) {
+        printf("%s: batch decoding failed with %i.\n", CHECK_FAIL, result);
+        return 99;
+    }
+    for (size_t i = 0; i < ITEMS; i++) {
+        if (strm[i].total_out != item_size(i)
+            || memcmp(ubuf + i * MAX_SIZE, obuf + i * MAX_SIZE,
+                      item_size(i))) {
+            printf("%s: batch decoding of buffer %zu differs.\n",
+                   CHECK_FAIL, i);
+            return 99;
+        }
+    }
+
+    /* Per buffer status */
+    strm[ITEMS / 2].bits_per_sample = 33;
+    for (size_t i = 0; i < ITEMS; i++) {
+        strm[i].next_in = ubuf + i * MAX_SIZE;
+        strm[i].avail_in = item_size(i);
+        strm[i].next_out = cbuf + i * 2 * MAX_SIZE;
+        strm[i].avail_out = i == ITEMS / 3 ? 1 : 2 * MAX_SIZE;
+    }
+    result = aec_buffer_encode_batch(strm, ITEMS, status, threads);
+    if (result != AEC_STREAM_ERROR
+        || status[ITEMS / 3] != AEC_STREAM_ERROR
+        || status[ITEMS / 2] != AEC_CONF_ERROR
+        || status[ITEMS - 1] != AEC_OK) {
+        printf("%s: unexpected batch status %i.\n", CHECK_FAIL, result);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    unsigned int seed = 5;
+    int status;
+
+    ubuf = malloc(ITEMS * MAX_SIZE);
+    cbuf = malloc(ITEMS * 2 * MAX_SIZE);
+    obuf = malloc(ITEMS * MAX_SIZE);
+    rbuf = malloc(2 * MAX_SIZE);
+    if (ubuf == NULL || cbuf == NULL || obuf == NULL || rbuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    for (size_t i = 0; i < ITEMS; i++) {
+        unsigned int bps = i % 5 == 1 ? 12 : i % 5 == 3 ? 24 : 0;
+        size_t bytes = (i % 5) < 1 ? 1 : (i % 5) < 3 ? 2 : 4;
+        unsigned char *p = ubuf + i * MAX_SIZE;
+
+        for (size_t j = 0; j < MAX_SIZE; j++) {
+            seed = seed * 1103515245 + 12345;
+            p[j] = (unsigned char)(seed >> (16 + (j / 512) % 8));
+        }
+        /* Clear bits above bits_per_sample */
+        if (bps) {
+            for (size_t j = 0; j < MAX_SIZE; j += bytes) {
+                if (i % 3 == 0)
+                    p[j] &= (unsigned char)(0xff >> (8 * bytes - bps));
+                else
+                    p[j + bytes - 1] &=
+                        (unsigned char)(0xff >> (8 * bytes - bps));
+            }
+        }
+    }
+
+    printf("Checking batch encoding and decoding ... ");
+    status = check(4);
+    if (status == 0)
+        status = check(1);
+    if (status == 0)
+        status = check(0);
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(cbuf);
+    free(obuf);
+    free(rbuf);
+    return status;
+}
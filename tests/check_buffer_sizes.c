@@ -4,6 +4,7 @@
 #include "check_aec.h"
 
 #define BUF_SIZE 1024 * 3
+#define MIN(a, b) (((a) < (b))? (a): (b))
 
 int check_block_sizes(struct test_state *state)
 {
@@ -43,6 +44,65 @@ int check_block_sizes_short(struct test_state *state)
     return 0;
 }
 
+int check_chunks(struct test_state *state, size_t in_chunk, size_t out_chunk)
+{
+    /* Feed input and provide output space in chunks which are
+     * neither a multiple of the RSI length nor of the sample size and
+     * compare with the output of a single call. */
+    int status;
+    size_t avail;
+    size_t len;
+    unsigned char *buf;
+    struct aec_stream *strm = state->strm;
+
+    strm->block_size = 16;
+    strm->rsi = 7;
+
+    strm->next_in = state->ubuf;
+    strm->avail_in = state->ibuf_len;
+    strm->next_out = state->cbuf;
+    strm->avail_out = state->cbuf_len;
+    status = aec_buffer_encode(strm);
+    if (status != AEC_OK)
+        return 99;
+    len = strm->total_out;
+
+    buf = (unsigned char *)malloc(state->cbuf_len);
+    if (buf == NULL || aec_encode_init(strm) != AEC_OK) {
+        free(buf);
+        return 99;
+    }
+    avail = state->ibuf_len;
+    strm->next_in = state->ubuf;
+    strm->avail_in = 0;
+    strm->next_out = buf;
+    strm->avail_out = 0;
+    status = AEC_OK;
+    for (;;) {
+        int flush = avail ? AEC_NO_FLUSH : AEC_FLUSH;
+        size_t n = MIN(in_chunk, avail);
+        strm->avail_in += n;
+        avail -= n;
+        strm->avail_out = MIN(out_chunk, state->cbuf_len - strm->total_out);
+        status = aec_encode(strm, flush);
+        if (status != AEC_OK)
+            break;
+        if (flush == AEC_FLUSH && strm->avail_out > 0)
+            break;
+    }
+    status = aec_encode_end(strm);
+
+    if (status != AEC_OK
+        || strm->total_out != len
+        || memcmp(state->cbuf, buf, len)) {
+        printf("%s: chunks of %zu/%zu bytes change output.\n",
+               CHECK_FAIL, in_chunk, out_chunk);
+        status = 99;
+    }
+    free(buf);
+    return status;
+}
+
 int check_rsi(struct test_state *state)
 {
     int status;
@@ -67,6 +127,17 @@ int check_rsi(struct test_state *state)
     if (status)
         return status;
 
+    printf ("%s\n", CHECK_PASS);
+
+    printf("Checking chunked input and output ... ");
+    for (size_t in_chunk = 1; in_chunk <= 1021; in_chunk += 127) {
+        for (size_t out_chunk = 1; out_chunk <= 1021; out_chunk += 85) {
+            status = check_chunks(state, in_chunk, out_chunk);
+            if (status)
+                return status;
+        }
+    }
+
     printf ("%s\n", CHECK_PASS);
     return 0;
 }
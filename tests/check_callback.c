@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define MAX_SAMPLES 50000
+
+struct io {
+    const unsigned char *in;
+    size_t in_len;
+    size_t in_pos;
+    size_t round;
+
+    /* Output grows in a buffer of the caller unless stage is set */
+    int stage;
+    unsigned char *out;
+    size_t out_len;
+    size_t out_size;
+    size_t calls;
+    size_t stop_after;
+};
+
+static unsigned char *ubuf, *rbuf;
+
+static size_t source(void *opaque, const unsigned char **data)
+{
+    /* Spans of odd sizes which split samples */
+    struct io *io = opaque;
+    size_t n = io->round++ * 1237 % 4001 + 1;
+
+    if (n > io->in_len - io->in_pos)
+        n = io->in_len - io->in_pos;
+    *data = io->in + io->in_pos;
+    io->in_pos += n;
+    return n;
+}
+
+static int sink(void *opaque, const unsigned char *data, size_t len,
+                unsigned char **next, size_t *avail)
+{
+    struct io *io = opaque;
+
+    if (io->stop_after && ++io->calls > io->stop_after)
+        return 1;
+
+    if (io->stage) {
+        if (io->out_len + len > io->out_size)
+            return 1;
+        if (len > 0)
+            memcpy(io->out + io->out_len, data, len);
+        io->out_len += len;
+        return 0;
+    }
+
+    /* Output was written to the end of our buffer */
+    if (len > 0 && data != io->out + io->out_len)
+        return 1;
+    io->out_len += len;
+    if (io->out_size - io->out_len < 64) {
+        unsigned char *p;
+
+        io->out_size = 2 * io->out_size + 64;
+        p = realloc(io->out, io->out_size);
+        if (p == NULL)
+            return 1;
+        io->out = p;
+    }
+    *next = io->out + io->out_len;
+    *avail = io->out_size - io->out_len;
+    return 0;
+}
+
+static void io_init(struct io *io, const unsigned char *in, size_t len,
+                    int stage)
+{
+    memset(io, 0, sizeof(*io));
+    io->in = in;
+    io->in_len = len;
+    io->stage = stage;
+    if (stage) {
+        io->out_size = MAX_SAMPLES * 8;
+        io->out = malloc(io->out_size);
+    }
+}
+
+static int check(const struct test_config *c, int stage)
+{
+    struct aec_stream strm;
+    struct io enc, dec;
+    size_t len = MAX_SAMPLES * test_sample_bytes(c) - test_sample_bytes(c);
+    size_t rlen;
+    int status;
+
+    if (test_encode(c, ubuf, len, rbuf, MAX_SAMPLES * 8, &rlen))
+        return 99;
+
+    io_init(&enc, ubuf, len, stage);
+    test_init(&strm, c);
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    status = aec_encode_callback(&strm, source, sink, &enc);
+    aec_encode_end(&strm);
+    if (status != AEC_OK || enc.out_len != rlen
+        || strm.total_in != len || strm.total_out != rlen
+        || memcmp(enc.out, rbuf, rlen)) {
+        printf("%s: callback encoding differs (%i).\n", CHECK_FAIL, status);
+        free(enc.out);
+        return 99;
+    }
+
+    io_init(&dec, enc.out, enc.out_len, stage);
+    test_init(&strm, c);
+    if (aec_decode_init(&strm) != AEC_OK)
+        return 99;
+    status = aec_decode_callback(&strm, source, sink, &dec);
+    aec_decode_end(&strm);
+    free(enc.out);
+    /* Padding of the last block is decoded as well */
+    if (status != AEC_OK || dec.out_len < len
+        || strm.total_out != dec.out_len
+        || memcmp(dec.out, ubuf, len)) {
+        printf("%s: callback decoding differs (%i).\n", CHECK_FAIL, status);
+        free(dec.out);
+        return 99;
+    }
+    free(dec.out);
+    return 0;
+}
+
+static int check_stop(void)
+{
+    static const struct test_config c = {16, 16, 4, AEC_DATA_PREPROCESS};
+    struct aec_stream strm;
+    struct io io;
+    int status;
+
+    io_init(&io, ubuf, MAX_SAMPLES * 2, 0);
+    io.stop_after = 3;
+    test_init(&strm, &c);
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    status = aec_encode_callback(&strm, source, sink, &io);
+    aec_encode_end(&strm);
+    free(io.out);
+    if (status != AEC_CANCELLED || strm.total_in >= MAX_SAMPLES * 2) {
+        printf("%s: stopping sink not honored.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {16, 16, 32, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+        {24, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE | AEC_DATA_MSB},
+        {32, 64, 2, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {12, 8, 16, 0},
+        {16, 16, 32, AEC_DATA_PREPROCESS | AEC_STREAM_BLOCKS},
+        {16, 8, 8, AEC_DATA_PREPROCESS | AEC_PIPELINE},
+    };
+    int status = 0;
+
+    ubuf = malloc(MAX_SAMPLES * 4);
+    rbuf = malloc(MAX_SAMPLES * 8);
+    if (ubuf == NULL || rbuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking callback driven coding ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        test_fill(ubuf, &configs[i], MAX_SAMPLES, 600, 0);
+        status = check(&configs[i], 0);
+        if (status == 0)
+            status = check(&configs[i], 1);
+        if (status)
+            break;
+    }
+    if (status == 0) {
+        test_fill(ubuf, &configs[0], MAX_SAMPLES, 600, 0);
+        status = check_stop();
+    }
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(rbuf);
+    return status;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define MAX_SAMPLES 40000
+#define SEGMENTS 6
+
+static unsigned char *ubuf, *cbuf, *jbuf, *obuf;
+
+static int encode_segments(const struct test_config *c, const size_t *samples,
+                           const unsigned char **segment, size_t *length)
+{
+    /**
+       Encode consecutive pieces of ubuf into separate segments in
+       cbuf.
+    */
+
+    size_t bytes = test_sample_bytes(c);
+    size_t in = 0;
+    size_t out = 0;
+
+    for (size_t i = 0; i < SEGMENTS; i++) {
+        segment[i] = cbuf + out;
+        length[i] = 0;
+        if (samples[i] == 0)
+            continue;
+        if (test_encode(c, ubuf + in, samples[i] * bytes, cbuf + out,
+                        2 * MAX_SAMPLES * 4 - out, &length[i]))
+            return 99;
+        in += samples[i] * bytes;
+        out += length[i];
+    }
+    return 0;
+}
+
+static int check(const struct test_config *c)
+{
+    struct aec_stream strm;
+    const unsigned char *segment[SEGMENTS];
+    size_t length[SEGMENTS];
+    size_t rsi_samples = c->rsi * c->block_size;
+    size_t samples[SEGMENTS] = {3, 0, 1, 7, 2, 0};
+    size_t bytes = test_sample_bytes(c);
+    size_t total = 0;
+    size_t sum = 0;
+    size_t joined;
+    int status;
+
+    for (size_t i = 0; i < SEGMENTS - 1; i++) {
+        samples[i] *= rsi_samples;
+        total += samples[i];
+    }
+    /* The last segment ends with a partial block */
+    samples[SEGMENTS - 1] = rsi_samples + c->block_size / 2 + 1;
+    total += samples[SEGMENTS - 1];
+    if (total > MAX_SAMPLES) {
+        printf("%s: test data too short.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    test_fill(ubuf, c, total, 500, 0);
+    if (encode_segments(c, samples, segment, length))
+        return 99;
+    for (size_t i = 0; i < SEGMENTS; i++)
+        sum += length[i];
+
+    test_init(&strm, c);
+    strm.next_out = jbuf;
+    strm.avail_out = sum;
+    strm.total_out = 0;
+    status = aec_concat(&strm, segment, length, SEGMENTS);
+    if (status != AEC_OK) {
+        printf("%s: joining segments failed with %i.\n", CHECK_FAIL,
+               status);
+        return 99;
+    }
+    if (strm.next_out != jbuf + strm.total_out
+        || strm.avail_out != sum - strm.total_out) {
+        printf("%s: output counters not updated.\n", CHECK_FAIL);
+        return 99;
+    }
+    joined = strm.total_out;
+
+    if (test_decode(c, jbuf, joined, obuf, ubuf, total * bytes))
+        return 99;
+
+    /* Output too small */
+    test_init(&strm, c);
+    strm.next_out = jbuf;
+    strm.avail_out = length[SEGMENTS - 1];
+    strm.total_out = 0;
+    status = aec_concat(&strm, segment, length, SEGMENTS);
+    if (status != AEC_STREAM_ERROR) {
+        printf("%s: short output not detected.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+static int check_partial(const struct test_config *c)
+{
+    /**
+       A segment which does not end at an RSI boundary has to be
+       rejected, with or without AEC_PAD_RSI. With rsi > 1, a
+       trailing full block starts an RSI which is not complete.
+    */
+
+    struct aec_stream strm;
+    const unsigned char *segment[SEGMENTS];
+    size_t length[SEGMENTS];
+    size_t rsi_samples = c->rsi * c->block_size;
+    size_t samples[SEGMENTS] = {0};
+    int status;
+
+    samples[0] = 2 * rsi_samples + c->block_size;
+    samples[1] = rsi_samples;
+    test_fill(ubuf, c, samples[0] + samples[1], 500, 0);
+    if (encode_segments(c, samples, segment, length))
+        return 99;
+
+    test_init(&strm, c);
+    strm.next_out = jbuf;
+    strm.avail_out = 2 * MAX_SAMPLES * 4;
+    strm.total_out = 0;
+    status = aec_concat(&strm, segment, length, 2);
+    if (status != AEC_DATA_ERROR) {
+        printf("%s: segment with partial RSI accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+        {24, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE},
+        {32, 64, 2, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {12, 8, 16, 0},
+        {2, 8, 16, AEC_DATA_PREPROCESS | AEC_RESTRICTED},
+        {13, 64, 1, AEC_DATA_PREPROCESS | AEC_NOT_ENFORCE},
+    };
+    int status = 0;
+
+    ubuf = malloc(MAX_SAMPLES * 4);
+    cbuf = malloc(2 * MAX_SAMPLES * 4);
+    jbuf = malloc(2 * MAX_SAMPLES * 4);
+    obuf = malloc(MAX_SAMPLES * 4);
+    if (ubuf == NULL || cbuf == NULL || jbuf == NULL || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking joining of encoded segments ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        status = check(&configs[i]);
+        if (status == 0 && configs[i].rsi > 1)
+            status = check_partial(&configs[i]);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(cbuf);
+    free(jbuf);
+    free(obuf);
+    return status;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define MIN(a, b) (((a) < (b))? (a): (b))
+
+#define BUF_SIZE (1024 * 64 + 36)
+
+static unsigned char *ubuf, *cbuf, *obuf;
+
+static int encode(struct aec_stream *strm, struct aec_index *index,
+                  size_t chunk)
+{
+    /**
+       Encode ubuf in chunks of chunk bytes while recording the index.
+    */
+
+    size_t in = 0;
+    size_t out = 0;
+
+    if (aec_encode_init(strm) != AEC_OK)
+        return 99;
+    if (aec_encode_index(strm, index) != AEC_OK)
+        return 99;
+
+    strm->next_in = ubuf;
+    strm->next_out = cbuf;
+    strm->avail_in = 0;
+    strm->avail_out = 0;
+    do {
+        size_t n = MIN(chunk, BUF_SIZE - in);
+
+        strm->avail_in += n;
+        in += n;
+        n = MIN(chunk, 2 * BUF_SIZE - out);
+        strm->avail_out += n;
+        out += n;
+        if (aec_encode(strm, in == BUF_SIZE ? AEC_FLUSH : AEC_NO_FLUSH)
+            != AEC_OK)
+            return 99;
+    } while (in < BUF_SIZE || strm->avail_out == 0);
+
+    if (aec_encode_index(strm, index) != AEC_STREAM_ERROR) {
+        printf("%s: index attached after encoding started.\n", CHECK_FAIL);
+        return 99;
+    }
+    return aec_encode_end(strm) == AEC_OK ? 0 : 99;
+}
+
+static int check_range(struct aec_stream *strm, struct aec_index *index,
+                       size_t clen, size_t offset, size_t count)
+{
+    int bytes = strm->bits_per_sample > 16 ? 4
+        : strm->bits_per_sample > 8 ? 2 : 1;
+
+    strm->next_in = cbuf;
+    strm->avail_in = clen;
+    strm->next_out = obuf;
+    strm->avail_out = count * bytes;
+    if (aec_decode_range(strm, index, offset, count) != AEC_OK) {
+        printf("%s: decoding range %zu + %zu failed.\n",
+               CHECK_FAIL, offset, count);
+        return 99;
+    }
+    if (strm->total_out != count * bytes
+        || memcmp(obuf, ubuf + offset * bytes, count * bytes)) {
+        printf("%s: range %zu + %zu differs for bps %u, rsi %u, "
+               "interval %zu.\n", CHECK_FAIL, offset, count,
+               strm->bits_per_sample, strm->rsi, index->interval);
+        return 99;
+    }
+    return 0;
+}
+
+static int check(unsigned int bps, unsigned int rsi, unsigned int flags,
+                 size_t interval, size_t chunk)
+{
+    struct aec_stream strm;
+    struct aec_index index;
+    size_t samples, rsi_samples, n_rsi, clen;
+    int bytes = bps > 16 ? 4 : bps > 8 ? 2 : 1;
+    int status;
+
+    memset(&index, 0, sizeof(index));
+    index.interval = interval;
+
+    strm.bits_per_sample = bps;
+    strm.block_size = 16;
+    strm.rsi = rsi;
+    strm.flags = flags;
+    status = encode(&strm, &index, chunk);
+    if (status)
+        return status;
+    clen = strm.total_out;
+
+    samples = BUF_SIZE / bytes;
+    rsi_samples = (size_t)rsi * strm.block_size;
+    n_rsi = (samples + rsi_samples - 1) / rsi_samples;
+    if (index.samples != samples
+        || index.count != (n_rsi + interval - 1) / interval
+        || index.offsets[0] != 0) {
+        printf("%s: index has %zu entries for %llu samples.\n",
+               CHECK_FAIL, index.count, (unsigned long long)index.samples);
+        return 99;
+    }
+
+    status = check_range(&strm, &index, clen, 0, samples);
+    for (size_t i = 0; i < 50 && status == 0; i++) {
+        size_t offset = (i * 7919 * rsi_samples / 13) % samples;
+        size_t count = MIN(samples - offset, 1 + i * 37);
+        status = check_range(&strm, &index, clen, offset, count);
+    }
+    if (status == 0)
+        status = check_range(&strm, &index, clen, samples - 1, 1);
+
+    if (status == 0) {
+        strm.next_in = cbuf;
+        strm.avail_in = clen;
+        strm.next_out = obuf;
+        strm.avail_out = 2 * bytes;
+        if (aec_decode_range(&strm, &index, samples - 1, 2)
+            != AEC_CONF_ERROR) {
+            printf("%s: range beyond end accepted.\n", CHECK_FAIL);
+            status = 99;
+        }
+    }
+
+    aec_index_free(&index);
+    return status;
+}
+
+int main(void)
+{
+    unsigned int seed = 7;
+    int status = 0;
+
+    ubuf = malloc(BUF_SIZE);
+    cbuf = malloc(2 * BUF_SIZE);
+    obuf = malloc(BUF_SIZE);
+    if (ubuf == NULL || cbuf == NULL || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+    for (size_t i = 0; i < BUF_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        ubuf[i] = (unsigned char)((seed >> 16) & ((i >> 11) % 8 ? 0x1f : 0));
+    }
+
+    printf("Checking RSI index and range decoding ... ");
+    status = check(8, 16, AEC_DATA_PREPROCESS, 1, BUF_SIZE);
+    if (status == 0)
+        status = check(8, 16, AEC_DATA_PREPROCESS, 1, 7);
+    if (status == 0)
+        status = check(16, 8, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED, 3, 100);
+    if (status == 0)
+        status = check(13, 64, 0, 2, 4096);
+    if (status == 0)
+        status = check(32, 32, AEC_DATA_PREPROCESS | AEC_PAD_RSI, 5, 33);
+    if (status == 0)
+        status = check(29, 128, AEC_DATA_PREPROCESS | AEC_DATA_MSB, 1,
+                       BUF_SIZE);
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
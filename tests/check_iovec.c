@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define MAX_SAMPLES 40000
+#define MAX_SEGMENTS 4096
+
+static unsigned char *ubuf, *rbuf, *cbuf, *dbuf;
+static struct aec_iovec in[MAX_SEGMENTS], out[MAX_SEGMENTS];
+
+static size_t split(struct aec_iovec *seg, unsigned char *buf, size_t len,
+                    size_t max, size_t step)
+{
+    /**
+       Cut len bytes at buf into segments of up to max segments of
+       varying, mostly odd sizes including empty ones.
+    */
+
+    size_t n = 0;
+
+    while (len > 0 && n < max) {
+        size_t l = n * step % 1999 % (len + 1);
+
+        if (n + 1 == max)
+            l = len;
+        seg[n].base = buf;
+        seg[n].len = l;
+        buf += l;
+        len -= l;
+        n++;
+    }
+    return n;
+}
+
+static int check(const struct test_config *c)
+{
+    struct aec_stream strm;
+    size_t bytes = test_sample_bytes(c);
+    size_t len = MAX_SAMPLES * bytes;
+    size_t rlen;
+    size_t n;
+    int status;
+
+    if (test_encode(c, ubuf, len, rbuf, MAX_SAMPLES * 8, &rlen))
+        return 99;
+
+    /* Few output segments at a time so that input is left over */
+    test_init(&strm, c);
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    for (size_t round = 0;; round++) {
+        size_t in_count = split(in, ubuf + strm.total_in,
+                                len - strm.total_in, MAX_SEGMENTS, 37);
+        size_t out_count = split(out, cbuf + strm.total_out,
+                                 MAX_SAMPLES * 8 - strm.total_out,
+                                 round % 5 + 2, 53);
+        size_t total_out = strm.total_out;
+
+        status = aec_encode_v(&strm, in, in_count, out, out_count,
+                              AEC_FLUSH);
+        if (status != AEC_OK) {
+            printf("%s: encoding failed with %i.\n", CHECK_FAIL, status);
+            return 99;
+        }
+        n = 0;
+        for (size_t i = 0; i < out_count; i++)
+            n += out[i].len;
+        if (strm.total_in == len && strm.total_out - total_out < n)
+            break;
+    }
+    aec_encode_end(&strm);
+    if (strm.total_out != rlen || memcmp(cbuf, rbuf, rlen)) {
+        printf("%s: scattered encoding differs.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    /* Decoded samples straddle output segments */
+    test_init(&strm, c);
+    if (aec_decode_init(&strm) != AEC_OK)
+        return 99;
+    while (strm.total_out < len) {
+        size_t total_out = strm.total_out;
+        size_t in_count = split(in, rbuf + strm.total_in,
+                                rlen - strm.total_in, 7, 41);
+        size_t out_count = split(out, dbuf + strm.total_out,
+                                 len - strm.total_out, MAX_SEGMENTS, 29);
+
+        status = aec_decode_v(&strm, in, in_count, out, out_count,
+                              AEC_NO_FLUSH);
+        if (status != AEC_OK || strm.total_out == total_out) {
+            printf("%s: decoding failed with %i.\n", CHECK_FAIL, status);
+            return 99;
+        }
+    }
+    aec_decode_end(&strm);
+    if (strm.total_out != len || memcmp(dbuf, ubuf, len)) {
+        printf("%s: gathered decoding differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {16, 16, 32, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+        {24, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE | AEC_DATA_MSB},
+        {32, 64, 2, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {20, 16, 8, 0},
+        {16, 8, 8, AEC_DATA_PREPROCESS | AEC_PIPELINE},
+    };
+    int status = 0;
+
+    ubuf = malloc(MAX_SAMPLES * 4);
+    rbuf = malloc(MAX_SAMPLES * 8);
+    cbuf = malloc(MAX_SAMPLES * 8);
+    dbuf = malloc(MAX_SAMPLES * 4);
+    if (ubuf == NULL || rbuf == NULL || cbuf == NULL || dbuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking scatter-gather coding ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        test_fill(ubuf, &configs[i], MAX_SAMPLES, 800, 0);
+        status = check(&configs[i]);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(rbuf);
+    free(cbuf);
+    free(dbuf);
+    return status;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define STREAMS 37
+#define SAMPLES 6000
+
+static unsigned char *ubuf, *cbuf, *obuf;
+static size_t clen[STREAMS];
+
+static int encode(const struct test_config *c)
+{
+    /* Reference streams for the multi-stream decoder */
+    size_t len = SAMPLES * test_sample_bytes(c);
+
+    for (size_t s = 0; s < STREAMS; s++) {
+        test_fill(ubuf + s * SAMPLES * 4, c, SAMPLES, 300, (unsigned int)s);
+        if (test_encode(c, ubuf + s * SAMPLES * 4, len,
+                        cbuf + s * 2 * SAMPLES * 4, 2 * SAMPLES * 4,
+                        &clen[s]))
+            return 99;
+    }
+    return 0;
+}
+
+static int check_decode(const struct test_config *c)
+{
+    struct aec_stream strm[STREAMS];
+    size_t len = SAMPLES * test_sample_bytes(c);
+    int status;
+
+    for (size_t s = 0; s < STREAMS; s++) {
+        test_init(&strm[s], c);
+        if (aec_decode_init(&strm[s]) != AEC_OK) {
+            printf("%s: init failed.\n", CHECK_FAIL);
+            return 99;
+        }
+        strm[s].next_in = cbuf + s * 2 * SAMPLES * 4;
+        strm[s].avail_in = 0;
+        strm[s].next_out = obuf + s * SAMPLES * 4;
+        strm[s].avail_out = 0;
+    }
+
+    /* Feed a few bytes per call and stream, some streams with
+     * little output space */
+    for (size_t round = 0; ; round++) {
+        int more = 0;
+
+        for (size_t s = 0; s < STREAMS; s++) {
+            const unsigned char *in = cbuf + s * 2 * SAMPLES * 4;
+            size_t given = (size_t)(strm[s].next_in - in)
+                + strm[s].avail_in;
+            size_t n = 1 + (round * 5 + s * 11) % 37;
+
+            if (s % 5 == 0)
+                n += 500;
+            if (n > clen[s] - given)
+                n = clen[s] - given;
+            strm[s].avail_in += n;
+
+            if (s % 4 == 1)
+                strm[s].avail_out = (1 + round % 5) * test_sample_bytes(c);
+            else
+                strm[s].avail_out = len - strm[s].total_out;
+            if (strm[s].avail_out > len - strm[s].total_out)
+                strm[s].avail_out = len - strm[s].total_out;
+            if (strm[s].total_out < len)
+                more = 1;
+        }
+        if (!more)
+            break;
+        if (round > 100000) {
+            printf("%s: multi-stream decoding does not progress.\n",
+                   CHECK_FAIL);
+            return 99;
+        }
+
+        status = aec_decode_multi(strm, STREAMS, AEC_NO_FLUSH);
+        if (status != AEC_OK) {
+            printf("%s: multi-stream decoding failed with %i.\n",
+                   CHECK_FAIL, status);
+            return 99;
+        }
+    }
+
+    for (size_t s = 0; s < STREAMS; s++) {
+        aec_decode_end(&strm[s]);
+        if (memcmp(ubuf + s * SAMPLES * 4, obuf + s * SAMPLES * 4, len)) {
+            printf("%s: multi-stream decoding of stream %zu differs.\n",
+                   CHECK_FAIL, s);
+            return 99;
+        }
+    }
+    return 0;
+}
+
+static int check_mixed(void)
+{
+    struct aec_stream strm[2];
+    int status;
+
+    for (int i = 0; i < 2; i++) {
+        strm[i].bits_per_sample = 8;
+        strm[i].block_size = 16;
+        strm[i].rsi = i ? 32 : 64;
+        strm[i].flags = AEC_DATA_PREPROCESS;
+        if (aec_decode_init(&strm[i]) != AEC_OK)
+            return 99;
+    }
+    status = aec_decode_multi(strm, 2, AEC_FLUSH);
+    aec_decode_end(&strm[0]);
+    aec_decode_end(&strm[1]);
+    if (status != AEC_CONF_ERROR) {
+        printf("%s: streams with different parameters accepted.\n",
+               CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED | AEC_DATA_MSB},
+        {24, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE | AEC_PAD_RSI},
+        {32, 64, 2, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {12, 8, 16, AEC_DATA_MSB},
+        {2, 8, 16, AEC_DATA_PREPROCESS | AEC_RESTRICTED},
+        {13, 64, 1, AEC_DATA_PREPROCESS | AEC_NOT_ENFORCE},
+    };
+    int status = 0;
+
+    ubuf = malloc(STREAMS * SAMPLES * 4);
+    cbuf = malloc(STREAMS * 2 * SAMPLES * 4);
+    obuf = malloc(STREAMS * SAMPLES * 4);
+    if (ubuf == NULL || cbuf == NULL || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking multi-stream decoding ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        status = encode(&configs[i]);
+        if (status == 0)
+            status = check_decode(&configs[i]);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        status = check_mixed();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
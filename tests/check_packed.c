@@ -0,0 +1,241 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define SAMPLES 20480
+
+/* Packed samples, one sample per storage unit, encoded reference,
+ * encoded and decoded output */
+static unsigned char *pbuf, *ubuf, *rbuf, *cbuf, *obuf;
+
+static struct test_config unpacked(const struct test_config *c)
+{
+    /* Same samples, one per storage unit in big endian */
+    struct test_config u = *c;
+
+    u.flags = (c->flags & ~AEC_DATA_3BYTE) | AEC_DATA_MSB;
+    return u;
+}
+
+static size_t packed_len(const struct test_config *c)
+{
+    return SAMPLES * c->bits_per_sample / 8;
+}
+
+static void fill(const struct test_config *c)
+{
+    struct test_config u = unpacked(c);
+    unsigned int bps = c->bits_per_sample;
+    size_t bytes = test_sample_bytes(&u);
+    uint64_t acc = 0;
+    unsigned int bits = 0;
+    unsigned char *p = pbuf;
+
+    test_fill(ubuf, &u, SAMPLES, 600, 0);
+    for (size_t i = 0; i < SAMPLES; i++) {
+        uint32_t v = 0;
+
+        for (size_t b = 0; b < bytes; b++)
+            v = (v << 8) | ubuf[i * bytes + b];
+        acc = (acc << bps) | v;
+        bits += bps;
+        while (bits >= 8) {
+            bits -= 8;
+            *p++ = (unsigned char)(acc >> bits);
+        }
+    }
+}
+
+static void init_packed(struct aec_stream *strm, const struct test_config *c)
+{
+    test_init(strm, c);
+    strm->flags |= AEC_DATA_PACKED;
+}
+
+static int check_encode(const struct test_config *c, size_t *rlen)
+{
+    struct aec_stream strm;
+    struct test_config u = unpacked(c);
+    size_t len = packed_len(c);
+    int status;
+
+    /* Reference from unpacked samples */
+    if (test_encode(&u, ubuf, SAMPLES * test_sample_bytes(&u), rbuf,
+                    SAMPLES * 8, rlen))
+        return 99;
+
+    /* In pieces which end inside of samples */
+    init_packed(&strm, c);
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    strm.next_in = pbuf;
+    strm.avail_in = 0;
+    strm.next_out = cbuf;
+    strm.avail_out = SAMPLES * 8;
+    for (size_t round = 0, fed = 0; fed < len; round++) {
+        size_t n = round * 1237 % 3001 + 1;
+
+        if (n > len - fed)
+            n = len - fed;
+        strm.avail_in += n;
+        fed += n;
+        status = aec_encode(&strm, fed == len ? AEC_FLUSH : AEC_NO_FLUSH);
+        if (status != AEC_OK) {
+            printf("%s: packed encoding failed with %i.\n", CHECK_FAIL,
+                   status);
+            return 99;
+        }
+    }
+    aec_encode_end(&strm);
+    if (strm.total_in != len || strm.total_out != *rlen
+        || memcmp(cbuf, rbuf, *rlen)) {
+        printf("%s: packed encoding with %u bits differs.\n",
+               CHECK_FAIL, c->bits_per_sample);
+        return 99;
+    }
+
+    init_packed(&strm, c);
+    strm.next_in = pbuf;
+    strm.avail_in = len;
+    strm.next_out = cbuf;
+    strm.avail_out = SAMPLES * 8;
+    status = aec_buffer_encode_parallel(&strm, 3);
+    if (status != AEC_OK || strm.total_out != *rlen
+        || memcmp(cbuf, rbuf, *rlen)) {
+        printf("%s: parallel packed encoding differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+static int check_decode(const struct test_config *c, size_t rlen)
+{
+    struct aec_stream strm;
+    size_t len = packed_len(c);
+    int status;
+
+    /* Output buffers which end inside of samples */
+    memset(obuf, 0, len);
+    init_packed(&strm, c);
+    if (aec_decode_init(&strm) != AEC_OK)
+        return 99;
+    strm.next_in = rbuf;
+    strm.avail_in = rlen;
+    strm.next_out = obuf;
+    for (size_t round = 0; strm.total_out < len; round++) {
+        size_t n = round % 5 ? round * 331 % 977 + 1 : 1;
+
+        strm.avail_out = n < len - strm.total_out ? n : len - strm.total_out;
+        status = aec_decode(&strm, AEC_FLUSH);
+        if (status != AEC_OK) {
+            printf("%s: packed decoding failed with %i.\n", CHECK_FAIL,
+                   status);
+            return 99;
+        }
+        if (strm.avail_out) {
+            printf("%s: packed output not filled.\n", CHECK_FAIL);
+            return 99;
+        }
+    }
+    aec_decode_end(&strm);
+    if (memcmp(obuf, pbuf, len)) {
+        printf("%s: packed decoding with %u bits differs.\n",
+               CHECK_FAIL, c->bits_per_sample);
+        return 99;
+    }
+
+    memset(obuf, 0, len);
+    init_packed(&strm, c);
+    strm.next_in = rbuf;
+    strm.avail_in = rlen;
+    strm.next_out = obuf;
+    strm.avail_out = len;
+    status = aec_buffer_decode_parallel(&strm, 3);
+    if (status != AEC_OK || strm.total_out != len
+        || memcmp(obuf, pbuf, len)) {
+        printf("%s: parallel packed decoding differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+static int check_params(void)
+{
+    static const struct test_config c = {1, 2, 8, AEC_NOT_ENFORCE};
+    struct aec_stream strm;
+
+    init_packed(&strm, &c);
+    if (aec_encode_init(&strm) != AEC_CONF_ERROR
+        || aec_decode_init(&strm) != AEC_CONF_ERROR) {
+        printf("%s: block of partial bytes accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+    strm.block_size = 16;
+    strm.flags |= AEC_DATA_STRIDED;
+    strm.sample_stride = 1;
+    if (aec_encode_init(&strm) != AEC_CONF_ERROR
+        || aec_decode_init(&strm) != AEC_CONF_ERROR) {
+        printf("%s: packed strided samples accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {1, 16, 8, AEC_DATA_PREPROCESS},
+        {1, 64, 2, 0},
+        {2, 8, 32, AEC_DATA_PREPROCESS | AEC_RESTRICTED},
+        {3, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {4, 16, 16, AEC_DATA_PREPROCESS | AEC_PIPELINE},
+        {7, 8, 32, AEC_DATA_PREPROCESS | AEC_STREAM_BLOCKS},
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {12, 16, 32, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+        {12, 32, 8, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {13, 8, 16, 0},
+        {16, 16, 8, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {20, 64, 4, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+        {24, 16, 8, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE},
+        {31, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {32, 16, 8, 0},
+    };
+    int status = 0;
+
+    pbuf = malloc(SAMPLES * 4);
+    ubuf = malloc(SAMPLES * 4);
+    rbuf = malloc(SAMPLES * 8);
+    cbuf = malloc(SAMPLES * 8);
+    obuf = malloc(SAMPLES * 4);
+    if (pbuf == NULL || ubuf == NULL || rbuf == NULL || cbuf == NULL
+        || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking packed samples ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        size_t rlen;
+
+        fill(&configs[i]);
+        status = check_encode(&configs[i], &rlen);
+        if (status == 0)
+            status = check_decode(&configs[i], rlen);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        status = check_params();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(pbuf);
+    free(ubuf);
+    free(rbuf);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
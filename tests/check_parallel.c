@@ -0,0 +1,298 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define BUF_SIZE (1024 * 1024)
+
+static unsigned char *ubuf, *cbuf, *pbuf, *obuf;
+
+static void fill(unsigned char *buf, size_t len, unsigned int seed)
+{
+    /**
+       Noise with varying amplitude and runs of zeros so that k
+       changes between RSIs.
+    */
+    for (size_t i = 0; i < len; i++) {
+        int amp = (int)((i >> 10) % 9);
+        seed = seed * 1103515245 + 12345;
+        if ((i >> 12) % 7 == 3)
+            buf[i] = 0;
+        else
+            buf[i] = (unsigned char)((seed >> 16) & ((1U << amp) - 1));
+    }
+}
+
+static int check_decode(struct aec_stream *strm, size_t clen, size_t len,
+                        unsigned int threads)
+{
+    /**
+       Decode cbuf in parallel and compare with serial decoding. The
+       output buffer is also cut short.
+    */
+
+    size_t out_len[2];
+
+    out_len[0] = len / 12 * 12;
+    out_len[1] = len / 24 * 12;
+    for (int i = 0; i < 2; i++) {
+        size_t serial_len;
+        int status;
+
+        strm->next_in = cbuf;
+        strm->avail_in = clen;
+        strm->next_out = obuf;
+        strm->avail_out = out_len[i];
+        if (aec_buffer_decode(strm) != AEC_OK)
+            return 99;
+        serial_len = strm->total_out;
+
+        strm->next_in = cbuf;
+        strm->avail_in = clen;
+        strm->next_out = pbuf;
+        strm->avail_out = out_len[i];
+        status = aec_buffer_decode_parallel(strm, threads);
+        if (status != AEC_OK) {
+            printf("%s: parallel decoding failed (%i).\n",
+                   CHECK_FAIL, status);
+            return 99;
+        }
+        if (strm->total_out != serial_len
+            || memcmp(obuf, pbuf, serial_len)) {
+            printf("%s: decoded output differs for bps %u, block %u, "
+                   "rsi %u, flags %u, len %zu, threads %u.\n",
+                   CHECK_FAIL, strm->bits_per_sample, strm->block_size,
+                   strm->rsi, strm->flags, out_len[i], threads);
+            return 99;
+        }
+    }
+    return 0;
+}
+
+static int check(unsigned int bps, unsigned int block_size, unsigned int rsi,
+                 unsigned int flags, size_t len, unsigned int threads)
+{
+    struct aec_stream strm;
+    size_t serial_len;
+    int status;
+
+    strm.bits_per_sample = bps;
+    strm.block_size = block_size;
+    strm.rsi = rsi;
+    strm.flags = flags;
+    strm.next_in = ubuf;
+    strm.avail_in = len;
+    strm.next_out = cbuf;
+    strm.avail_out = 2 * BUF_SIZE;
+    if (aec_buffer_encode(&strm) != AEC_OK)
+        return 99;
+    serial_len = strm.total_out;
+
+    strm.next_in = ubuf;
+    strm.avail_in = len;
+    strm.next_out = pbuf;
+    strm.avail_out = 2 * BUF_SIZE;
+    status = aec_buffer_encode_parallel(&strm, threads);
+    if (status != AEC_OK) {
+        printf("%s: parallel encoding failed (%i).\n", CHECK_FAIL, status);
+        return 99;
+    }
+
+    if (strm.total_out != serial_len
+        || memcmp(cbuf, pbuf, serial_len)) {
+        printf("%s: output differs for bps %u, block %u, rsi %u, "
+               "flags %u, len %zu, threads %u.\n",
+               CHECK_FAIL, bps, block_size, rsi, flags, len, threads);
+        return 99;
+    }
+
+    status = check_decode(&strm, serial_len, len, threads);
+    if (status)
+        return status;
+
+    if (serial_len > 1) {
+        strm.next_in = ubuf;
+        strm.avail_in = len;
+        strm.next_out = pbuf;
+        strm.avail_out = serial_len - 1;
+        if (aec_buffer_encode_parallel(&strm, threads)
+            != AEC_STREAM_ERROR) {
+            printf("%s: short output buffer not detected.\n", CHECK_FAIL);
+            return 99;
+        }
+    }
+    return 0;
+}
+
+static int check_large_output(void)
+{
+    /**
+       An output buffer which the input can never fill must not make
+       the decoder try to track more RSIs than the input holds.
+    */
+
+    struct aec_stream strm;
+    int status;
+
+    strm.bits_per_sample = 8;
+    strm.block_size = 16;
+    strm.rsi = 8;
+    strm.flags = AEC_DATA_PREPROCESS;
+    strm.next_in = ubuf;
+    strm.avail_in = BUF_SIZE;
+    strm.next_out = cbuf;
+    strm.avail_out = 2 * BUF_SIZE;
+    if (aec_buffer_encode(&strm) != AEC_OK)
+        return 99;
+
+    strm.next_in = cbuf;
+    strm.avail_in = strm.total_out;
+    strm.next_out = pbuf;
+    strm.avail_out = SIZE_MAX / 2;
+    status = aec_buffer_decode_parallel(&strm, 4);
+    if (status != AEC_OK || strm.total_out != BUF_SIZE
+        || memcmp(ubuf, pbuf, BUF_SIZE)) {
+        printf("%s: decoding into a large buffer failed (%i).\n",
+               CHECK_FAIL, status);
+        return 99;
+    }
+    return 0;
+}
+
+static size_t allocs;
+
+static void *count_alloc(void *opaque, size_t size)
+{
+    (void)opaque;
+    allocs++;
+    return malloc(size);
+}
+
+static void count_free(void *opaque, void *ptr)
+{
+    (void)opaque;
+    free(ptr);
+}
+
+static int check_corrupt(void)
+{
+    /**
+       A slice which fails on corrupt input must not make the whole
+       stream get decoded again serially. That would take another
+       decoder state.
+    */
+
+    struct aec_stream strm;
+    size_t clen;
+    size_t valid_allocs;
+
+    strm.bits_per_sample = 8;
+    strm.block_size = 16;
+    strm.rsi = 64;
+    strm.flags = AEC_DATA_PREPROCESS | AEC_CUSTOM_ALLOC;
+    strm.alloc_func = count_alloc;
+    strm.free_func = count_free;
+    strm.opaque = NULL;
+    strm.next_in = ubuf;
+    strm.avail_in = BUF_SIZE;
+    strm.next_out = cbuf;
+    strm.avail_out = 2 * BUF_SIZE;
+    if (aec_buffer_encode(&strm) != AEC_OK)
+        return 99;
+    clen = strm.total_out;
+
+    strm.next_in = cbuf;
+    strm.avail_in = clen;
+    strm.next_out = pbuf;
+    strm.avail_out = BUF_SIZE;
+    allocs = 0;
+    if (aec_buffer_decode_parallel(&strm, 4) != AEC_OK)
+        return 99;
+    valid_allocs = allocs;
+
+    /* Damage the second half until a slice fails */
+    for (size_t off = clen / 2; off + 3 < clen; off += clen / 64) {
+        unsigned char saved[3];
+        int status;
+
+        memcpy(saved, cbuf + off, 3);
+        memset(cbuf + off, 0xff, 3);
+        strm.next_in = cbuf;
+        strm.avail_in = clen;
+        strm.next_out = pbuf;
+        strm.avail_out = BUF_SIZE;
+        allocs = 0;
+        status = aec_buffer_decode_parallel(&strm, 4);
+        memcpy(cbuf + off, saved, 3);
+        if (status == AEC_DATA_ERROR) {
+            if (allocs != valid_allocs) {
+                printf("%s: corrupt stream decoded again serially.\n",
+                       CHECK_FAIL);
+                return 99;
+            }
+            return 0;
+        }
+    }
+    printf("%s: corrupt stream not detected.\n", CHECK_FAIL);
+    return 99;
+}
+
+int main(void)
+{
+    unsigned int bps[] = {1, 3, 8, 12, 16, 24, 32};
+    unsigned int threads[] = {2, 3, 8};
+    size_t len[] = {BUF_SIZE, BUF_SIZE - 1, BUF_SIZE / 3 + 5, 300};
+    int status = 0;
+
+    ubuf = malloc(BUF_SIZE);
+    cbuf = malloc(2 * BUF_SIZE);
+    pbuf = malloc(2 * BUF_SIZE);
+    obuf = malloc(2 * BUF_SIZE);
+    if (ubuf == NULL || cbuf == NULL || pbuf == NULL || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+    fill(ubuf, BUF_SIZE, 42);
+
+    printf("Checking parallel encoding and decoding ... ");
+    for (int b = 0; b < 7 && status == 0; b++) {
+        for (int t = 0; t < 3 && status == 0; t++) {
+            for (int l = 0; l < 4 && status == 0; l++) {
+                unsigned int flags = AEC_DATA_PREPROCESS;
+
+                if (bps[b] <= 4)
+                    flags |= AEC_RESTRICTED;
+                if (bps[b] == 24)
+                    flags |= AEC_DATA_3BYTE | AEC_DATA_MSB;
+                if (t == 1)
+                    flags |= AEC_DATA_SIGNED;
+                if (l != 1)
+                    flags |= AEC_PAD_RSI;
+                status = check(bps[b], 16, 8, flags, len[l], threads[t]);
+                if (status == 0)
+                    status = check(bps[b], 32, 64,
+                                   flags & ~AEC_DATA_PREPROCESS,
+                                   len[l], threads[t]);
+                if (status == 0)
+                    status = check(bps[b], 64, 4096, flags,
+                                   len[l], threads[t]);
+            }
+        }
+    }
+    if (status == 0)
+        status = check(8, 16, 1, AEC_DATA_PREPROCESS, BUF_SIZE, 0);
+    if (status == 0)
+        status = check_large_output();
+    if (status == 0)
+        status = check_corrupt();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(cbuf);
+    free(pbuf);
+    free(obuf);
+    return status;
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define BUF_SIZE (1024 * 96 + 12)
+#define MIN(a, b) (((a) < (b))? (a): (b))
+
+static unsigned char *ubuf, *cbuf, *pbuf, *obuf;
+
+static int encode(struct aec_stream *strm, unsigned char *dest,
+                  size_t in_chunk, size_t out_chunk, size_t *len)
+{
+    /**
+       Encode ubuf feeding input and output in chunks of the given
+       sizes.
+    */
+
+    size_t in = 0;
+    size_t out = 0;
+
+    strm->next_in = ubuf;
+    strm->next_out = dest;
+    strm->avail_in = 0;
+    strm->avail_out = 0;
+    do {
+        size_t n = MIN(in_chunk, BUF_SIZE - in);
+        int flush;
+
+        strm->avail_in += n;
+        in += n;
+        n = MIN(out_chunk, 2 * BUF_SIZE - out);
+        strm->avail_out += n;
+        out += n;
+        flush = in == BUF_SIZE ? AEC_FLUSH : AEC_NO_FLUSH;
+        if (aec_encode(strm, flush) != AEC_OK)
+            return 99;
+    } while (in < BUF_SIZE || strm->avail_out == 0);
+
+    *len = strm->total_out;
+    return 0;
+}
+
+static int decode(struct aec_stream *strm, size_t clen,
+                  size_t in_chunk, size_t out_chunk)
+{
+    /**
+       Decode cbuf into obuf feeding input and output in chunks of
+       the given sizes.
+    */
+
+    size_t in = 0;
+    size_t out = 0;
+
+    strm->next_in = cbuf;
+    strm->next_out = obuf;
+    strm->avail_in = 0;
+    strm->avail_out = 0;
+    while (strm->total_out < BUF_SIZE) {
+        size_t total_out = strm->total_out;
+        size_t n = MIN(in_chunk, clen - in);
+
+        strm->avail_in += n;
+        in += n;
+        n = MIN(out_chunk, BUF_SIZE - out);
+        strm->avail_out += n;
+        out += n;
+        if (aec_decode(strm, AEC_NO_FLUSH) != AEC_OK)
+            return 99;
+        if (in == clen && out == BUF_SIZE && strm->total_out == total_out)
+            break;
+    }
+    return strm->total_out == BUF_SIZE
+        && memcmp(ubuf, obuf, BUF_SIZE) == 0 ? 0 : 99;
+}
+
+static int check(unsigned int bps, unsigned int rsi, unsigned int flags,
+                 size_t in_chunk, size_t out_chunk)
+{
+    struct aec_stream strm;
+    size_t clen, plen;
+    int status;
+
+    strm.bits_per_sample = bps;
+    strm.block_size = 16;
+    strm.rsi = rsi;
+    strm.flags = flags;
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    status = encode(&strm, cbuf, BUF_SIZE, 2 * BUF_SIZE, &clen);
+    aec_encode_end(&strm);
+    if (status)
+        return status;
+
+    strm.flags = flags | AEC_PIPELINE;
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    for (int round = 0; round < 2 && status == 0; round++) {
+        memset(pbuf, 0, 2 * BUF_SIZE);
+        status = encode(&strm, pbuf, in_chunk, out_chunk, &plen);
+        if (status == 0 && (plen != clen || memcmp(cbuf, pbuf, clen))) {
+            printf("%s: pipelined output differs for bps %u, rsi %u, "
+                   "flags %u, chunks %zu/%zu.\n", CHECK_FAIL,
+                   bps, rsi, flags, in_chunk, out_chunk);
+            status = 99;
+        }
+        if (status == 0 && aec_encode_reset(&strm) != AEC_OK)
+            status = 99;
+    }
+    if (aec_encode_end(&strm) != AEC_OK && status == 0)
+        status = 99;
+    if (status)
+        return status;
+
+    if (aec_decode_init(&strm) != AEC_OK)
+        return 99;
+    for (int round = 0; round < 2 && status == 0; round++) {
+        memset(obuf, 0, BUF_SIZE);
+        status = decode(&strm, clen, out_chunk, in_chunk);
+        if (status)
+            printf("%s: pipelined decoding failed for bps %u, rsi %u, "
+                   "flags %u, chunks %zu/%zu.\n", CHECK_FAIL,
+                   bps, rsi, flags, out_chunk, in_chunk);
+        if (status == 0 && aec_decode_reset(&strm) != AEC_OK)
+            status = 99;
+    }
+    aec_decode_end(&strm);
+    return status;
+}
+
+int main(void)
+{
+    unsigned int seed = 11;
+    int status = 0;
+
+    ubuf = malloc(BUF_SIZE);
+    cbuf = malloc(2 * BUF_SIZE);
+    pbuf = malloc(2 * BUF_SIZE);
+    obuf = malloc(BUF_SIZE);
+    if (ubuf == NULL || cbuf == NULL || pbuf == NULL || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+    for (size_t i = 0; i < BUF_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        ubuf[i] = (unsigned char)((seed >> 16) & ((i >> 12) % 4 ? 0x3f : 0));
+    }
+
+    printf("Checking pipelined encoding and decoding ... ");
+    status = check(8, 16, AEC_DATA_PREPROCESS, BUF_SIZE, 2 * BUF_SIZE);
+    if (status == 0)
+        status = check(8, 16, AEC_DATA_PREPROCESS, 1000, 2 * BUF_SIZE);
+    if (status == 0)
+        status = check(16, 64, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED,
+                       5000, 100);
+    if (status == 0)
+        status = check(8, 4, 0, 777, 3);
+    if (status == 0)
+        status = check(16, 32, AEC_DATA_PREPROCESS | AEC_PAD_RSI,
+                       BUF_SIZE, 10);
+    if (status == 0)
+        status = check(30, 8, AEC_DATA_PREPROCESS | AEC_DATA_MSB,
+                       4096, 1);
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(cbuf);
+    free(pbuf);
+    free(obuf);
+    return status;
+}
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+#include "threads.h"
+
+#define BUF_SIZE (1024 * 8)
+#define THREADS 8
+#define ROUNDS 50
+
+struct worker {
+    struct aec_pool *pool;
+    int id;
+    int status;
+};
+
+static void fill(unsigned char *buf, size_t len, unsigned int seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (unsigned char)((seed >> 16) & 0x0f) + (unsigned char)(i >> 5);
+    }
+}
+
+static void set_params(struct aec_stream *strm, int variant)
+{
+    strm->bits_per_sample = variant & 1 ? 16 : 8;
+    strm->block_size = variant & 2 ? 32 : 16;
+    strm->rsi = 64;
+    strm->flags = AEC_DATA_PREPROCESS;
+}
+
+static int roundtrip(struct aec_pool *pool, int variant, unsigned int seed)
+{
+    struct aec_stream enc, dec;
+    unsigned char ubuf[BUF_SIZE], cbuf[2 * BUF_SIZE], obuf[BUF_SIZE];
+    int status = 0;
+
+    fill(ubuf, BUF_SIZE, seed);
+
+    set_params(&enc, variant);
+    enc.next_in = ubuf;
+    enc.avail_in = BUF_SIZE;
+    enc.next_out = cbuf;
+    enc.avail_out = sizeof(cbuf);
+    if (aec_pool_encode_acquire(pool, &enc) != AEC_OK)
+        return 99;
+    if (aec_encode(&enc, AEC_FLUSH) != AEC_OK)
+        status = 99;
+
+    set_params(&dec, variant);
+    dec.next_in = cbuf;
+    dec.avail_in = enc.total_out;
+    dec.next_out = obuf;
+    dec.avail_out = BUF_SIZE;
+    aec_pool_encode_release(pool, &enc);
+    if (status)
+        return status;
+
+    if (aec_pool_decode_acquire(pool, &dec) != AEC_OK)
+        return 99;
+    if (aec_decode(&dec, AEC_FLUSH) != AEC_OK
+        || dec.total_out != BUF_SIZE
+        || memcmp(ubuf, obuf, BUF_SIZE))
+        status = 99;
+    aec_pool_decode_release(pool, &dec);
+    return status;
+}
+
+static int check_hits(void)
+{
+    struct aec_pool *pool;
+    size_t hits, misses;
+
+    printf("Checking pool hits and misses ... ");
+
+    pool = aec_pool_create(32);
+    if (pool == NULL)
+        return 99;
+
+    /* miss, miss (encoder and decoder), then hits */
+    for (int i = 0; i < 3; i++)
+        if (roundtrip(pool, 0, i))
+            return 99;
+    aec_pool_stats(pool, &hits, &misses);
+    if (hits != 4 || misses != 2) {
+        printf("%s: got %zu hits and %zu misses, expected 4 and 2.\n",
+               CHECK_FAIL, hits, misses);
+        return 99;
+    }
+
+    /* different parameters don't match cached states */
+    if (roundtrip(pool, 3, 0))
+        return 99;
+    aec_pool_stats(pool, &hits, &misses);
+    if (hits != 4 || misses != 4) {
+        printf("%s: got %zu hits and %zu misses, expected 4 and 4.\n",
+               CHECK_FAIL, hits, misses);
+        return 99;
+    }
+
+    aec_pool_destroy(pool);
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static int check_capacity(void)
+{
+    struct aec_pool *pool;
+    struct aec_stream strm[20];
+    size_t hits, misses;
+
+    printf("Checking pool capacity ... ");
+
+    pool = aec_pool_create(16);
+    if (pool == NULL)
+        return 99;
+
+    for (int i = 0; i < 20; i++) {
+        set_params(&strm[i], 0);
+        if (aec_pool_encode_acquire(pool, &strm[i]) != AEC_OK)
+            return 99;
+    }
+    for (int i = 0; i < 20; i++)
+        aec_pool_encode_release(pool, &strm[i]);
+
+    /* The whole capacity is available to one set of parameters */
+    for (int i = 0; i < 20; i++)
+        if (aec_pool_encode_acquire(pool, &strm[i]) != AEC_OK)
+            return 99;
+    aec_pool_stats(pool, &hits, &misses);
+    if (hits != 16 || misses != 24) {
+        printf("%s: got %zu hits and %zu misses, expected 16 and 24.\n",
+               CHECK_FAIL, hits, misses);
+        return 99;
+    }
+    for (int i = 0; i < 20; i++)
+        aec_pool_encode_release(pool, &strm[i]);
+
+    aec_pool_destroy(pool);
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static void *acquire_one(void *arg)
+{
+    struct worker *w = arg;
+    struct aec_stream strm;
+
+    set_params(&strm, 0);
+    w->status = aec_pool_encode_acquire(w->pool, &strm);
+    if (w->status == AEC_OK)
+        aec_pool_encode_release(w->pool, &strm);
+    return NULL;
+}
+
+static int check_steal(void)
+{
+    struct aec_pool *pool;
+    struct aec_stream strm;
+    aec_thread_t thread;
+    struct worker w;
+    size_t hits, misses;
+
+    printf("Checking pool states of other threads ... ");
+
+    pool = aec_pool_create(4);
+    if (pool == NULL)
+        return 99;
+
+    set_params(&strm, 0);
+    if (aec_pool_encode_acquire(pool, &strm) != AEC_OK)
+        return 99;
+    aec_pool_encode_release(pool, &strm);
+
+    w.pool = pool;
+    w.status = 0;
+    if (aec_thread_create(&thread, acquire_one, &w))
+        return 99;
+    aec_thread_join(thread);
+    aec_pool_stats(pool, &hits, &misses);
+    if (w.status != AEC_OK || hits != 1 || misses != 1) {
+        printf("%s: got %zu hits and %zu misses, expected 1 and 1.\n",
+               CHECK_FAIL, hits, misses);
+        return 99;
+    }
+
+    aec_pool_destroy(pool);
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static int check_workspace(void)
+{
+    struct aec_pool *pool;
+    struct aec_stream strm;
+    size_t hits, misses;
+    void *workspace;
+
+    printf("Checking pool with caller workspaces ... ");
+
+    pool = aec_pool_create(4);
+    if (pool == NULL)
+        return 99;
+
+    set_params(&strm, 0);
+    workspace = malloc(aec_encode_workspace_size(&strm));
+    if (workspace == NULL
+        || aec_encode_init_workspace(&strm, workspace,
+                                     aec_encode_workspace_size(&strm))
+        != AEC_OK)
+        return 99;
+    aec_pool_encode_release(pool, &strm);
+    free(workspace);
+
+    /* The state in the freed workspace must not be handed out */
+    if (aec_pool_encode_acquire(pool, &strm) != AEC_OK)
+        return 99;
+    aec_pool_encode_release(pool, &strm);
+    aec_pool_stats(pool, &hits, &misses);
+    if (hits != 0 || misses != 1) {
+        printf("%s: got %zu hits and %zu misses, expected 0 and 1.\n",
+               CHECK_FAIL, hits, misses);
+        return 99;
+    }
+
+    aec_pool_destroy(pool);
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static void *work(void *arg)
+{
+    struct worker *w = arg;
+
+    for (int i = 0; i < ROUNDS && w->status == 0; i++)
+        w->status = roundtrip(w->pool, (w->id + i) & 3, w->id * ROUNDS + i);
+    return NULL;
+}
+
+static int check_threads(void)
+{
+    struct aec_pool *pool;
+    aec_thread_t thread[THREADS];
+    struct worker w[THREADS];
+    size_t hits, misses;
+
+    printf("Checking pool with %i threads ... ", THREADS);
+
+    pool = aec_pool_create(THREADS);
+    if (pool == NULL)
+        return 99;
+
+    for (int i = 0; i < THREADS; i++) {
+        w[i].pool = pool;
+        w[i].id = i;
+        w[i].status = 0;
+        if (aec_thread_create(&thread[i], work, &w[i]))
+            return 99;
+    }
+    for (int i = 0; i < THREADS; i++)
+        aec_thread_join(thread[i]);
+
+    for (int i = 0; i < THREADS; i++) {
+        if (w[i].status) {
+            printf("%s: round trip failed in thread %i.\n", CHECK_FAIL, i);
+            return 99;
+        }
+    }
+
+    aec_pool_stats(pool, &hits, &misses);
+    if (hits + misses != 2 * THREADS * ROUNDS || hits == 0) {
+        printf("%s: got %zu hits and %zu misses.\n",
+               CHECK_FAIL, hits, misses);
+        return 99;
+    }
+
+    aec_pool_destroy(pool);
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+int main(void)
+{
+    int status;
+
+    status = check_hits();
+    if (status)
+        return status;
+    status = check_capacity();
+    if (status)
+        return status;
+    status = check_steal();
+    if (status)
+        return status;
+    status = check_workspace();
+    if (status)
+        return status;
+    return check_threads();
+}
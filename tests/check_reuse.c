@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define BUF_SIZE (1024 * 12)
+
+static unsigned char *ubuf, *cbuf, *obuf;
+
+static void fill(unsigned char *buf, size_t len, unsigned int seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (unsigned char)((seed >> 16) & 0x07) + (unsigned char)(i >> 6);
+    }
+}
+
+static int roundtrip(struct aec_stream *enc, struct aec_stream *dec,
+                     int reset)
+{
+    int status;
+    size_t n = BUF_SIZE / 4 * 4;
+
+    enc->next_in = ubuf;
+    enc->avail_in = n;
+    enc->next_out = cbuf;
+    enc->avail_out = 2 * BUF_SIZE;
+    status = reset ? aec_encode_reset(enc) : AEC_OK;
+    if (status != AEC_OK) {
+        printf("%s: encoder reset failed (%i).\n", CHECK_FAIL, status);
+        return 99;
+    }
+    if (aec_encode(enc, AEC_FLUSH) != AEC_OK)
+        return 99;
+
+    dec->bits_per_sample = enc->bits_per_sample;
+    dec->block_size = enc->block_size;
+    dec->rsi = enc->rsi;
+    dec->flags = enc->flags;
+    dec->next_in = cbuf;
+    dec->avail_in = enc->total_out;
+    dec->next_out = obuf;
+    dec->avail_out = n;
+    status = reset ? aec_decode_reset(dec) : AEC_OK;
+    if (status != AEC_OK) {
+        printf("%s: decoder reset failed (%i).\n", CHECK_FAIL, status);
+        return 99;
+    }
+    if (aec_decode(dec, AEC_FLUSH) != AEC_OK)
+        return 99;
+
+    if (dec->total_out != n || memcmp(ubuf, obuf, n)) {
+        printf("%s: output differs for %u bits, rsi %u.\n",
+               CHECK_FAIL, enc->bits_per_sample, enc->rsi);
+        return 99;
+    }
+    return 0;
+}
+
+static int check_reset(void)
+{
+    struct aec_stream enc, dec;
+    unsigned int bps[] = {8, 16, 24, 32, 16};
+    unsigned int rsi[] = {16, 64, 16, 128, 256};
+    int status;
+
+    printf("Checking reset ... ");
+
+    enc.bits_per_sample = dec.bits_per_sample = bps[0];
+    enc.block_size = dec.block_size = 16;
+    enc.rsi = dec.rsi = rsi[0];
+    enc.flags = dec.flags = AEC_DATA_PREPROCESS;
+    if (aec_encode_init(&enc) != AEC_OK || aec_decode_init(&dec) != AEC_OK)
+        return 99;
+
+    for (int i = 0; i < 5; i++) {
+        enc.bits_per_sample = bps[i];
+        enc.rsi = rsi[i];
+        enc.flags = AEC_DATA_PREPROCESS;
+        if (i == 2)
+            enc.flags |= AEC_DATA_3BYTE | AEC_DATA_MSB;
+        if (i == 3)
+            enc.flags = 0;
+        if (i == 4)
+            enc.flags |= AEC_DATA_SIGNED;
+        status = roundtrip(&enc, &dec, 1);
+        if (status)
+            return status;
+    }
+
+    enc.bits_per_sample = 8;
+    enc.flags = AEC_RESTRICTED;
+    if (aec_encode_reset(&enc) != AEC_CONF_ERROR) {
+        printf("%s: reset accepted illegal parameters.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    aec_encode_end(&enc);
+    aec_decode_end(&dec);
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+static int check_workspace(void)
+{
+    struct aec_stream enc, dec;
+    void *enc_ws, *dec_ws;
+    size_t enc_size, dec_size;
+    int status;
+
+    printf("Checking caller provided workspace ... ");
+
+    enc.bits_per_sample = 16;
+    enc.block_size = 32;
+    enc.rsi = 64;
+    enc.flags = AEC_DATA_PREPROCESS | AEC_DATA_SIGNED;
+    dec = enc;
+
+    enc_size = aec_encode_workspace_size(&enc);
+    dec_size = aec_decode_workspace_size(&dec);
+    if (enc_size == 0 || dec_size == 0)
+        return 99;
+
+    enc_ws = malloc(enc_size);
+    dec_ws = malloc(dec_size + 1);
+    if (enc_ws == NULL || dec_ws == NULL)
+        return 99;
+
+    if (aec_encode_init_workspace(&enc, enc_ws, enc_size - 1)
+        != AEC_MEM_ERROR) {
+        printf("%s: accepted short workspace.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    /* Misaligned workspace must work as well */
+    if (aec_encode_init_workspace(&enc, enc_ws, enc_size) != AEC_OK
+        || aec_decode_init_workspace(&dec, (char *)dec_ws + 1,
+                                     dec_size) != AEC_OK)
+        return 99;
+
+    status = roundtrip(&enc, &dec, 0);
+    if (status)
+        return status;
+
+    /* Smaller RSI fits into the same workspace, larger doesn't */
+    enc.rsi = 32;
+    status = roundtrip(&enc, &dec, 1);
+    if (status)
+        return status;
+
+    enc.rsi = 128;
+    if (aec_encode_reset(&enc) != AEC_MEM_ERROR) {
+        printf("%s: reset overflows workspace.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    aec_encode_end(&enc);
+    aec_decode_end(&dec);
+    free(enc_ws);
+    free(dec_ws);
+
+    enc.bits_per_sample = 33;
+    if (aec_encode_workspace_size(&enc) != 0) {
+        printf("%s: workspace size for illegal parameters.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    printf("%s\n", CHECK_PASS);
+    return 0;
+}
+
+int main(void)
+{
+    int status;
+
+    ubuf = (unsigned char *)malloc(BUF_SIZE);
+    cbuf = (unsigned char *)malloc(2 * BUF_SIZE);
+    obuf = (unsigned char *)malloc(BUF_SIZE);
+
+    if (!ubuf || !cbuf || !obuf) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+    fill(ubuf, BUF_SIZE, 1);
+
+    status = check_reset();
+    if (status == 0)
+        status = check_workspace();
+
+    free(ubuf);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
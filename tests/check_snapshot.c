@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define MAX_SAMPLES 30000
+#define MAX_STATE (1 << 20)
+#define MIN(a, b) (((a) < (b))? (a): (b))
+
+static unsigned char *ubuf, *rbuf, *cbuf, *dbuf, *sbuf;
+
+static int migrate(struct aec_stream *strm, const struct test_config *c,
+                   int encoder)
+{
+    /**
+       Save the state of strm, end it, and continue in a new stream
+       from the snapshot.
+    */
+
+    size_t size = MAX_STATE;
+    size_t need = encoder ? aec_encode_state_size(strm)
+        : aec_decode_state_size(strm);
+    int status = encoder ? aec_encode_save_state(strm, sbuf, &size)
+        : aec_decode_save_state(strm, sbuf, &size);
+
+    if (status != AEC_OK || size != need) {
+        printf("%s: saving state failed with %i.\n", CHECK_FAIL, status);
+        return 99;
+    }
+    if (encoder)
+        aec_encode_end(strm);
+    else
+        aec_decode_end(strm);
+
+    memset(strm, 0, sizeof(*strm));
+    test_init(strm, c);
+    status = encoder ? aec_encode_restore_state(strm, sbuf, size)
+        : aec_decode_restore_state(strm, sbuf, size);
+    if (status != AEC_OK) {
+        printf("%s: restoring state failed with %i.\n", CHECK_FAIL,
+               status);
+        return 99;
+    }
+    return 0;
+}
+
+static int check(const struct test_config *c)
+{
+    /**
+       Encode and decode in pieces of varying size with a migration
+       of the stream after every call. The output has to be identical
+       to that of the buffer functions.
+    */
+
+    struct aec_stream strm;
+    size_t bytes = test_sample_bytes(c);
+    size_t len = MAX_SAMPLES * bytes - 3 * bytes;
+    size_t rlen;
+    int status;
+
+    test_fill(ubuf, c, MAX_SAMPLES, 400, 0);
+    if (test_encode(c, ubuf, len, rbuf, MAX_SAMPLES * 8, &rlen))
+        return 99;
+
+    test_init(&strm, c);
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    for (size_t round = 0;; round++) {
+        int flush = strm.total_in == len ? AEC_FLUSH : AEC_NO_FLUSH;
+
+        strm.next_in = ubuf + strm.total_in;
+        strm.avail_in = MIN(len - strm.total_in,
+                            (round * 389 % 1500 + 1) * bytes);
+        strm.next_out = cbuf + strm.total_out;
+        strm.avail_out = round % 3 ? round * 97 % 2000 + 1 : 1;
+        status = aec_encode(&strm, flush);
+        if (status != AEC_OK) {
+            printf("%s: encoding failed with %i.\n", CHECK_FAIL, status);
+            return 99;
+        }
+        if (flush == AEC_FLUSH && strm.avail_out > 0)
+            break;
+        if (migrate(&strm, c, 1))
+            return 99;
+    }
+    aec_encode_end(&strm);
+    if (strm.total_out != rlen || memcmp(cbuf, rbuf, rlen)) {
+        printf("%s: output of migrated encoder differs.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    test_init(&strm, c);
+    if (aec_decode_init(&strm) != AEC_OK)
+        return 99;
+    for (size_t round = 0; strm.total_out < len; round++) {
+        strm.next_in = cbuf + strm.total_in;
+        strm.avail_in = MIN(rlen - strm.total_in, round * 13 % 300 + 1);
+        strm.next_out = dbuf + strm.total_out;
+        strm.avail_out = MIN(len - strm.total_out,
+                             (round * 31 % 700 + 1) * bytes);
+        status = aec_decode(&strm, AEC_NO_FLUSH);
+        if (status != AEC_OK) {
+            printf("%s: decoding failed with %i.\n", CHECK_FAIL, status);
+            return 99;
+        }
+        if (migrate(&strm, c, 0))
+            return 99;
+    }
+    aec_decode_end(&strm);
+    if (memcmp(dbuf, ubuf, len)) {
+        printf("%s: output of migrated decoder differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+static int check_errors(void)
+{
+    static const struct test_config c = {16, 16, 32, AEC_DATA_PREPROCESS};
+    static const struct {
+        const char *name;
+        size_t index;
+        unsigned char value;
+    } fields[] = {
+        {"ref", 7, 2},
+        {"zero_ref", 9, 2},
+        {"k", 13, 15},
+        {"flush", 14, 3},
+    };
+    struct aec_stream strm;
+    size_t size = 10;
+    size_t need;
+
+    test_init(&strm, &c);
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    strm.next_in = ubuf;
+    strm.avail_in = 1000;
+    strm.next_out = cbuf;
+    strm.avail_out = MAX_SAMPLES;
+    aec_encode(&strm, AEC_NO_FLUSH);
+    need = aec_encode_state_size(&strm);
+    if (aec_encode_save_state(&strm, sbuf, &size) != AEC_STREAM_ERROR
+        || size != need) {
+        printf("%s: short snapshot buffer not detected.\n", CHECK_FAIL);
+        return 99;
+    }
+    aec_encode_save_state(&strm, sbuf, &size);
+    aec_encode_end(&strm);
+
+    /* Other parameters */
+    test_init(&strm, &c);
+    strm.rsi = 64;
+    if (aec_encode_restore_state(&strm, sbuf, size) != AEC_CONF_ERROR) {
+        printf("%s: snapshot with other parameters accepted.\n",
+               CHECK_FAIL);
+        return 99;
+    }
+
+    /* Truncated, damaged, or of the wrong kind */
+    test_init(&strm, &c);
+    if (aec_encode_restore_state(&strm, sbuf, size - 1) != AEC_DATA_ERROR
+        || aec_decode_restore_state(&strm, sbuf, size) != AEC_DATA_ERROR) {
+        printf("%s: damaged snapshot accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+    sbuf[0] ^= 1;
+    if (aec_encode_restore_state(&strm, sbuf, size) != AEC_DATA_ERROR) {
+        printf("%s: damaged snapshot accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+    sbuf[0] ^= 1;
+
+    /* Out of range fields of the encoder state, little endian after
+     * a 40 byte header */
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        unsigned char *p = sbuf + 40 + 4 * fields[i].index;
+        unsigned char saved = p[0];
+
+        p[0] = fields[i].value;
+        if (aec_encode_restore_state(&strm, sbuf, size) != AEC_DATA_ERROR) {
+            printf("%s: snapshot with %s out of range accepted.\n",
+                   CHECK_FAIL, fields[i].name);
+            return 99;
+        }
+        p[0] = saved;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {16, 16, 32, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+        {24, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE | AEC_DATA_MSB},
+        {32, 64, 2, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {12, 8, 16, 0},
+        {2, 8, 16, AEC_DATA_PREPROCESS | AEC_RESTRICTED},
+        {16, 16, 32, AEC_DATA_PREPROCESS | AEC_STREAM_BLOCKS},
+        {16, 8, 8, AEC_DATA_PREPROCESS | AEC_PIPELINE},
+    };
+    int status = 0;
+
+    ubuf = malloc(MAX_SAMPLES * 4);
+    rbuf = malloc(MAX_SAMPLES * 8);
+    cbuf = malloc(MAX_SAMPLES * 8);
+    dbuf = malloc(MAX_SAMPLES * 4);
+    sbuf = malloc(MAX_STATE);
+    if (ubuf == NULL || rbuf == NULL || cbuf == NULL || dbuf == NULL
+        || sbuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking saving and restoring of states ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        status = check(&configs[i]);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        status = check_errors();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(rbuf);
+    free(cbuf);
+    free(dbuf);
+    free(sbuf);
+    return status;
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define MAX_SAMPLES 30000
+
+/* Test case with the number of samples, the last zero_tail of them
+ * zero */
+struct config {
+    struct test_config code;
+    size_t samples;
+    size_t zero_tail;
+};
+
+static unsigned char *ubuf, *rbuf, *cbuf;
+
+static void fill(const struct config *c)
+{
+    size_t bytes = test_sample_bytes(&c->code);
+
+    /* Zero runs end at various blocks */
+    test_fill(ubuf, &c->code, c->samples, 97, 0);
+    memset(ubuf + (c->samples - c->zero_tail) * bytes, 0,
+           c->zero_tail * bytes);
+}
+
+static int check(const struct config *c, unsigned int flags)
+{
+    /**
+       Feed the samples in pieces which do not line up with blocks
+       or RSIs. The output has to be identical to the output of
+       aec_buffer_encode, also in the index.
+    */
+
+    struct aec_stream strm;
+    struct aec_index rindex = {0};
+    struct aec_index index = {0};
+    size_t bytes = test_sample_bytes(&c->code);
+    size_t len = c->samples * bytes;
+    size_t rlen;
+    size_t fed = 0;
+    int status;
+
+    fill(c);
+    test_init(&strm, &c->code);
+    strm.next_in = ubuf;
+    strm.avail_in = len;
+    strm.next_out = rbuf;
+    strm.avail_out = MAX_SAMPLES * 8;
+    if (aec_encode_init(&strm) != AEC_OK
+        || aec_encode_index(&strm, &rindex) != AEC_OK
+        || aec_encode(&strm, AEC_FLUSH) != AEC_OK) {
+        printf("%s: reference encoding failed.\n", CHECK_FAIL);
+        return 99;
+    }
+    rlen = strm.total_out;
+    aec_encode_end(&strm);
+
+    test_init(&strm, &c->code);
+    strm.flags |= AEC_STREAM_BLOCKS | flags;
+    if (aec_encode_init(&strm) != AEC_OK
+        || aec_encode_index(&strm, &index) != AEC_OK) {
+        printf("%s: init failed.\n", CHECK_FAIL);
+        return 99;
+    }
+    strm.next_in = ubuf;
+    strm.next_out = cbuf;
+    for (size_t round = 0; fed < len; round++) {
+        size_t n = (round * 37 % (3 * c->code.block_size) + 1) * bytes;
+
+        if (n > len - fed)
+            n = len - fed;
+        strm.avail_in += n;
+        fed += n;
+
+        /* Some calls with little output space */
+        do {
+            strm.avail_out = round % 4 ? MAX_SAMPLES * 8 : 3;
+            status = aec_encode(&strm, AEC_NO_FLUSH);
+            if (status != AEC_OK) {
+                printf("%s: encoding failed with %i.\n", CHECK_FAIL,
+                       status);
+                return 99;
+            }
+        } while (strm.avail_out == 0);
+
+        if (strm.avail_in >= bytes || strm.total_out > rlen
+            || memcmp(cbuf, rbuf, strm.total_out)) {
+            printf("%s: output differs after %zu bytes of input.\n",
+                   CHECK_FAIL, fed);
+            return 99;
+        }
+    }
+
+    do {
+        strm.avail_out = 5;
+        status = aec_encode(&strm, AEC_FLUSH);
+    } while (status == AEC_OK && strm.avail_out == 0);
+    aec_encode_end(&strm);
+    if (status != AEC_OK || strm.total_out != rlen
+        || memcmp(cbuf, rbuf, rlen)) {
+        printf("%s: final output differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    if (index.count != rindex.count || index.samples != rindex.samples
+        || memcmp(index.offsets, rindex.offsets,
+                  index.count * sizeof(uint64_t))) {
+        printf("%s: index differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    aec_index_free(&index);
+    aec_index_free(&rindex);
+    return 0;
+}
+
+static int check_early_output(void)
+{
+    /**
+       A block of noise has to show up in the output before the
+       rest of its RSI arrives.
+    */
+
+    static const struct config c = {{16, 16, 128, AEC_DATA_PREPROCESS},
+                                     16 * 128, 0};
+    struct aec_stream strm;
+    size_t out;
+    int status;
+
+    fill(&c);
+    test_init(&strm, &c.code);
+    strm.flags |= AEC_STREAM_BLOCKS;
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    strm.next_in = ubuf + 2 * 304;
+    strm.avail_in = 16 * 2;
+    strm.next_out = cbuf;
+    strm.avail_out = MAX_SAMPLES * 8;
+    status = aec_encode(&strm, AEC_NO_FLUSH);
+    out = strm.total_out;
+    aec_encode_end(&strm);
+    if (status != AEC_OK || out < 16) {
+        printf("%s: first block not encoded right away.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct config configs[] = {
+        {{8, 16, 8, AEC_DATA_PREPROCESS}, 16 * 8 * 23 + 5, 0},
+        {{16, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED}, 32 * 64, 0},
+        {{16, 16, 32, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+         16 * 32 * 20 + 48, 0},
+        {{16, 8, 128, AEC_DATA_PREPROCESS | AEC_PAD_RSI}, 8 * 128 * 9 + 3, 0},
+        {{24, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE},
+         8 * 16 * 30 + 8, 0},
+        {{32, 64, 2, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+         64 * 2 * 40 + 63, 0},
+        {{12, 8, 16, 0}, 8 * 16 * 50 + 17, 0},
+        {{12, 8, 16, AEC_PAD_RSI}, 8 * 16 * 50 + 16, 0},
+        {{2, 8, 100, AEC_DATA_PREPROCESS | AEC_RESTRICTED},
+         8 * 100 * 7 + 9, 0},
+        {{13, 64, 1, AEC_DATA_PREPROCESS | AEC_NOT_ENFORCE}, 64 * 100 + 1, 0},
+        /* The last RSI ends with a run of zero blocks */
+        {{16, 16, 64, AEC_DATA_PREPROCESS}, 16 * 64 * 3 + 16 * 10, 16 * 8},
+        {{16, 16, 64, AEC_DATA_PREPROCESS | AEC_PAD_RSI},
+         16 * 64 * 3 + 16 * 3, 16 * 2},
+    };
+    int status = 0;
+
+    ubuf = malloc(MAX_SAMPLES * 4);
+    rbuf = malloc(MAX_SAMPLES * 8);
+    cbuf = malloc(MAX_SAMPLES * 8);
+    if (ubuf == NULL || rbuf == NULL || cbuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking encoding of single blocks ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        status = check(&configs[i], 0);
+        if (status == 0)
+            status = check(&configs[i], AEC_PIPELINE);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        status = check_early_output();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(rbuf);
+    free(cbuf);
+    return status;
+}
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define SAMPLES 20003
+#define COMPONENTS 3
+#define GAP 0xa5
+
+/* Interleaved frames, one component packed, encoded data, output */
+static unsigned char *fbuf, *pbuf, *rbuf, *cbuf, *obuf;
+
+static size_t stride(const struct test_config *c)
+{
+    /* One byte of other data per frame */
+    return COMPONENTS * test_sample_bytes(c) + 1;
+}
+
+static void fill(const struct test_config *c)
+{
+    /* Each component with its own data, one gap byte per frame */
+    size_t bytes = test_sample_bytes(c);
+
+    memset(fbuf, GAP, SAMPLES * stride(c));
+    for (size_t k = 0; k < COMPONENTS; k++) {
+        test_fill(pbuf, c, SAMPLES, 500, (unsigned int)k);
+        for (size_t i = 0; i < SAMPLES; i++)
+            memcpy(fbuf + i * stride(c) + k * bytes, pbuf + i * bytes, bytes);
+    }
+}
+
+static void init_strided(struct aec_stream *strm, const struct test_config *c)
+{
+    test_init(strm, c);
+    strm->flags |= AEC_DATA_STRIDED;
+    strm->sample_stride = (unsigned int)stride(c);
+}
+
+static int check_component(const struct test_config *c, size_t k)
+{
+    struct aec_stream strm;
+    size_t bytes = test_sample_bytes(c);
+    size_t len = SAMPLES * stride(c);
+    size_t rlen;
+    int status;
+
+    /* Reference from the deinterleaved component */
+    for (size_t i = 0; i < SAMPLES; i++)
+        memcpy(pbuf + i * bytes, fbuf + i * stride(c) + k * bytes, bytes);
+    if (test_encode(c, pbuf, SAMPLES * bytes, rbuf, SAMPLES * 8, &rlen))
+        return 99;
+
+    /* In pieces which end inside of samples */
+    init_strided(&strm, c);
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    strm.next_out = cbuf;
+    strm.avail_out = SAMPLES * 8;
+    for (size_t round = 0; strm.total_in < len; round++) {
+        size_t n = round * 1237 % 9001 + 1;
+
+        strm.next_in = fbuf + k * bytes + strm.total_in;
+        strm.avail_in = n < len - strm.total_in ? n : len - strm.total_in;
+        status = aec_encode(&strm, strm.avail_in == len - strm.total_in
+                            ? AEC_FLUSH : AEC_NO_FLUSH);
+        if (status != AEC_OK) {
+            printf("%s: strided encoding failed with %i.\n", CHECK_FAIL,
+                   status);
+            return 99;
+        }
+    }
+    aec_encode_end(&strm);
+    if (strm.total_out != rlen || memcmp(cbuf, rbuf, rlen)) {
+        printf("%s: strided encoding of component %zu differs.\n",
+               CHECK_FAIL, k);
+        return 99;
+    }
+
+    init_strided(&strm, c);
+    strm.next_in = fbuf + k * bytes;
+    strm.avail_in = len;
+    strm.next_out = cbuf;
+    strm.avail_out = SAMPLES * 8;
+    status = aec_buffer_encode_parallel(&strm, 3);
+    if (status != AEC_OK || strm.total_out != rlen
+        || memcmp(cbuf, rbuf, rlen)) {
+        printf("%s: parallel strided encoding differs.\n", CHECK_FAIL);
+        return 99;
+    }
+
+    init_strided(&strm, c);
+    strm.next_in = fbuf + k * bytes;
+    strm.avail_in = len;
+    strm.next_out = cbuf;
+    strm.avail_out = SAMPLES * 8;
+    status = aec_buffer_encode_batch(&strm, 1, NULL, 2);
+    if (status != AEC_OK || strm.total_out != rlen
+        || memcmp(cbuf, rbuf, rlen)) {
+        printf("%s: batch strided encoding failed with %i.\n", CHECK_FAIL,
+               status);
+        return 99;
+    }
+
+    /* Decode into the frames next to the other components */
+    init_strided(&strm, c);
+    strm.next_in = rbuf;
+    strm.avail_in = rlen;
+    strm.next_out = obuf + k * bytes;
+    strm.avail_out = len;
+    status = aec_buffer_decode(&strm);
+    if (status != AEC_OK || strm.total_out != len) {
+        printf("%s: strided decoding failed with %i.\n", CHECK_FAIL,
+               status);
+        return 99;
+    }
+    return 0;
+}
+
+static int check_multi(const struct test_config *c)
+{
+    /**
+       Decode all components at once with aec_decode_multi().
+    */
+
+    struct aec_stream strm[COMPONENTS];
+    size_t bytes = test_sample_bytes(c);
+    size_t len = SAMPLES * stride(c);
+    size_t offset[COMPONENTS];
+    size_t clen[COMPONENTS];
+    int status;
+
+    for (size_t k = 0; k < COMPONENTS; k++) {
+        init_strided(&strm[k], c);
+        offset[k] = k * SAMPLES * 8;
+        strm[k].next_in = fbuf + k * bytes;
+        strm[k].avail_in = len;
+        strm[k].next_out = cbuf + offset[k];
+        strm[k].avail_out = SAMPLES * 8;
+        if (aec_buffer_encode(&strm[k]) != AEC_OK) {
+            printf("%s: strided encoding failed.\n", CHECK_FAIL);
+            return 99;
+        }
+        clen[k] = strm[k].total_out;
+    }
+
+    memset(obuf, GAP, len);
+    for (size_t k = 0; k < COMPONENTS; k++) {
+        init_strided(&strm[k], c);
+        if (aec_decode_init(&strm[k]) != AEC_OK)
+            return 99;
+        strm[k].next_in = cbuf + offset[k];
+        strm[k].avail_in = clen[k];
+        strm[k].next_out = obuf + k * bytes;
+        strm[k].avail_out = len;
+    }
+    status = aec_decode_multi(strm, COMPONENTS, AEC_FLUSH);
+    for (size_t k = 0; k < COMPONENTS; k++)
+        aec_decode_end(&strm[k]);
+    if (status != AEC_OK || memcmp(obuf, fbuf, len)) {
+        printf("%s: strided multi-stream decoding differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+static int check(const struct test_config *c)
+{
+    int status = 0;
+
+    fill(c);
+    memset(obuf, GAP, SAMPLES * stride(c));
+    for (size_t k = 0; k < COMPONENTS && status == 0; k++)
+        status = check_component(c, k);
+    if (status == 0 && memcmp(obuf, fbuf, SAMPLES * stride(c))) {
+        printf("%s: decoded frames differ.\n", CHECK_FAIL);
+        status = 99;
+    }
+    if (status == 0)
+        status = check_multi(c);
+    return status;
+}
+
+static int check_params(void)
+{
+    static const struct test_config c = {16, 16, 32, AEC_DATA_PREPROCESS};
+    struct aec_stream strm;
+
+    init_strided(&strm, &c);
+    strm.sample_stride = 1;
+    if (aec_encode_init(&strm) != AEC_CONF_ERROR
+        || aec_decode_init(&strm) != AEC_CONF_ERROR) {
+        printf("%s: stride shorter than a sample accepted.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {16, 32, 4, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED | AEC_DATA_MSB},
+        {16, 16, 32, AEC_DATA_PREPROCESS | AEC_PIPELINE},
+        {24, 8, 16, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE},
+        {24, 16, 8, AEC_DATA_PREPROCESS | AEC_DATA_3BYTE | AEC_DATA_MSB},
+        {32, 64, 2, AEC_DATA_PREPROCESS | AEC_DATA_SIGNED},
+        {32, 8, 16, AEC_DATA_MSB},
+        {12, 8, 16, AEC_DATA_PREPROCESS | AEC_STREAM_BLOCKS},
+    };
+    int status = 0;
+
+    fbuf = malloc(SAMPLES * (COMPONENTS * 4 + 1));
+    pbuf = malloc(SAMPLES * 4);
+    rbuf = malloc(SAMPLES * 8);
+    cbuf = malloc(COMPONENTS * SAMPLES * 8);
+    obuf = malloc(SAMPLES * (COMPONENTS * 4 + 1));
+    if (fbuf == NULL || pbuf == NULL || rbuf == NULL || cbuf == NULL
+        || obuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking strided samples ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        status = check(&configs[i]);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        status = check_params();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(fbuf);
+    free(pbuf);
+    free(rbuf);
+    free(cbuf);
+    free(obuf);
+    return status;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define SAMPLES 50000
+
+static unsigned char *ubuf, *rbuf, *cbuf, *dbuf;
+
+static void fill(void)
+{
+    unsigned int seed = 1;
+    unsigned int x = 0;
+
+    for (size_t i = 0; i < SAMPLES; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i / 700 % 4 == 0)
+            x = 0;
+        else if (i / 700 % 4 == 3)
+            x = seed >> 10;
+        else
+            x += (seed >> 16) % 7 - 3;
+        ubuf[2 * i] = (unsigned char)x;
+        ubuf[2 * i + 1] = (unsigned char)(x >> 8);
+    }
+}
+
+static void init(struct aec_stream *strm, unsigned int flags)
+{
+    strm->bits_per_sample = 16;
+    strm->block_size = 16;
+    strm->rsi = 32;
+    strm->flags = AEC_DATA_PREPROCESS | AEC_PAD_RSI | flags;
+}
+
+static int check(unsigned int flags)
+{
+    /**
+       Feed input in pieces with AEC_SYNC_FLUSH. After every call
+       the output has to end exactly at the last complete RSI of the
+       reference stream.
+    */
+
+    struct aec_stream strm;
+    struct aec_index index = {0};
+    size_t rsi_bytes = 16 * 32 * 2;
+    size_t rlen;
+    size_t fed = 0;
+    int status;
+
+    init(&strm, flags);
+    strm.next_in = ubuf;
+    strm.avail_in = SAMPLES * 2;
+    strm.next_out = rbuf;
+    strm.avail_out = SAMPLES * 4;
+    index.interval = 1;
+    if (aec_encode_init(&strm) != AEC_OK
+        || aec_encode_index(&strm, &index) != AEC_OK
+        || aec_encode(&strm, AEC_FLUSH) != AEC_OK) {
+        printf("%s: reference encoding failed.\n", CHECK_FAIL);
+        return 99;
+    }
+    rlen = strm.total_out;
+    aec_encode_end(&strm);
+
+    init(&strm, flags);
+    if (aec_encode_init(&strm) != AEC_OK) {
+        printf("%s: init failed.\n", CHECK_FAIL);
+        return 99;
+    }
+    strm.next_in = ubuf;
+    strm.next_out = cbuf;
+    for (size_t round = 0; fed < SAMPLES * 2; round++) {
+        size_t n = (round % 7 + 1) * 777 * 2;
+        size_t rsis;
+        size_t expect;
+
+        if (n > SAMPLES * 2 - fed)
+            n = SAMPLES * 2 - fed;
+        strm.avail_in += n;
+        fed += n;
+
+        /* Some calls with little output space */
+        do {
+            strm.avail_out = round % 3 ? SAMPLES * 4 : 5;
+            status = aec_encode(&strm, AEC_SYNC_FLUSH);
+            if (status != AEC_OK) {
+                printf("%s: sync flush failed with %i.\n", CHECK_FAIL,
+                       status);
+                return 99;
+            }
+        } while (strm.avail_out == 0);
+
+        rsis = fed / rsi_bytes;
+        expect = rsis < index.count ? index.offsets[rsis] / 8 : rlen;
+        if (strm.total_out != expect
+            || memcmp(cbuf, rbuf, strm.total_out)) {
+            printf("%s: output does not end at RSI %zu.\n",
+                   CHECK_FAIL, rsis);
+            return 99;
+        }
+
+        /* The output so far can be decoded on its own */
+        if (round % 5 == 0 && rsis > 0) {
+            struct aec_stream dec;
+
+            init(&dec, flags);
+            dec.next_in = cbuf;
+            dec.avail_in = strm.total_out;
+            dec.next_out = dbuf;
+            dec.avail_out = rsis * rsi_bytes;
+            status = aec_buffer_decode(&dec);
+            if (status != AEC_OK || dec.total_out != rsis * rsi_bytes
+                || memcmp(dbuf, ubuf, rsis * rsi_bytes)) {
+                printf("%s: synced output does not decode.\n", CHECK_FAIL);
+                return 99;
+            }
+        }
+    }
+
+    strm.avail_out = SAMPLES * 4;
+    status = aec_encode(&strm, AEC_FLUSH);
+    aec_encode_end(&strm);
+    aec_index_free(&index);
+    if (status != AEC_OK || strm.total_out != rlen
+        || memcmp(cbuf, rbuf, rlen)) {
+        printf("%s: final output differs.\n", CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+static int check_no_pad(void)
+{
+    struct aec_stream strm;
+    unsigned char out[16];
+    int status;
+
+    init(&strm, 0);
+    strm.flags &= ~AEC_PAD_RSI;
+    if (aec_encode_init(&strm) != AEC_OK)
+        return 99;
+    strm.next_in = ubuf;
+    strm.avail_in = 2;
+    strm.next_out = out;
+    strm.avail_out = sizeof(out);
+    status = aec_encode(&strm, AEC_SYNC_FLUSH);
+    aec_encode_end(&strm);
+    if (status != AEC_CONF_ERROR || strm.avail_in != 2) {
+        printf("%s: sync flush without AEC_PAD_RSI accepted.\n",
+               CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int status;
+
+    ubuf = malloc(SAMPLES * 2);
+    rbuf = malloc(SAMPLES * 4);
+    cbuf = malloc(SAMPLES * 4);
+    dbuf = malloc(SAMPLES * 2);
+    if (ubuf == NULL || rbuf == NULL || cbuf == NULL || dbuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+    fill();
+
+    printf("Checking sync flush ... ");
+    status = check(0);
+    if (status == 0)
+        status = check(AEC_PIPELINE);
+    if (status == 0)
+        status = check_no_pad();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(ubuf);
+    free(rbuf);
+    free(cbuf);
+    free(dbuf);
+    return status;
+}
@@ -13,8 +13,8 @@ int main(int argc, char *argv[])
 {
     int status;
     SZ_com_t sz_param;
-    unsigned char *source, *dest, *dest1;
-    size_t destLen, dest1Len, sourceLen;
+    unsigned char *source, *dest, *dest1, *dest2;
+    size_t destLen, dest1Len, dest2Len, sourceLen;
     FILE *fp;
 
     if (argc < 2) {
@@ -39,8 +39,9 @@ int main(int argc, char *argv[])
     source = (unsigned char *)malloc(sourceLen);
     dest = (unsigned char *)malloc(destLen);
     dest1 = (unsigned char *)malloc(destLen);
+    dest2 = (unsigned char *)malloc(destLen);
 
-    if (source == NULL || dest == NULL || dest1 == NULL)
+    if (source == NULL || dest == NULL || dest1 == NULL || dest2 == NULL)
         return 1;
 
     sourceLen = fread(source, 1, sourceLen, fp);
@@ -59,8 +60,34 @@ int main(int argc, char *argv[])
     if (memcmp(source, dest1, sourceLen) != 0)
         fprintf(stderr, "File %s Buffers differ\n", argv[2]);
 
+    /* Multithreaded coding has to give the same results */
+    sz_param.options_mask = OPTIONS_MASK | SZ_THREADS_OPTION_MASK;
+    dest2Len = sourceLen + sourceLen / 10;
+    status = SZ_BufftoBuffCompress(dest2, &dest2Len,
+                                   source, sourceLen, &sz_param);
+    if (status != SZ_OK)
+        return status;
+    if (dest2Len != destLen || memcmp(dest, dest2, destLen) != 0) {
+        fprintf(stderr, "File %s Multithreaded compression differs\n",
+                argv[1]);
+        return 1;
+    }
+
+    memset(dest1, 0, sourceLen);
+    dest1Len = sourceLen;
+    status = SZ_BufftoBuffDecompress(dest1, &dest1Len,
+                                     dest, destLen, &sz_param);
+    if (status != SZ_OK)
+        return status;
+    if (dest1Len != sourceLen || memcmp(source, dest1, sourceLen) != 0) {
+        fprintf(stderr, "File %s Multithreaded decompression differs\n",
+                argv[1]);
+        return 1;
+    }
+
     free(source);
     free(dest);
     free(dest1);
+    free(dest2);
     return 0;
 }
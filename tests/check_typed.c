@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libaec.h"
+#include "check_aec.h"
+
+#define SAMPLES 20011
+
+/* Samples as little endian bytes, encoded reference, typed output */
+static unsigned char *bbuf, *rbuf, *cbuf;
+
+static uint32_t sample(size_t i, size_t width)
+{
+    uint32_t v = 0;
+
+    for (size_t b = 0; b < width; b++)
+        v |= (uint32_t)bbuf[i * width + b] << (8 * b);
+    return v;
+}
+
+/* Encode an array of TYPE holding the sign extended samples, compare
+ * with the byte oriented reference and decode it again. Layout
+ * flags are set on purpose and must be ignored and left alone. */
+#define CHECK_TYPED(NAME, TYPE, SIGNED)                                 \
+    static int check_##NAME(const struct test_config *c)                \
+    {                                                                   \
+        struct aec_stream strm;                                         \
+        struct test_config ref = *c;                                    \
+        TYPE *src = malloc(SAMPLES * sizeof(TYPE));                     \
+        TYPE *dst = malloc(SAMPLES * sizeof(TYPE));                     \
+        uint32_t m = UINT32_C(1) << (c->bits_per_sample - 1);           \
+        size_t rlen;                                                    \
+        int status = 0;                                                 \
+                                                                        \
+        if (src == NULL || dst == NULL) {                               \
+            free(src);                                                  \
+            free(dst);                                                  \
+            return 99;                                                  \
+        }                                                               \
+        if (SIGNED)                                                     \
+            ref.flags |= AEC_DATA_SIGNED;                               \
+        if (test_encode(&ref, bbuf, SAMPLES * sizeof(TYPE), rbuf,       \
+                        SAMPLES * 8, &rlen))                            \
+            status = 99;                                                \
+        for (size_t i = 0; i < SAMPLES; i++) {                          \
+            uint32_t v = sample(i, sizeof(TYPE));                       \
+            src[i] = (TYPE)(SIGNED ? (v ^ m) - m : v);                  \
+        }                                                               \
+                                                                        \
+        test_init(&strm, c);                                            \
+        strm.flags |= AEC_DATA_MSB | AEC_DATA_PACKED                    \
+            | (SIGNED ? 0 : AEC_DATA_SIGNED);                           \
+        strm.next_out = cbuf;                                           \
+        strm.avail_out = SAMPLES * 8;                                   \
+        if (status == 0                                                 \
+            && (aec_encode_##NAME(&strm, src, SAMPLES) != AEC_OK        \
+                || strm.total_out != rlen                               \
+                || memcmp(cbuf, rbuf, rlen))) {                         \
+            printf("%s: aec_encode_" #NAME "() differs with %u bits.\n",\
+                   CHECK_FAIL, c->bits_per_sample);                     \
+            status = 99;                                                \
+        }                                                               \
+        if (status == 0                                                 \
+            && strm.flags != (c->flags | AEC_DATA_MSB | AEC_DATA_PACKED \
+                              | (SIGNED ? 0 : AEC_DATA_SIGNED))) {      \
+            printf("%s: flags changed.\n", CHECK_FAIL);                 \
+            status = 99;                                                \
+        }                                                               \
+                                                                        \
+        strm.next_in = rbuf;                                            \
+        strm.avail_in = rlen;                                           \
+        memset(dst, 0x5a, SAMPLES * sizeof(TYPE));                      \
+        if (status == 0                                                 \
+            && (aec_decode_##NAME(&strm, dst, SAMPLES) != AEC_OK        \
+                || strm.total_out != SAMPLES * sizeof(TYPE)             \
+                || memcmp(dst, src, SAMPLES * sizeof(TYPE)))) {         \
+            printf("%s: aec_decode_" #NAME "() differs with %u bits.\n",\
+                   CHECK_FAIL, c->bits_per_sample);                     \
+            status = 99;                                                \
+        }                                                               \
+        free(src);                                                      \
+        free(dst);                                                      \
+        return status;                                                  \
+    }
+
+CHECK_TYPED(u8, uint8_t, 0)
+CHECK_TYPED(i8, int8_t, 1)
+CHECK_TYPED(u16, uint16_t, 0)
+CHECK_TYPED(i16, int16_t, 1)
+CHECK_TYPED(u32, uint32_t, 0)
+CHECK_TYPED(i32, int32_t, 1)
+
+static int check(const struct test_config *c)
+{
+    int status;
+
+    test_fill(bbuf, c, SAMPLES, 700, 0);
+    if (c->bits_per_sample <= 8) {
+        status = check_u8(c);
+        if (status == 0)
+            status = check_i8(c);
+    } else if (c->bits_per_sample <= 16) {
+        status = check_u16(c);
+        if (status == 0)
+            status = check_i16(c);
+    } else {
+        status = check_u32(c);
+        if (status == 0)
+            status = check_i32(c);
+    }
+    return status;
+}
+
+static int check_params(void)
+{
+    struct aec_stream strm;
+    uint16_t s16[8] = {0};
+    uint32_t s32[8] = {0};
+
+    strm.bits_per_sample = 8;
+    strm.block_size = 8;
+    strm.rsi = 1;
+    strm.flags = AEC_DATA_PREPROCESS;
+    strm.next_out = cbuf;
+    strm.avail_out = 64;
+    if (aec_encode_u16(&strm, s16, 8) != AEC_CONF_ERROR
+        || aec_decode_u16(&strm, s16, 8) != AEC_CONF_ERROR) {
+        printf("%s: 8 bit samples in 16 bit array accepted.\n",
+               CHECK_FAIL);
+        return 99;
+    }
+    strm.bits_per_sample = 16;
+    if (aec_encode_u32(&strm, s32, 8) != AEC_CONF_ERROR
+        || aec_decode_i32(&strm, (int32_t *)s32, 8) != AEC_CONF_ERROR) {
+        printf("%s: 16 bit samples in 32 bit array accepted.\n",
+               CHECK_FAIL);
+        return 99;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const struct test_config configs[] = {
+        {3, 8, 16, AEC_DATA_PREPROCESS},
+        {8, 16, 8, AEC_DATA_PREPROCESS},
+        {7, 16, 8, 0},
+        {12, 16, 32, AEC_DATA_PREPROCESS},
+        {12, 32, 4, 0},
+        {16, 16, 32, AEC_DATA_PREPROCESS | AEC_PIPELINE},
+        {16, 64, 2, AEC_DATA_PREPROCESS | AEC_STREAM_BLOCKS},
+        {20, 8, 16, AEC_DATA_PREPROCESS},
+        {24, 16, 8, 0},
+        {32, 16, 8, AEC_DATA_PREPROCESS},
+        {32, 32, 4, 0},
+    };
+    int status = 0;
+
+    bbuf = malloc(SAMPLES * 4);
+    rbuf = malloc(SAMPLES * 8);
+    cbuf = malloc(SAMPLES * 8);
+    if (bbuf == NULL || rbuf == NULL || cbuf == NULL) {
+        printf("Not enough memory.\n");
+        return 99;
+    }
+
+    printf("Checking typed arrays ... ");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        status = check(&configs[i]);
+        if (status)
+            break;
+    }
+    if (status == 0)
+        status = check_params();
+    if (status == 0)
+        printf("%s\n", CHECK_PASS);
+
+    free(bbuf);
+    free(rbuf);
+    free(cbuf);
+    return status;
+}
@@ -86,3 +86,7 @@ decode "${EXTP}/sar32bit.j16.r256.rz" "${EXTP}/sar32bit.dat" \
        "-n32 -j16 -r256 -p"
 decode "${EXTP}/sar32bit.j64.r4096.rz" "${EXTP}/sar32bit.dat" \
        "-n32 -j64 -r4096 -p"
+code_size "${EXTP}/sar32bit.j16.r256.rz" "${EXTP}/sar32bit.dat" \
+          "-n32 -j16 -r256 -p"
+code_size "${EXTP}/sar32bit.j64.r4096.rz" "${EXTP}/sar32bit.dat" \
+          "-n32 -j64 -r4096 -p"
@@ -6,3 +6,4 @@ if [ ! -f $testfile ]; then
     exit -1
 fi
 ./check_szcomp $testfile
+LIBAEC_SZ_THREADS=4 ./check_szcomp $testfile